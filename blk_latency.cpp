@@ -0,0 +1,495 @@
+#include <QDateTime>
+#include <QFile>
+#include <QMap>
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <linux/bpf.h>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+
+#include "widget.h"
+#include "blk_latency.h"
+
+#define TRACEFS             "/sys/kernel/tracing/events/block/"
+#define TRACEFS_DEBUG       "/sys/kernel/debug/tracing/events/block/"
+#define START_ENTRIES       65536       // requests in flight over all the slots
+#define VERIFIER_LOG_LEN    65536
+
+/* Offsets of the tracepoint fields the programs read */
+typedef struct ST_TPFIELDS {
+    int id;
+    int dev;                // dev_t, u32
+    int sector;             // sector_t, u64
+    int rwbs;               // char[8], "R", "W", "FWS", "D", ...
+} _ST_TPFIELDS;
+
+static const char * OP_NAME[BLKLAT_NOPS] = { "read", "write", "other" };
+
+static long
+sys_bpf(int cmd, union bpf_attr * attr)
+{
+    return syscall(__NR_bpf, cmd, attr, sizeof(*attr));
+}
+
+static int
+map_create(int key_size, int value_size, int entries)
+{
+    union bpf_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.map_type = BPF_MAP_TYPE_HASH;
+    attr.key_size = key_size;
+    attr.value_size = value_size;
+    attr.max_entries = entries;
+    return sys_bpf(BPF_MAP_CREATE, &attr);
+}
+
+static int
+map_update(int fd, const void * key, const void * value)
+{
+    union bpf_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.map_fd = fd;
+    attr.key = (uint64_t)(uintptr_t) key;
+    attr.value = (uint64_t)(uintptr_t) value;
+    attr.flags = BPF_ANY;
+    return sys_bpf(BPF_MAP_UPDATE_ELEM, &attr);
+}
+
+/* Read one field offset out of a tracepoint format file, -1 if not there */
+static int
+field_offset(const QStringList & format, const QString & name)
+{
+    for (const QString & line : format) {
+        // "\tfield:dev_t dev;\toffset:8;\tsize:4;\tsigned:0;"
+        QStringList parts = line.trimmed().split(';');
+        if (parts.size() < 2 || false == parts[0].startsWith("field:")) {
+            continue;
+        }
+        QString field = parts[0].section(' ', -1).section('[', 0, 0);
+        if (field == name) {
+            return parts[1].trimmed().section(':', 1).toInt();
+        }
+    }
+    return -1;
+}
+
+static bool
+tracepoint_fields(const QString & event, _ST_TPFIELDS & tp)
+{
+    QString dir = QFile::exists(TRACEFS + event) ? TRACEFS + event : TRACEFS_DEBUG + event;
+    QFile id(dir + "/id"), format(dir + "/format");
+    if (false == id.open(QIODevice::ReadOnly | QIODevice::Text) || false == format.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        qDebug() << "tracepoint not found: " << dir;
+        return false;
+    }
+    QStringList lines = QString(format.readAll()).split('\n');
+    tp.id = QString(id.readAll()).trimmed().toInt();
+    tp.dev = field_offset(lines, "dev");
+    tp.sector = field_offset(lines, "sector");
+    tp.rwbs = field_offset(lines, "rwbs");
+    return tp.id > 0 && tp.dev >= 0 && tp.sector >= 0 && tp.rwbs >= 0;
+}
+
+/* A tiny assembler for the two programs */
+class BpfProg
+{
+public:
+    void op(uint8_t code, int dst, int src, int off, int imm) {
+        struct bpf_insn i;
+        memset(&i, 0, sizeof(i));
+        i.code = code;
+        i.dst_reg = dst;
+        i.src_reg = src;
+        i.off = off;
+        i.imm = imm;
+        insns.append(i);
+    }
+    void mov(int dst, int src)          { op(BPF_ALU64 | BPF_MOV | BPF_X, dst, src, 0, 0); }
+    void movi(int dst, int imm)         { op(BPF_ALU64 | BPF_MOV | BPF_K, dst, 0, 0, imm); }
+    void alui(int alu, int dst, int imm) { op(BPF_ALU64 | alu | BPF_K, dst, 0, 0, imm); }
+    void alu(int alu, int dst, int src) { op(BPF_ALU64 | alu | BPF_X, dst, src, 0, 0); }
+    void ldx(int size, int dst, int src, int off) { op(BPF_LDX | size | BPF_MEM, dst, src, off, 0); }
+    void stx(int size, int dst, int off, int src) { op(BPF_STX | size | BPF_MEM, dst, src, off, 0); }
+    void sti(int size, int dst, int off, int imm) { op(BPF_ST | size | BPF_MEM, dst, 0, off, imm); }
+    void call(int func)                 { op(BPF_JMP | BPF_CALL, 0, 0, 0, func); }
+    void exit0()                        { movi(BPF_REG_0, 0); op(BPF_JMP | BPF_EXIT, 0, 0, 0, 0); }
+    void map(int dst, int fd) {
+        op(BPF_LD | BPF_DW | BPF_IMM, dst, BPF_PSEUDO_MAP_FD, 0, fd);
+        op(0, 0, 0, 0, 0);
+    }
+    void stack_ptr(int dst, int off)    { mov(dst, BPF_REG_10); alui(BPF_ADD, dst, off); }
+    /* A forward jump to be pointed at a later instruction by land() */
+    int jmpi(int jmp, int dst, int imm) { op(BPF_JMP | jmp | BPF_K, dst, 0, 0, imm); return insns.size() - 1; }
+    void land(int at)                   { insns[at].off = insns.size() - at - 1; }
+
+    QVector<struct bpf_insn> insns;
+};
+
+/* The (dev_t, sector) key of a request at fp-24 */
+static void
+start_key(BpfProg & p, const _ST_TPFIELDS & tp)
+{
+    p.ldx(BPF_W, BPF_REG_2, BPF_REG_6, tp.dev);
+    p.stx(BPF_W, BPF_REG_10, -24, BPF_REG_2);
+    p.sti(BPF_W, BPF_REG_10, -20, 0);
+    p.ldx(BPF_DW, BPF_REG_2, BPF_REG_6, tp.sector);
+    p.stx(BPF_DW, BPF_REG_10, -16, BPF_REG_2);
+}
+
+/* block_rq_issue: the time of a request to a slot traced */
+static BpfProg
+issue_prog(const _ST_TPFIELDS & tp, int devs, int start)
+{
+    BpfProg p;
+    p.mov(BPF_REG_6, BPF_REG_1);
+    p.ldx(BPF_W, BPF_REG_2, BPF_REG_6, tp.dev);
+    p.stx(BPF_W, BPF_REG_10, -4, BPF_REG_2);
+    p.map(BPF_REG_1, devs);
+    p.stack_ptr(BPF_REG_2, -4);
+    p.call(BPF_FUNC_map_lookup_elem);
+    int out = p.jmpi(BPF_JEQ, BPF_REG_0, 0);
+
+    start_key(p, tp);
+    p.call(BPF_FUNC_ktime_get_ns);
+    p.stx(BPF_DW, BPF_REG_10, -32, BPF_REG_0);
+    p.map(BPF_REG_1, start);
+    p.stack_ptr(BPF_REG_2, -24);
+    p.stack_ptr(BPF_REG_3, -32);
+    p.movi(BPF_REG_4, BPF_ANY);
+    p.call(BPF_FUNC_map_update_elem);
+
+    p.land(out);
+    p.exit0();
+    return p;
+}
+
+/* block_rq_complete: the latency of a request issued into its log2 bucket */
+static BpfProg
+complete_prog(const _ST_TPFIELDS & tp, int start, int hist)
+{
+    BpfProg p;
+    p.mov(BPF_REG_6, BPF_REG_1);
+    start_key(p, tp);
+    p.map(BPF_REG_1, start);
+    p.stack_ptr(BPF_REG_2, -24);
+    p.call(BPF_FUNC_map_lookup_elem);
+    int out = p.jmpi(BPF_JEQ, BPF_REG_0, 0);
+
+    // r7 = now - issued, in us
+    p.ldx(BPF_DW, BPF_REG_7, BPF_REG_0, 0);
+    p.call(BPF_FUNC_ktime_get_ns);
+    p.alu(BPF_SUB, BPF_REG_0, BPF_REG_7);
+    p.mov(BPF_REG_7, BPF_REG_0);
+    p.map(BPF_REG_1, start);
+    p.stack_ptr(BPF_REG_2, -24);
+    p.call(BPF_FUNC_map_delete_elem);
+    p.alui(BPF_DIV, BPF_REG_7, 1000);
+
+    // r8 = log2(r7) by halving, no loops for the verifier
+    p.movi(BPF_REG_8, 0);
+    for (int shift = 32; shift > 0; shift >>= 1) {
+        p.mov(BPF_REG_1, BPF_REG_7);
+        p.alui(BPF_RSH, BPF_REG_1, shift);
+        int skip = p.jmpi(BPF_JEQ, BPF_REG_1, 0);
+        p.alui(BPF_ADD, BPF_REG_8, shift);
+        p.mov(BPF_REG_7, BPF_REG_1);
+        p.land(skip);
+    }
+    int small = p.jmpi(BPF_JGT, BPF_REG_8, BLKLAT_BUCKETS - 1);
+    int fits = p.jmpi(BPF_JA, 0, 0);
+    p.land(small);
+    p.movi(BPF_REG_8, BLKLAT_BUCKETS - 1);
+    p.land(fits);
+
+    // r3 = op: 'R' 0, 'W' 1, anything else 2; a leading 'F' is a flush ahead of it
+    p.ldx(BPF_B, BPF_REG_2, BPF_REG_6, tp.rwbs);
+    int noflush = p.jmpi(BPF_JNE, BPF_REG_2, 'F');
+    p.ldx(BPF_B, BPF_REG_2, BPF_REG_6, tp.rwbs + 1);
+    p.land(noflush);
+    p.movi(BPF_REG_3, 2);
+    int notread = p.jmpi(BPF_JNE, BPF_REG_2, 'R');
+    p.movi(BPF_REG_3, 0);
+    int done = p.jmpi(BPF_JA, 0, 0);
+    p.land(notread);
+    int notwrite = p.jmpi(BPF_JNE, BPF_REG_2, 'W');
+    p.movi(BPF_REG_3, 1);
+    p.land(notwrite);
+    p.land(done);
+    p.alui(BPF_MUL, BPF_REG_3, BLKLAT_BUCKETS);
+    p.alu(BPF_ADD, BPF_REG_3, BPF_REG_8);
+
+    // hist[(dev, r3)] += 1
+    p.ldx(BPF_W, BPF_REG_2, BPF_REG_6, tp.dev);
+    p.stx(BPF_W, BPF_REG_10, -40, BPF_REG_2);
+    p.stx(BPF_W, BPF_REG_10, -36, BPF_REG_3);
+    p.map(BPF_REG_1, hist);
+    p.stack_ptr(BPF_REG_2, -40);
+    p.call(BPF_FUNC_map_lookup_elem);
+    int fresh = p.jmpi(BPF_JEQ, BPF_REG_0, 0);
+    p.movi(BPF_REG_1, 1);
+    p.op(BPF_STX | BPF_DW | BPF_XADD, BPF_REG_0, BPF_REG_1, 0, 0);
+    int counted = p.jmpi(BPF_JA, 0, 0);
+    p.land(fresh);
+    p.sti(BPF_DW, BPF_REG_10, -48, 1);
+    p.map(BPF_REG_1, hist);
+    p.stack_ptr(BPF_REG_2, -40);
+    p.stack_ptr(BPF_REG_3, -48);
+    p.movi(BPF_REG_4, BPF_NOEXIST);
+    p.call(BPF_FUNC_map_update_elem);
+    p.land(counted);
+
+    p.land(out);
+    p.exit0();
+    return p;
+}
+
+static int
+prog_load(const BpfProg & p, const char * name, int vb)
+{
+    static char log[VERIFIER_LOG_LEN];
+    union bpf_attr attr;
+    int fd = -1;
+
+    // the log is only taken when asked for or to tell why the verifier said no
+    for (int level = vb ? 1 : 0; level <= 1 && fd < 0; ++level) {
+        memset(&attr, 0, sizeof(attr));
+        log[0] = 0;
+        attr.prog_type = BPF_PROG_TYPE_TRACEPOINT;
+        attr.insns = (uint64_t)(uintptr_t) p.insns.constData();
+        attr.insn_cnt = p.insns.size();
+        attr.license = (uint64_t)(uintptr_t) "GPL";
+        if (level) {
+            attr.log_buf = (uint64_t)(uintptr_t) log;
+            attr.log_size = sizeof(log);
+            attr.log_level = level;
+        }
+        fd = sys_bpf(BPF_PROG_LOAD, &attr);
+    }
+    if (fd < 0 || vb) {
+        qDebug("%s: %s program %s\n%s", __func__, name, fd < 0 ? "rejected" : "loaded", log);
+    }
+    return fd;
+}
+
+/*
+ * Attach a program to a tracepoint; returns the perf event descriptor or -1.
+ * A program attached to a tracepoint runs on whatever CPU hits it, so one
+ * event is enough, opened on CPU 0 as libbpf does.
+ */
+static int
+attach(int tp_id, int prog, int vb)
+{
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.type = PERF_TYPE_TRACEPOINT;
+    attr.size = sizeof(attr);
+    attr.config = tp_id;
+    attr.sample_period = 1;
+    attr.wakeup_events = 1;
+    int fd = syscall(__NR_perf_event_open, &attr, -1, 0, -1, PERF_FLAG_FD_CLOEXEC);
+    if (fd < 0) {
+        if (vb) {
+            qDebug("%s: tracepoint %d: %s", __func__, tp_id, strerror(errno));
+        }
+        return -1;
+    }
+    if (ioctl(fd, PERF_EVENT_IOC_SET_BPF, prog) < 0 || ioctl(fd, PERF_EVENT_IOC_ENABLE, 0) < 0) {
+        if (vb) {
+            qDebug("%s: tracepoint %d: %s", __func__, tp_id, strerror(errno));
+        }
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+BlkLatTracer::BlkLatTracer()
+    : m_verbose(0), m_devs(-1), m_start(-1), m_hist(-1), m_begin_ms(0), m_span_ms(0)
+{
+    m_prog[0] = m_prog[1] = -1;
+}
+
+/* Load and attach the programs for the block devices of the slots */
+bool BlkLatTracer::begin(const QVector<int> & slots, int vb)
+{
+    _ST_TPFIELDS issue, complete;
+
+    end();
+    m_verbose = vb;
+    m_result.clear();
+    m_slot_of_dev.clear();
+    if (false == tracepoint_fields("block_rq_issue", issue) || false == tracepoint_fields("block_rq_complete", complete)) {
+        gAppendMessage("Block latency: block tracepoints not found, is tracefs mounted?");
+        return false;
+    }
+
+    m_devs = map_create(sizeof(uint32_t), sizeof(uint32_t), NSLOT);
+    m_start = map_create(2 * sizeof(uint64_t), sizeof(uint64_t), START_ENTRIES);
+    m_hist = map_create(2 * sizeof(uint32_t), sizeof(uint64_t), NSLOT * BLKLAT_NOPS * BLKLAT_BUCKETS);
+    if (m_devs < 0 || m_start < 0 || m_hist < 0) {
+        gAppendMessage(QString("Block latency: BPF maps not created: ") + strerror(errno));
+        close_all();
+        return false;
+    }
+
+    for (int sl : slots) {
+        // "8:16" is MKDEV(8, 16), major << 20 | minor in the kernel
+        QFile file("/sys/block/" + gDevices.block(sl) + "/dev");
+        if (false == file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+            continue;
+        }
+        QStringList mm = QString(file.readLine()).trimmed().split(':');
+        if (2 == mm.size()) {
+            uint32_t dev = (mm[0].toUInt() << 20) | mm[1].toUInt();
+            uint32_t slot = sl;
+            map_update(m_devs, &dev, &slot);
+            m_slot_of_dev.insert(dev, sl);
+        }
+    }
+    if (m_slot_of_dev.isEmpty()) {
+        close_all();
+        return false;
+    }
+
+    m_prog[0] = prog_load(issue_prog(issue, m_devs, m_start), "block_rq_issue", vb);
+    m_prog[1] = prog_load(complete_prog(complete, m_start, m_hist), "block_rq_complete", vb);
+    if (m_prog[0] < 0 || m_prog[1] < 0) {
+        gAppendMessage("Block latency: BPF programs not loaded, root and CONFIG_BPF_SYSCALL are needed");
+        close_all();
+        return false;
+    }
+    // completions first, so no request issued goes without one
+    int fd = attach(complete.id, m_prog[1], vb);
+    if (fd >= 0) {
+        m_events.append(fd);
+        fd = attach(issue.id, m_prog[0], vb);
+        if (fd >= 0) {
+            m_events.append(fd);
+        }
+    }
+    if (fd < 0) {
+        gAppendMessage("Block latency: BPF programs failed to attach");
+        close_all();
+        return false;
+    }
+    m_begin_ms = QDateTime::currentMSecsSinceEpoch();
+    return true;
+}
+
+/* Detach, keeping the histograms for report() */
+void BlkLatTracer::end()
+{
+    if (isRunning()) {
+        for (int fd : m_events) {
+            ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+        }
+        m_span_ms = QDateTime::currentMSecsSinceEpoch() - m_begin_ms;
+        collect();
+    }
+    close_all();
+}
+
+void BlkLatTracer::close_all()
+{
+    for (int fd : m_events) {
+        close(fd);
+    }
+    m_events.clear();
+    for (int * fd : { &m_prog[0], &m_prog[1], &m_devs, &m_start, &m_hist }) {
+        if (*fd >= 0) {
+            close(*fd);
+            *fd = -1;
+        }
+    }
+}
+
+void BlkLatTracer::collect()
+{
+    uint32_t key[2], next[2];
+    uint64_t count;
+    union bpf_attr attr;
+    bool first = true;
+
+    for (;;) {
+        memset(&attr, 0, sizeof(attr));
+        attr.map_fd = m_hist;
+        attr.key = first ? 0 : (uint64_t)(uintptr_t) key;
+        attr.next_key = (uint64_t)(uintptr_t) next;
+        if (sys_bpf(BPF_MAP_GET_NEXT_KEY, &attr) < 0) {
+            break;
+        }
+        first = false;
+        memcpy(key, next, sizeof(key));
+
+        memset(&attr, 0, sizeof(attr));
+        attr.map_fd = m_hist;
+        attr.key = (uint64_t)(uintptr_t) key;
+        attr.value = (uint64_t)(uintptr_t) &count;
+        int op = key[1] / BLKLAT_BUCKETS, bucket = key[1] % BLKLAT_BUCKETS;
+        if (sys_bpf(BPF_MAP_LOOKUP_ELEM, &attr) < 0 || false == m_slot_of_dev.contains(key[0]) || op >= BLKLAT_NOPS) {
+            continue;
+        }
+        m_result[m_slot_of_dev.value(key[0])].count[op][bucket] = count;
+    }
+}
+
+/* The upper bound in us of the bucket holding the given fraction of the requests */
+static uint64_t
+percentile_us(const uint64_t * count, double fraction)
+{
+    uint64_t total = 0, seen = 0;
+    for (int b = 0; b < BLKLAT_BUCKETS; ++b) {
+        total += count[b];
+    }
+    for (int b = 0; b < BLKLAT_BUCKETS; ++b) {
+        seen += count[b];
+        if (total > 0 && seen >= total * fraction) {
+            return 2ULL << b;
+        }
+    }
+    return 0;
+}
+
+/* Per slot and op: requests, p50, p99 and the worst bucket; into the slot tooltips and a table */
+void BlkLatTracer::report()
+{
+    QMap<int, _ST_BLKLATHIST> sorted;
+    for (auto it = m_result.cbegin(); it != m_result.cend(); ++it) {
+        sorted.insert(it.key(), it.value());
+    }
+
+    QString html = "<table cellspacing=0 cellpadding=2><tr><th>slot</th><th>op</th><th>requests</th>"
+                   "<th>p50 &lt;</th><th>p99 &lt;</th><th>max &lt;</th></tr>";
+    for (auto it = sorted.cbegin(); it != sorted.cend(); ++it) {
+        QStringList tip;
+        for (int op = 0; op < BLKLAT_NOPS; ++op) {
+            const uint64_t * count = it.value().count[op];
+            uint64_t n = 0;
+            int worst = 0;
+            for (int b = 0; b < BLKLAT_BUCKETS; ++b) {
+                n += count[b];
+                worst = count[b] ? b : worst;
+            }
+            if (0 == n) {
+                continue;
+            }
+            uint64_t p50 = percentile_us(count, 0.50), p99 = percentile_us(count, 0.99);
+            tip << QString::asprintf("block %s: p50 < %llu us, p99 < %llu us", OP_NAME[op],
+                                     (unsigned long long) p50, (unsigned long long) p99);
+            html += QString::asprintf("<tr><td>%d %s</td><td>%s</td><td>%llu</td><td>%llu us</td><td>%llu us</td><td>%llu us</td></tr>",
+                                      it.key() + 1, gDevices.block(it.key()).toStdString().c_str(), OP_NAME[op],
+                                      (unsigned long long) n, (unsigned long long) p50, (unsigned long long) p99, 2ULL << worst);
+        }
+        gDevices.setSlotBlkLat(it.key(), tip.join('\n'));
+    }
+    html += "</table>";
+
+    gAppendMessage(QString::asprintf("Block latency: %d slots traced over %.0f s, issue to completion in the block layer",
+                                     (int)sorted.size(), m_span_ms / 1000.0));
+    if (false == sorted.isEmpty()) {
+        gAppendMessage(html);
+    }
+}
@@ -0,0 +1,48 @@
+#ifndef BLK_LATENCY_H
+#define BLK_LATENCY_H
+
+#include <QHash>
+#include <QVector>
+#include <stdint.h>
+
+#define BLKLAT_BUCKETS  32      // log2 of the latency in us
+#define BLKLAT_NOPS     3       // read, write, other
+
+typedef struct ST_BLKLATHIST {
+    uint64_t count[BLKLAT_NOPS][BLKLAT_BUCKETS];
+} _ST_BLKLATHIST;
+
+/*
+ * Block layer latency of the slots from issue to completion, measured in the
+ * kernel by eBPF programs on the block_rq_issue and block_rq_complete
+ * tracepoints and kept as log2 histograms per device and op. Loaded through
+ * the bpf syscall directly, no libbpf or compiler is needed.
+ */
+class BlkLatTracer
+{
+public:
+    BlkLatTracer();
+    ~BlkLatTracer() { end(); }
+
+    bool begin(const QVector<int> & slots, int verbose);
+    void end();
+    bool isRunning() const { return false == m_events.isEmpty(); }
+    void report();
+
+private:
+    void collect();
+    void close_all();
+
+    int m_verbose;
+    int m_devs;             // dev_t -> slot, the filter
+    int m_start;            // (dev_t, sector) -> issue time
+    int m_hist;             // (dev_t, op * BLKLAT_BUCKETS + bucket) -> count
+    int m_prog[2];
+    QVector<int> m_events;  // perf events the programs are attached to
+    QHash<uint32_t, int> m_slot_of_dev;
+    QHash<int, _ST_BLKLATHIST> m_result;
+    qint64 m_begin_ms;
+    qint64 m_span_ms;
+};
+
+#endif // BLK_LATENCY_H
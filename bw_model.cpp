@@ -0,0 +1,222 @@
+#include <math.h>
+
+#include "bw_model.h"
+#include "lsscsi.h"
+#include "mpi3mr_app.h"
+
+#define KNEE_GAIN       0.5     // a drive added must bring this fraction of the average per-drive bandwidth
+#define DEFAULT_LANE_MBPS 1200  // assumed when the negotiated link rate is unknown (12G)
+#define QD_HEADROOM     1.25    // over the outstanding IOs measured, to saturate rather than just match
+#define MAX_QD_PER_JOB  32      // deeper queues are split into more jobs per drive
+
+/*
+ * Usable bandwidth of one lane in MB/s for the negotiated logical link rate
+ * (DISCOVER response byte 13, low nibble); 8b10b coding up to 12G, 128b150b
+ * for 22.5G. Returns 0 when the phy is not up at a known rate.
+ */
+int
+linkrate_mbps(int negot)
+{
+    switch (negot & 0xf) {
+    case 0x8: return 150;
+    case 0x9: return 300;
+    case 0xa: return 600;
+    case 0xb: return 1200;
+    case 0xc: return 2400;
+    }
+    return 0;
+}
+
+const char *
+linkrate_str(int negot)
+{
+    switch (negot & 0xf) {
+    case 0x8: return "1.5";
+    case 0x9: return "3";
+    case 0xa: return "6";
+    case 0xb: return "12";
+    case 0xc: return "22.5";
+    }
+    return "";
+}
+
+/* The link rate code of "1.5", "3", "6", "12" or "22.5" Gbps, 0 if none */
+int
+linkrate_code(const QString & gbps)
+{
+    for (int code = 0x8; code <= 0xc; ++code) {
+        if (gbps == linkrate_str(code)) {
+            return code;
+        }
+    }
+    return 0;
+}
+
+/*
+ * agg_mbs[n] is the aggregate bandwidth measured with n+1 drives running.
+ * Returns the drive count beyond which adding a drive stops scaling, or 0
+ * if the aggregate never saturated over the range measured.
+ */
+int
+bw_find_knee(const QVector<double> & agg_mbs)
+{
+    for (int n = 1; n < agg_mbs.size(); n++) {
+        double per_drive = agg_mbs[n - 1] / n;
+        if (agg_mbs[n] - agg_mbs[n - 1] < per_drive * KNEE_GAIN) {
+            return n;
+        }
+    }
+    return 0;
+}
+
+/* fio block size string ("4K", "512K", "1M") in KiB */
+static int
+bs_kb(const QString & bs)
+{
+    QString u = bs.toUpper();
+    if (u.endsWith('M')) {
+        return u.chopped(1).toInt() * 1024;
+    }
+    if (u.endsWith('K')) {
+        return u.chopped(1).toInt();
+    }
+    return qMax(1, u.toInt() / 1024);
+}
+
+/* The smallest queue depth the SCSI devices of the run are set up with */
+static int
+min_queue_depth(const QVector<int> & slots)
+{
+    int qd = 0;
+    for (int sl : slots) {
+        QString value;
+        if (get_myValue("/sys/block/" + gDevices.block(sl) + "/device", "queue_depth", value) && value.toInt() > 0) {
+            qd = (0 == qd) ? value.toInt() : qMin(qd, value.toInt());
+        }
+    }
+    return qd;
+}
+
+/*
+ * Predict the throughput of the target drives running "rw/bs" from the topology:
+ * each drive is bounded by its negotiated link rate (or its solo measurement of
+ * the same workload), each expander by the lanes up to the HBA. The queue depth
+ * is sized by Little's law from the solo measurement where there is one, then
+ * capped by the device queue depth, the IOC outstanding requests and throttle.
+ */
+void
+bw_model_build(_ST_BWMODEL & m, const QString & rw, const QString & bs, const QVector<int> & targets, int vb)
+{
+    bool seq = false == rw.startsWith("rand");
+    int kb = bs_kb(bs);
+    int need = 1, based = 0;
+    QVector<int> slots;
+
+    m.workload = rw + "/" + bs;
+    m.total_mbs = 0;
+    m.basis.clear();
+
+    for (int k = 0; k < NEXPDR; ++k) {
+        double sum = 0;
+        m.exp_mbs[k] = 0;
+        for (int i = k*NSLOT_PEREXP; i < (k+1)*NSLOT_PEREXP; ++i) {
+            m.slot_mbs[i] = 0;
+            if (gControllers.bsgPath(k).isEmpty() || gDevices.slotVacant(i) || false == targets.contains(i)) {
+                continue;
+            }
+            slots.append(i);
+
+            int link = linkrate_mbps(gDevices.slotLinkRate(i));
+            double drive = link ? link : DEFAULT_LANE_MBPS;
+            const _ST_SLOTPERF & solo = gDevices.solo(i);
+            if (solo.workload == m.workload && solo.bw_kbs > 0) {
+                drive = qMin(drive, solo.bw_kbs * 1.024 / 1000);
+                // outstanding IOs that sustained the solo rate
+                need = qMax(need, (int) ceil(solo.iops * solo.lat_us / 1000000 * QD_HEADROOM));
+                based++;
+            }
+            m.slot_mbs[i] = drive;
+            sum += drive;
+        }
+
+        int uplink = gControllers.uplinkMBps(k);
+        if (gControllers.uplinkDown(k) > 0) {
+            m.basis += QString::asprintf("Expander-%d uplink %d of %d lanes down; ", k+1,
+                                         gControllers.uplinkDown(k), gControllers.uplinkLanes(k));
+        }
+        m.exp_mbs[k] = (uplink > 0) ? qMin(sum, (double) uplink) : sum;
+        if (sum > 0 && m.exp_mbs[k] < sum) {
+            // the drives share what the uplink allows
+            for (int i = k*NSLOT_PEREXP; i < (k+1)*NSLOT_PEREXP; ++i) {
+                m.slot_mbs[i] *= m.exp_mbs[k] / sum;
+            }
+            m.basis += QString::asprintf("Expander-%d uplink-bound; ", k+1);
+        }
+        m.total_mbs += m.exp_mbs[k];
+    }
+    if (slots.isEmpty()) {
+        m.iodepth = m.numjobs = 0;
+        return;
+    }
+    if (based < slots.size()) {
+        // keep about 2 MiB in flight per drive streaming, enough to reorder random IO
+        int guess = seq ? qMax(2, 2048 / kb) : 16;
+        need = (0 == based) ? guess : qMax(need, guess);
+        m.basis += QString::asprintf("%d of %d drives without solo baseline (link rate bound); ", (int)slots.size() - based, (int)slots.size());
+    }
+
+    int qd = need;
+    int dev_qd = min_queue_depth(slots);
+    if (dev_qd > 0 && qd > dev_qd) {
+        qd = dev_qd;
+        m.basis += QString::asprintf("capped by device queue_depth %d; ", dev_qd);
+    }
+    int data_kb, high_mb, groups;
+    int max_reqs = get_iocthrottle(data_kb, high_mb, groups);
+    if (max_reqs > 0 && qd * slots.size() > max_reqs) {
+        qd = qMax(1, max_reqs / (int) slots.size());
+        m.basis += QString::asprintf("capped by IOC max requests %d; ", max_reqs);
+    }
+    // IOs over the throttle data length beyond the high watermark are diverted to the firmware
+    if (groups > 0 && data_kb > 0 && high_mb > 0 && kb >= data_kb && qd * kb > high_mb * 1024) {
+        qd = qMax(1, high_mb * 1024 / kb);
+        m.basis += QString::asprintf("capped by IO throttle high watermark %d MB; ", high_mb);
+    }
+
+    m.numjobs = (qd + MAX_QD_PER_JOB - 1) / MAX_QD_PER_JOB;
+    m.iodepth = (qd + m.numjobs - 1) / m.numjobs;
+    if (m.basis.endsWith("; ")) {
+        m.basis.chop(2);
+    }
+    if (vb) {
+        qDebug("%s: %s needs qd %d, sized %d x %d jobs", __func__, m.workload.toStdString().c_str(), need, m.iodepth, m.numjobs);
+    }
+}
+
+/* Measured vs. predicted per expander and in total */
+void
+bw_model_report(const _ST_BWMODEL & m, const QVector<_ST_FIOJOB> & jobs)
+{
+    double measured[NEXPDR] = {0};
+    double total = 0;
+
+    for (const _ST_FIOJOB & job : jobs) {
+        for (int i = 0; i < NSLOT; i++) {
+            if (m.slot_mbs[i] > 0 && "/dev/" + gDevices.block(i) == job.filename) {
+                measured[i / NSLOT_PEREXP] += job.bw_kbs * 1.024 / 1000;
+                total += job.bw_kbs * 1.024 / 1000;
+                break;
+            }
+        }
+    }
+    for (int k = 0; k < NEXPDR; ++k) {
+        if (m.exp_mbs[k] > 0) {
+            gAppendMessage(QString::asprintf("  Expander-%d: measured %.1f MB/s, predicted %.1f MB/s (%.0f%%)",
+                                             k+1, measured[k], m.exp_mbs[k], measured[k] / m.exp_mbs[k] * 100));
+        }
+    }
+    if (m.total_mbs > 0) {
+        gAppendMessage(QString::asprintf("  Total %s: measured %.1f MB/s, predicted %.1f MB/s (%.0f%%)",
+                                         m.workload.toStdString().c_str(), total, m.total_mbs, total / m.total_mbs * 100));
+    }
+}
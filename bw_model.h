@@ -0,0 +1,26 @@
+#ifndef BW_MODEL_H
+#define BW_MODEL_H
+
+#include <QVector>
+
+#include "widget.h"
+#include "fio_result.h"
+
+typedef struct ST_BWMODEL {
+    QString workload;           // "rw/bs" the model is built for
+    double slot_mbs[NSLOT];     // predicted per drive, 0 if not in the run
+    double exp_mbs[NEXPDR];     // predicted per expander: drives capped by the uplink
+    double total_mbs;           // predicted for the run
+    int iodepth;                // per job
+    int numjobs;                // per drive
+    QString basis;              // what bounds the prediction
+} _ST_BWMODEL;
+
+int linkrate_mbps(int negot);
+const char * linkrate_str(int negot);
+int linkrate_code(const QString & gbps);
+int bw_find_knee(const QVector<double> & agg_mbs);
+void bw_model_build(_ST_BWMODEL & m, const QString & rw, const QString & bs, const QVector<int> & targets, int vb);
+void bw_model_report(const _ST_BWMODEL & m, const QVector<_ST_FIOJOB> & jobs);
+
+#endif // BW_MODEL_H
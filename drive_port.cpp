@@ -0,0 +1,212 @@
+#include <QMutex>
+#include <algorithm>
+
+#include "widget.h"
+#include "drive_port.h"
+#include "scsi_cmd.h"
+
+#define LOG_SENSE               0x4d
+#define LOG_PAGE_SAS_PORT       0x18    // Protocol-Specific Port log page
+#define LOG_PC_CUMULATIVE       0x40
+#define LOG_ALLOC_LEN           1024
+#define SAS_PROTOCOL_ID         0x6
+#define DRIVE_PORT_PER_EXP      4       // LOG SENSE in flight per expander
+
+static inline uint32_t
+get_be32(const uint8_t * p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static inline int
+get_be16(const uint8_t * p)
+{
+    return (p[0] << 8) | p[1];
+}
+
+static inline uint64_t
+get_be64(const uint8_t * p)
+{
+    return ((uint64_t)get_be32(p) << 32) | get_be32(p + 4);
+}
+
+/*
+ * Page 18h holds a parameter per target port; each lists its phys with the
+ * attached SAS address and phy identifier, and the four error counters
+ * (SPL-4 Protocol-Specific Port log parameter for SAS).
+ */
+static int
+parse_port_page(int sl, const uint8_t * lp, int len, QVector<_ST_DRVPHY> & phys)
+{
+    int count = 0;
+    int end = qMin(len, 4 + get_be16(lp + 2));
+
+    for (int off = 4; off + 8 <= end; off += 4 + lp[off + 3]) {
+        const uint8_t * bp = lp + off;
+        int pend = qMin(end, off + 4 + bp[3]);
+        if ((bp[4] & 0xf) != SAS_PROTOCOL_ID) {
+            continue;
+        }
+        int pos = off + 8;
+        for (int n = 0; n < bp[7] && pos + 48 <= pend; ++n) {
+            const uint8_t * vp = lp + pos;
+            _ST_DRVPHY phy;
+            phy.slot = sl;
+            phy.port = get_be16(bp);
+            phy.attached_sa = get_be64(vp + 16);
+            phy.attached_phy = vp[24];
+            phy.negot = vp[5] & 0xf;
+            phy.err.phy_id = vp[1];
+            phy.err.invalid_dword = get_be32(vp + 32);
+            phy.err.disparity = get_be32(vp + 36);
+            phy.err.loss_sync = get_be32(vp + 40);
+            phy.err.reset_problem = get_be32(vp + 44);
+            phys.append(phy);
+            count++;
+            pos += (vp[3] < 44) ? 48 : 4 + vp[3];
+        }
+    }
+    return count;
+}
+
+/*
+ * Drive side error counters of every occupied slot by LOG SENSE, a few
+ * drives of each expander at a time. Returns the number of phys read.
+ */
+int
+drive_port_snapshot(_ST_DRVSNAPSHOT & snap, int vb)
+{
+    QVector<int> slots;
+    QMutex mutex;
+
+    snap.phys.clear();
+    snap.time = QDateTime::currentDateTime();
+    for (int sl = 0; sl < NSLOT; ++sl) {
+        if (false == gDevices.slotVacant(sl)) {
+            slots.append(sl);
+        }
+    }
+
+    scsi_for_each_slot(slots, DRIVE_PORT_PER_EXP, [&snap, &mutex, vb](int sl, int fd) {
+        uint8_t cdb[10] = {LOG_SENSE, 0, LOG_PC_CUMULATIVE | LOG_PAGE_SAS_PORT, 0, 0, 0, 0,
+                           LOG_ALLOC_LEN >> 8, LOG_ALLOC_LEN & 0xff, 0};
+        uint8_t lp[LOG_ALLOC_LEN];
+        QVector<_ST_DRVPHY> phys;
+
+        int len = scsi_cmd(fd, cdb, sizeof(cdb), SCSI_READ, lp, sizeof(lp), nullptr, SCSI_TIMEOUT_MS, vb);
+        if (len < 4 || (lp[0] & 0x3f) != LOG_PAGE_SAS_PORT) {
+            // SATA drives behind a STP bridge have no such page
+            if (vb) {
+                qDebug("%s: slot %d: no SAS port log page", __func__, sl + 1);
+            }
+            return;
+        }
+        parse_port_page(sl, lp, len, phys);
+        QMutexLocker locker(&mutex);
+        snap.phys += phys;
+    }, vb);
+
+    std::sort(snap.phys.begin(), snap.phys.end(), [](const _ST_DRVPHY & a, const _ST_DRVPHY & b) {
+        return (a.slot != b.slot) ? a.slot < b.slot : a.port < b.port;
+    });
+    return snap.phys.size();
+}
+
+/* The expander and its phy on the other end of a drive phy, -1 if not one of ours */
+static int
+attached_expander(const _ST_DRVPHY & phy)
+{
+    for (int k = 0; k < NEXPDR; ++k) {
+        if (gControllers.wwid64(k) && (gControllers.wwid64(k) >> 6) == (phy.attached_sa >> 6)) {
+            return k;
+        }
+    }
+    return -1;
+}
+
+static const _ST_DRVPHY *
+find_phy(const _ST_DRVSNAPSHOT & snap, const _ST_DRVPHY & phy)
+{
+    for (const _ST_DRVPHY & p : snap.phys) {
+        if (p.slot == phy.slot && p.port == phy.port && p.err.phy_id == phy.err.phy_id) {
+            return &p;
+        }
+    }
+    return nullptr;
+}
+
+/* Counters as a delta since before, the counters saturate rather than wrap */
+static QString
+err_cols(const _ST_PHYERR * b, const _ST_PHYERR & a)
+{
+    if (nullptr == b) {
+        return QString::asprintf("%8u %8u %8u %8u", a.invalid_dword, a.disparity, a.loss_sync, a.reset_problem);
+    }
+    return QString::asprintf("%+8d %+8d %+8d %+8d", (int)(a.invalid_dword - b->invalid_dword), (int)(a.disparity - b->disparity),
+                             (int)(a.loss_sync - b->loss_sync), (int)(a.reset_problem - b->reset_problem));
+}
+
+static bool
+err_any(const _ST_PHYERR * b, const _ST_PHYERR & a)
+{
+    _ST_PHYERR zero = { a.phy_id, 0, 0, 0, 0 };
+    if (nullptr == b) {
+        b = &zero;
+    }
+    return a.invalid_dword != b->invalid_dword || a.disparity != b->disparity ||
+           a.loss_sync != b->loss_sync || a.reset_problem != b->reset_problem;
+}
+
+/*
+ * Both ends of every drive link in one table: the drive phy counters from
+ * LOG SENSE next to the expander phy counters from REPORT PHY ERROR LOG.
+ * Deltas between the snapshots, or absolute counts without a snapshot
+ * before; only the links with errors on either end are listed.
+ */
+void
+drive_port_report(const _ST_DRVSNAPSHOT & before, const _ST_DRVSNAPSHOT & after,
+                  const _ST_ERRSNAPSHOT & exp_before, const _ST_ERRSNAPSHOT & exp_after)
+{
+    bool based = before.time.isValid();
+    bool exp_based = exp_before.time.isValid();
+    int links = 0, listed = 0;
+
+    for (const _ST_DRVPHY & a : after.phys) {
+        const _ST_DRVPHY * b = based ? find_phy(before, a) : nullptr;
+        if (based && nullptr == b) {
+            continue;
+        }
+        int k = attached_expander(a);
+        const _ST_PHYERR * ea = nullptr, * eb = nullptr;
+        if (k >= 0 && a.attached_phy < exp_after.phys[k].size() && exp_after.phys[k][a.attached_phy].phy_id >= 0) {
+            ea = &exp_after.phys[k][a.attached_phy];
+            if (exp_based && a.attached_phy < exp_before.phys[k].size() && exp_before.phys[k][a.attached_phy].phy_id >= 0) {
+                eb = &exp_before.phys[k][a.attached_phy];
+            }
+        }
+        links++;
+        bool exp_err = ea && (false == exp_based || eb) && err_any(eb, *ea);
+        if (false == err_any(b ? &b->err : nullptr, a.err) && false == exp_err) {
+            continue;
+        }
+        if (0 == listed++) {
+            gAppendMessage("  slot   block    port phy |  inv dw   disp  loss sync  reset | expander   phy |  inv dw   disp  loss sync  reset");
+        }
+        QString row = QString::asprintf("  %4d %-8s %4c %3d | ", a.slot + 1, gDevices.block(a.slot).toStdString().c_str(),
+                                        'A' + a.port - 1, a.err.phy_id);
+        row += err_cols(b ? &b->err : nullptr, a.err) + " | ";
+        if (k < 0) {
+            row += QString::asprintf("%016llx", (unsigned long long)a.attached_sa);
+        } else if (nullptr == ea || (exp_based && nullptr == eb)) {
+            row += QString::asprintf("Expander-%d %3d | not read", k + 1, a.attached_phy);
+        } else {
+            row += QString::asprintf("Expander-%d %3d | ", k + 1, a.attached_phy) + err_cols(eb, *ea);
+        }
+        gAppendMessage(row);
+    }
+    if (based) {
+        gAppendMessage(QString::asprintf("Drive port log: %d of %d links with errors in %lld s", listed, links, before.time.secsTo(after.time)));
+    } else {
+        gAppendMessage(QString::asprintf("Drive port log: %d of %d links with errors", listed, links));
+    }
+}
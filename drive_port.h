@@ -0,0 +1,27 @@
+#ifndef DRIVE_PORT_H
+#define DRIVE_PORT_H
+
+#include <QDateTime>
+#include <QVector>
+
+#include "smp_batch.h"
+
+typedef struct ST_DRVPHY {
+    int slot;
+    int port;               // relative target port, 1 for port A
+    uint64_t attached_sa;   // the expander on the other end of the link
+    int attached_phy;
+    int negot;              // negotiated physical link rate
+    _ST_PHYERR err;         // phy_id is the phy of the drive
+} _ST_DRVPHY;
+
+typedef struct ST_DRVSNAPSHOT {
+    QDateTime time;
+    QVector<_ST_DRVPHY> phys;
+} _ST_DRVSNAPSHOT;
+
+int drive_port_snapshot(_ST_DRVSNAPSHOT & snap, int verbose);
+void drive_port_report(const _ST_DRVSNAPSHOT & before, const _ST_DRVSNAPSHOT & after,
+                       const _ST_ERRSNAPSHOT & exp_before, const _ST_ERRSNAPSHOT & exp_after);
+
+#endif // DRIVE_PORT_H
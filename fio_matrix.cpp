@@ -0,0 +1,339 @@
+#include <QDateTime>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+
+#include "widget.h"
+#include "fio_matrix.h"
+#include "numa_affinity.h"
+#include "bw_model.h"
+
+#define MAX_POINTS_PER_RUN  16      // bounds what a failed fio invocation loses
+#define FIO_RUNS_FILE       "fio_runs.jsonl"
+
+/*
+ * The auto FIO workloads: the target writes while every other occupied
+ * slot keeps reading 4K at random.
+ */
+_ST_FIOMATRIX
+fio_matrix_preset(int wl)
+{
+    _ST_FIOMATRIX mx;
+    mx.name = QString("Workload %1").arg(wl);
+    mx.rw << ((1 == wl) ? "write" : "randwrite");
+    mx.bs << ((1 == wl) ? "512k" : "4k");
+    mx.iodepth << 8;
+    mx.numjobs << 1;
+    mx.targets = ENUM_TARGETSET::TGT_CHECKED;
+    mx.bg_rw = "randread";
+    mx.bg_bs = "4K";
+    mx.ramp = 30;
+    mx.runtime = 120;
+    mx.pause = 0;
+    mx.merge = true;
+    mx.autosize = false;
+    return mx;
+}
+
+/* A list is given as a JSON array, or a single value for a list of one */
+static QJsonArray
+json_list(const QJsonObject & obj, const char * key)
+{
+    QJsonValue v = obj.value(key);
+    if (v.isArray()) {
+        return v.toArray();
+    }
+    return v.isUndefined() ? QJsonArray() : QJsonArray({ v });
+}
+
+/*
+ * A matrix file is a JSON object, e.g.
+ *   { "name": "sweep", "rw": ["randread", "read"], "bs": ["4K", "128K"],
+ *     "iodepth": [8, 32], "numjobs": 1, "fan": ["60", "100"], "linkrate": ["12", "6", "3"],
+ *     "targets": "checked", "ramp": 5, "runtime": 60, "pause": 10, "tuning": "throughput" }
+ * Lists not given take the values of the preset of workload 1 without background.
+ */
+bool
+fio_matrix_load(const QString & path, _ST_FIOMATRIX & mx, QString & err)
+{
+    QFile file(path);
+    if (false == file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        err = "Matrix file failed to open: " + path;
+        return false;
+    }
+    QJsonParseError perr;
+    QJsonDocument doc = QJsonDocument::fromJson(file.readAll(), &perr);
+    file.close();
+    if (false == doc.isObject()) {
+        err = "Matrix file parse error: " + perr.errorString();
+        return false;
+    }
+    QJsonObject obj = doc.object();
+
+    mx = fio_matrix_preset(1);
+    mx.bg_rw.clear();
+    mx.bg_bs.clear();
+    mx.name = obj.value("name").toString(QFileInfo(path).baseName());
+    if (obj.contains("rw")) {
+        mx.rw.clear();
+        for (const QJsonValue & v : json_list(obj, "rw")) mx.rw << v.toString();
+    }
+    if (obj.contains("bs")) {
+        mx.bs.clear();
+        for (const QJsonValue & v : json_list(obj, "bs")) mx.bs << v.toString();
+    }
+    if (obj.contains("iodepth")) {
+        mx.iodepth.clear();
+        for (const QJsonValue & v : json_list(obj, "iodepth")) mx.iodepth << v.toInt();
+    }
+    if (obj.contains("numjobs")) {
+        mx.numjobs.clear();
+        for (const QJsonValue & v : json_list(obj, "numjobs")) mx.numjobs << v.toInt();
+    }
+    for (const QJsonValue & v : json_list(obj, "fan")) {
+        mx.fan << (v.isDouble() ? QString::number(v.toInt()) : v.toString());
+    }
+    for (const QJsonValue & v : json_list(obj, "linkrate")) {
+        mx.linkrate << (v.isDouble() ? QString::number(v.toDouble()) : v.toString());
+    }
+    for (const QJsonValue & v : json_list(obj, "global")) {
+        mx.global << v.toString();
+    }
+
+    QString targets = obj.value("targets").toString("checked");
+    mx.targets = ("each" == targets) ? ENUM_TARGETSET::TGT_EACH :
+                 ("occupied" == targets) ? ENUM_TARGETSET::TGT_OCCUPIED : ENUM_TARGETSET::TGT_CHECKED;
+    QStringList bg = obj.value("background").toString().split('/');
+    if (2 == bg.size()) {
+        mx.bg_rw = bg[0];
+        mx.bg_bs = bg[1];
+    }
+    mx.ramp = obj.value("ramp").toInt(mx.ramp);
+    mx.runtime = obj.value("runtime").toInt(mx.runtime);
+    mx.pause = obj.value("pause").toInt(mx.pause);
+    mx.merge = obj.value("merge").toBool(mx.merge);
+    mx.autosize = obj.value("autosize").toBool(mx.autosize);
+    mx.tuning = obj.value("tuning").toString();
+
+    if (mx.rw.isEmpty() || mx.bs.isEmpty() || mx.iodepth.isEmpty() || mx.numjobs.isEmpty() || mx.runtime <= 0) {
+        err = "Matrix file has an empty dimension: " + path;
+        return false;
+    }
+    for (const QString & rate : mx.linkrate) {
+        if (0 == linkrate_code(rate)) {
+            err = "Matrix file has a link rate not 1.5, 3, 6, 12 or 22.5 Gbps: " + rate;
+            return false;
+        }
+    }
+    if (false == mx.tuning.isEmpty() && false == queue_profile_names().contains(mx.tuning)) {
+        err = "Matrix file has a tuning profile not one of " + queue_profile_names().join(", ") + ": " + mx.tuning;
+        return false;
+    }
+    return true;
+}
+
+static bool
+slot_in_run(int sl, bool checked)
+{
+    return false == gControllers.bsgPath(sl / NSLOT_PEREXP).isEmpty() && false == gDevices.slotVacant(sl) &&
+           (false == checked || gDevices.cbSlot(sl)->isChecked());
+}
+
+/*
+ * Expand the matrix into fio invocations. Fan duty is the outermost loop so the
+ * fans are set the fewest times, then the link rate, and the points of one fan
+ * duty and link rate are merged into one job file, run one after another
+ * (stonewall), unless merge is off.
+ */
+QVector<QVector<_ST_FIOPOINT>>
+fio_matrix_plan(const _ST_FIOMATRIX & mx)
+{
+    QVector<QVector<_ST_FIOPOINT>> plan;
+    QVector<QVector<int>> targets;
+    QVector<int> set;
+
+    for (int i = 0; i < NSLOT; i++) {
+        if (slot_in_run(i, ENUM_TARGETSET::TGT_OCCUPIED != mx.targets)) {
+            if (ENUM_TARGETSET::TGT_EACH == mx.targets) {
+                targets.append(QVector<int>({ i }));
+            } else {
+                set.append(i);
+            }
+        }
+    }
+    if (false == set.isEmpty()) {
+        targets.append(set);
+    }
+    if (targets.isEmpty()) {
+        return plan;
+    }
+
+    QStringList fans = mx.fan.isEmpty() ? QStringList({ QString() }) : mx.fan;
+    QStringList rates = mx.linkrate.isEmpty() ? QStringList({ QString() }) : mx.linkrate;
+    for (const QString & fan : fans)
+    for (const QString & linkrate : rates) {
+        QVector<_ST_FIOPOINT> run;
+        for (const QString & rw : mx.rw)
+        for (const QString & bs : mx.bs)
+        for (int iodepth : mx.iodepth)
+        for (int numjobs : mx.numjobs)
+        for (const QVector<int> & slots : targets) {
+            _ST_FIOPOINT pt = { rw, bs, iodepth, numjobs, fan, linkrate, slots, QVector<int>() };
+            if (false == mx.bg_rw.isEmpty()) {
+                for (int i = 0; i < NSLOT; i++) {
+                    if (slot_in_run(i, false) && false == slots.contains(i)) {
+                        pt.bg.append(i);
+                    }
+                }
+            }
+            if (false == run.isEmpty() && (false == mx.merge || run.size() >= MAX_POINTS_PER_RUN)) {
+                plan.append(run);
+                run.clear();
+            }
+            run.append(pt);
+        }
+        plan.append(run);
+    }
+    return plan;
+}
+
+/* Expected duration of an invocation, for the progress bar */
+int
+fio_run_seconds(const _ST_FIOMATRIX & mx, const QVector<_ST_FIOPOINT> & run)
+{
+    return run.size() * (mx.ramp + mx.runtime) + (run.size() - 1) * mx.pause;
+}
+
+static void
+write_job(QTextStream & stream, const QString & name, int sl, const QString & rw, const QString & bs,
+          const _ST_FIOPOINT & pt, bool first, int startdelay)
+{
+    stream << "[" << name << "]" << Qt::endl
+           << "filename=/dev/" << gDevices.block(sl) << Qt::endl
+           << "rw=" << rw << Qt::endl
+           << "bs=" << bs << Qt::endl
+           << "iodepth=" << pt.iodepth << Qt::endl;
+    if (pt.numjobs > 1) {
+        stream << "numjobs=" << pt.numjobs << Qt::endl;
+    }
+    for (const QString & opt : numa_job_options(sl)) {
+        stream << opt << Qt::endl;
+    }
+    if (first) {
+        // the first job of a point waits for the previous point to finish
+        stream << "stonewall" << Qt::endl
+               << "new_group" << Qt::endl;
+    }
+    if (startdelay > 0) {
+        stream << "startdelay=" << startdelay << Qt::endl;
+    }
+    stream << Qt::endl;
+}
+
+/* Every point of the run is a reporting group of its own, numbered from 0 */
+void
+fio_write_jobfile(QTextStream & stream, const _ST_FIOMATRIX & mx, const QVector<_ST_FIOPOINT> & run)
+{
+    stream << "[global]"        << Qt::endl
+           << "direct=1"        << Qt::endl
+           << "ioengine=libaio" << Qt::endl
+           << "time_based"      << Qt::endl
+           << "ramp_time=" << mx.ramp << Qt::endl
+           << "runtime=" << mx.runtime << Qt::endl;
+    for (const QString & line : mx.global) {
+        stream << line << Qt::endl;
+    }
+    stream << Qt::endl;
+
+    for (int g = 0; g < run.size(); ++g) {
+        const _ST_FIOPOINT & pt = run[g];
+        // fio counts startdelay from its own start, not from the end of the previous point
+        int delay = (g > 0 && mx.pause > 0) ? g * (mx.ramp + mx.runtime + mx.pause) : 0;
+        bool first = (g > 0);
+
+        stream << "## " << mx.name << ": " << pt.rw << " bs=" << pt.bs << " iodepth=" << pt.iodepth
+               << " numjobs=" << pt.numjobs << Qt::endl;
+        for (int sl : pt.slots) {
+            write_job(stream, QString::asprintf("g%d_sl%03d_", g, sl + 1) + gDevices.block(sl),
+                      sl, pt.rw, pt.bs, pt, first, delay);
+            first = false;
+        }
+        for (int sl : pt.bg) {
+            write_job(stream, QString::asprintf("g%d_sl%03d_bg_", g, sl + 1) + gDevices.block(sl),
+                      sl, mx.bg_rw, mx.bg_bs, pt, false, delay);
+        }
+    }
+}
+
+QVector<_ST_FIOJOB>
+fio_group_jobs(const QVector<_ST_FIOJOB> & jobs, int group)
+{
+    QVector<_ST_FIOJOB> res;
+    for (const _ST_FIOJOB & job : jobs) {
+        if (job.groupid == group) {
+            res.append(job);
+        }
+    }
+    return res;
+}
+
+/*
+ * Append the point run and the aggregate of its targets as one JSON line, so
+ * runs of different sweeps can be compared directly. queue is the block
+ * queue settings of the slots as read back by queue_tuning_apply().
+ */
+void
+fio_record_run(const QString & out, const _ST_FIOMATRIX & mx, int group, const _ST_FIOPOINT & pt,
+               const QVector<_ST_FIOJOB> & jobs, const QMap<int, QString> & queue)
+{
+    double bw_kbs = 0, iops = 0, lat = 0, p99 = 0;
+    QJsonArray devices;
+    QJsonObject settings;
+
+    for (int sl : pt.slots) {
+        devices.append(gDevices.block(sl));
+        if (queue.contains(sl)) {
+            settings.insert(gDevices.block(sl), queue.value(sl));
+        }
+        for (const _ST_FIOJOB & job : jobs) {
+            if (job.filename == "/dev/" + gDevices.block(sl)) {
+                bw_kbs += job.bw_kbs;
+                iops += job.iops;
+                lat += job.lat_us * job.iops;
+                p99 = qMax(p99, job.p99_us);
+            }
+        }
+    }
+
+    QJsonObject rec;
+    rec.insert("time", QDateTime::currentDateTime().toString(Qt::ISODate));
+    rec.insert("matrix", mx.name);
+    rec.insert("output", out);
+    rec.insert("group", group);
+    rec.insert("rw", pt.rw);
+    rec.insert("bs", pt.bs);
+    rec.insert("iodepth", pt.iodepth);
+    rec.insert("numjobs", pt.numjobs);
+    rec.insert("fan", pt.fan);
+    rec.insert("linkrate", pt.linkrate);
+    rec.insert("tuning", mx.tuning);
+    rec.insert("queue", settings);
+    rec.insert("ramp", mx.ramp);
+    rec.insert("runtime", mx.runtime);
+    rec.insert("targets", devices);
+    rec.insert("background", pt.bg.isEmpty() ? QString() : mx.bg_rw + "/" + mx.bg_bs);
+    rec.insert("bw_kbs", bw_kbs);
+    rec.insert("iops", iops);
+    rec.insert("lat_us", (iops > 0) ? lat / iops : 0);
+    rec.insert("p99_us", p99);
+
+    QFile file(FIO_RUNS_FILE);
+    if (false == file.open(QIODevice::WriteOnly | QIODevice::Append | QIODevice::Text)) {
+        qDebug() << "run metadata failed to open: " << FIO_RUNS_FILE;
+        return;
+    }
+    file.write(QJsonDocument(rec).toJson(QJsonDocument::Compact) + "\n");
+    file.close();
+}
@@ -0,0 +1,59 @@
+#ifndef FIO_MATRIX_H
+#define FIO_MATRIX_H
+
+#include <QMap>
+#include <QStringList>
+#include <QTextStream>
+#include <QVector>
+
+#include "fio_result.h"
+
+typedef enum {
+    TGT_CHECKED = 0,    // the checked slots run together
+    TGT_EACH,           // every checked slot is the target of a run of its own
+    TGT_OCCUPIED        // every occupied slot, checked or not
+} ENUM_TARGETSET;
+
+/* A workload matrix: every combination of the lists is a point to run */
+typedef struct ST_FIOMATRIX {
+    QString name;
+    QStringList rw;
+    QStringList bs;
+    QVector<int> iodepth;
+    QVector<int> numjobs;
+    QStringList fan;        // fan duty in %, empty to leave the fans alone
+    QStringList linkrate;   // maximum link rate of the targets in Gbps, empty to leave the phys alone
+    int targets;            // ENUM_TARGETSET
+    QString bg_rw;          // the occupied slots not targeted run this, if set
+    QString bg_bs;
+    int ramp;               // seconds
+    int runtime;            // seconds
+    int pause;              // seconds between points
+    bool merge;             // points of the same fan duty share a fio invocation
+    bool autosize;          // iodepth/numjobs are sized by the bandwidth model
+    QStringList global;     // extra [global] lines
+    QString tuning;         // block queue profile of the slots in the runs, empty for the kernel defaults
+} _ST_FIOMATRIX;
+
+/* One point of the matrix with its targets resolved to slots */
+typedef struct ST_FIOPOINT {
+    QString rw;
+    QString bs;
+    int iodepth;
+    int numjobs;
+    QString fan;
+    QString linkrate;
+    QVector<int> slots;     // targets
+    QVector<int> bg;        // running the background workload
+} _ST_FIOPOINT;
+
+_ST_FIOMATRIX fio_matrix_preset(int wl);
+bool fio_matrix_load(const QString & path, _ST_FIOMATRIX & mx, QString & err);
+QVector<QVector<_ST_FIOPOINT>> fio_matrix_plan(const _ST_FIOMATRIX & mx);
+int fio_run_seconds(const _ST_FIOMATRIX & mx, const QVector<_ST_FIOPOINT> & run);
+void fio_write_jobfile(QTextStream & stream, const _ST_FIOMATRIX & mx, const QVector<_ST_FIOPOINT> & run);
+QVector<_ST_FIOJOB> fio_group_jobs(const QVector<_ST_FIOJOB> & jobs, int group);
+void fio_record_run(const QString & out, const _ST_FIOMATRIX & mx, int group, const _ST_FIOPOINT & pt,
+                    const QVector<_ST_FIOJOB> & jobs, const QMap<int, QString> & queue);
+
+#endif // FIO_MATRIX_H
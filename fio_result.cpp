@@ -0,0 +1,136 @@
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QMap>
+
+#include "widget.h"
+#include "fio_result.h"
+
+/* A job option is either set in the job section or inherited from [global] */
+static QString
+job_option(const QJsonObject & job, const QJsonObject & global, const char * key)
+{
+    QJsonValue v = job.value("job options").toObject().value(key);
+    if (v.isUndefined()) {
+        v = global.value(key);
+    }
+    return v.toString();
+}
+
+/* Accumulate one data direction (read or write) of a job. Mean latency is weighted by IOPS. */
+static void
+add_direction(const QJsonObject & dir, _ST_FIOJOB & res, double & lat_weight)
+{
+    double iops = dir.value("iops").toDouble();
+    if (0 == iops) {
+        return;
+    }
+    QJsonObject clat = dir.value("clat_ns").toObject();
+    res.bw_kbs += dir.value("bw").toDouble();
+    res.iops += iops;
+    res.lat_us += clat.value("mean").toDouble() / 1000 * iops;
+    res.p99_us = qMax(res.p99_us, clat.value("percentile").toObject().value("99.000000").toDouble() / 1000);
+    lat_weight += iops;
+}
+
+/*
+ * fio is run with "--output-format=normal,json", so the JSON document is
+ * appended to the human readable report in the same output file.
+ */
+QVector<_ST_FIOJOB>
+fio_parse_output(const QString & path)
+{
+    QVector<_ST_FIOJOB> jobs;
+    QFile file(path);
+
+    if (false == file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        qDebug() << "fio output failed to open: " << path;
+        return jobs;
+    }
+    QByteArray data = file.readAll();
+    file.close();
+
+    int start = data.startsWith('{') ? 0 : data.indexOf("\n{") + 1;
+    int end = data.lastIndexOf('}');
+    if (start <= 0 && false == data.startsWith('{')) {
+        qDebug() << "no JSON section found in " << path;
+        return jobs;
+    }
+
+    QJsonParseError err;
+    QJsonDocument doc = QJsonDocument::fromJson(data.mid(start, end + 1 - start), &err);
+    if (doc.isNull()) {
+        qDebug() << "fio JSON parse error: " << err.errorString();
+        return jobs;
+    }
+
+    QJsonObject global = doc.object().value("global options").toObject();
+    const QJsonArray arr = doc.object().value("jobs").toArray();
+    for (const QJsonValue & v : arr) {
+        QJsonObject job = v.toObject();
+        _ST_FIOJOB res;
+        res.bw_kbs = res.iops = res.lat_us = res.p99_us = 0;
+        res.groupid = job.value("groupid").toInt();
+        double lat_weight = 0;
+
+        res.filename = job_option(job, global, "filename");
+        res.workload = job_option(job, global, "rw") + "/" + job_option(job, global, "bs");
+        add_direction(job.value("read").toObject(), res, lat_weight);
+        add_direction(job.value("write").toObject(), res, lat_weight);
+        if (lat_weight > 0) {
+            res.lat_us /= lat_weight;
+        }
+        jobs.append(res);
+    }
+    return jobs;
+}
+
+/*
+ * Jobs cloned by numjobs run on the same file; merge them into one result per
+ * file. Returns the number of slots the results are applied to.
+ */
+int
+fio_apply_results(const QVector<_ST_FIOJOB> & jobs)
+{
+    QMap<QString, _ST_FIOJOB> files;
+    int applied = 0;
+
+    for (const _ST_FIOJOB & job : jobs) {
+        // only a job on a single block device can be attributed to a slot
+        if (false == job.filename.startsWith("/dev/") || job.filename.contains(':')) {
+            continue;
+        }
+        if (false == files.contains(job.filename)) {
+            files.insert(job.filename, job);
+            continue;
+        }
+        _ST_FIOJOB & res = files[job.filename];
+        double iops = res.iops + job.iops;
+        if (iops > 0) {
+            res.lat_us = (res.lat_us * res.iops + job.lat_us * job.iops) / iops;
+        }
+        res.bw_kbs += job.bw_kbs;
+        res.iops = iops;
+        res.p99_us = qMax(res.p99_us, job.p99_us);
+    }
+
+    for (const _ST_FIOJOB & job : files) {
+        QString block = job.filename.mid(5);
+        for (int i = 0; i < NSLOT; i++) {
+            if (false == gDevices.slotVacant(i) && gDevices.block(i) == block) {
+                _ST_SLOTPERF perf;
+                perf.workload = job.workload;
+                perf.bw_kbs = job.bw_kbs;
+                perf.iops = job.iops;
+                perf.lat_us = job.lat_us;
+                perf.p99_us = job.p99_us;
+                perf.njobs = files.size();
+                gDevices.setSlotPerf(i, perf);
+                applied++;
+                break;
+            }
+        }
+    }
+    return applied;
+}
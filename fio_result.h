@@ -0,0 +1,20 @@
+#ifndef FIO_RESULT_H
+#define FIO_RESULT_H
+
+#include <QString>
+#include <QVector>
+
+typedef struct ST_FIOJOB {
+    QString filename;
+    QString workload;       // "rw/bs" signature of the job
+    double bw_kbs;          // KiB/s (read + write)
+    double iops;
+    double lat_us;          // mean completion latency
+    double p99_us;          // 99th percentile completion latency
+    int groupid;            // reporting group, one per point of a merged run
+} _ST_FIOJOB;
+
+QVector<_ST_FIOJOB> fio_parse_output(const QString & path);
+int fio_apply_results(const QVector<_ST_FIOJOB> & jobs);
+
+#endif // FIO_RESULT_H
@@ -0,0 +1,183 @@
+#include <QCoreApplication>
+#include <QMap>
+#include <algorithm>
+
+#include "flap_monitor.h"
+#include "bw_model.h"
+
+#define POLL_FAST_MS    50      // while links are changing
+#define POLL_SLOW_MS    1000    // quiet
+#define DISCOVER_CHANGE_COUNT   42  // PHY CHANGE COUNT in the DISCOVER response
+
+/* Open the expanders here in the calling thread and take the phy states to start from */
+bool FlapMonitor::begin(int vb)
+{
+    uint8_t rp[SMP_FN_DISCOVER_RESP_LEN];
+
+    m_verbose = vb;
+    m_stop = false;
+    m_events.clear();
+    m_clock.start();
+    m_begin = QDateTime::currentDateTime();
+
+    IntfEnum sel = (cardType == ENUM_CARDTYPE::HBA9500) ? I_SGV4 : I_SGV4_MPI;
+    for (int k = 0; k < NEXPDR; ++k) {
+        m_tobj[k].opened = 0;
+        m_phys[k] = 0;
+        if (gControllers.bsgPath(k).isEmpty() || smp_initiator_open(gControllers.bsgPath(k), sel, &m_tobj[k], vb) < 0) {
+            continue;
+        }
+        m_tobj[k].sas_addr64 = gControllers.wwid64(k);
+        m_count++;
+
+        uint8_t rg[SMP_FN_REPORT_GENERAL_RESP_LEN];
+        m_phys[k] = qBound(0, smp_report_general(&m_tobj[k], rg, vb), FLAP_MAX_PHYS);
+        m_change_count[k] = (rg[4] << 8) | rg[5];
+        for (int phy = 0; phy < m_phys[k]; ++phy) {
+            int len = smp_discover_phy(&m_tobj[k], phy, rp, sizeof(rp), vb);
+            m_phy_rate[k][phy] = (len > 13) ? (rp[13] & 0xf) : 0;
+            m_phy_changes[k][phy] = (len > DISCOVER_CHANGE_COUNT) ? rp[DISCOVER_CHANGE_COUNT] : 0;
+            m_down_at[k][phy] = -1;
+        }
+    }
+    if (0 == m_count) {
+        gAppendMessage("Flap monitor: no expander to monitor");
+        return false;
+    }
+    start();
+    return true;
+}
+
+void FlapMonitor::end()
+{
+    if (isRunning()) {
+        m_stop = true;
+        wait();
+    }
+    for (int k = 0; k < NEXPDR && m_count > 0; ++k) {
+        if (m_tobj[k].opened) {
+            smp_initiator_close(&m_tobj[k]);
+        }
+    }
+    m_count = 0;
+}
+
+void FlapMonitor::run()
+{
+    int interval = POLL_SLOW_MS;
+    uint8_t rg[SMP_FN_REPORT_GENERAL_RESP_LEN];
+
+    while (false == m_stop) {
+        bool changed = false;
+        for (int k = 0; k < NEXPDR; ++k) {
+            if (0 == m_tobj[k].opened || smp_report_general(&m_tobj[k], rg, m_verbose) < 0) {
+                continue;
+            }
+            int cc = (rg[4] << 8) | rg[5];
+            if (cc != m_change_count[k]) {
+                m_change_count[k] = cc;
+                poll_phys(k, m_clock.elapsed());
+                changed = true;
+            }
+        }
+        // adapt: at once down to fast on a change, back off doubling when quiet
+        interval = changed ? POLL_FAST_MS : qMin(interval * 2, POLL_SLOW_MS);
+        for (int t = 0; t < interval && false == m_stop; t += POLL_FAST_MS) {
+            msleep(POLL_FAST_MS);
+        }
+    }
+}
+
+void FlapMonitor::poll_phys(int k, qint64 now)
+{
+    uint8_t rp[SMP_FN_DISCOVER_RESP_LEN];
+
+    for (int phy = 0; phy < m_phys[k]; ++phy) {
+        int len = smp_discover_phy(&m_tobj[k], phy, rp, sizeof(rp), m_verbose);
+        if (len <= DISCOVER_CHANGE_COUNT) {
+            continue;
+        }
+        int rate = rp[13] & 0xf;
+        int changes = (uint8_t) (rp[DISCOVER_CHANGE_COUNT] - m_phy_changes[k][phy]);
+        bool was_up = linkrate_mbps(m_phy_rate[k][phy]) > 0;
+        bool is_up = linkrate_mbps(rate) > 0;
+        if (0 == changes && was_up == is_up) {
+            continue;
+        }
+
+        _ST_FLAPEVENT ev = { QDateTime::currentDateTime(), k, phy, is_up, -1, rate, changes };
+        if (was_up && false == is_up) {
+            m_down_at[k][phy] = now;
+        } else if (is_up) {
+            // down and up again within a poll are seen from the change count only
+            if (false == was_up && m_down_at[k][phy] >= 0) {
+                ev.down_ms = now - m_down_at[k][phy];
+            }
+            m_down_at[k][phy] = -1;
+        }
+        m_phy_rate[k][phy] = rate;
+        m_phy_changes[k][phy] = rp[DISCOVER_CHANGE_COUNT];
+        record(ev);
+    }
+}
+
+void FlapMonitor::record(const _ST_FLAPEVENT & ev)
+{
+    QString msg = ev.time.toString("hh:mm:ss.zzz") + QString::asprintf(" Expander-%d phy %d ", ev.exp + 1, ev.phy);
+    msg += ev.up ? QString("up ") + linkrate_str(ev.rate) + " Gbps" : QString("down");
+    if (ev.down_ms >= 0) {
+        msg += QString::asprintf(" after %lld ms down", ev.down_ms);
+    }
+    if (ev.changes > 1) {
+        msg += QString::asprintf(" (%d changes)", ev.changes);
+    }
+    {
+        QMutexLocker locker(&m_mutex);
+        m_events.append(ev);
+    }
+    // the message pane belongs to the GUI thread
+    QMetaObject::invokeMethod(QCoreApplication::instance(), [msg]() { gAppendMessage(msg); }, Qt::QueuedConnection);
+}
+
+/* Phys ranked by flaps per minute, with the down times seen */
+void FlapMonitor::report()
+{
+    QMutexLocker locker(&m_mutex);
+    QMap<int, QVector<_ST_FLAPEVENT>> per_phy;
+    for (const _ST_FLAPEVENT & ev : m_events) {
+        per_phy[(ev.exp << 8) | ev.phy].append(ev);
+    }
+
+    typedef struct { int key; int flaps; qint64 max_ms; double mean_ms; } rank_t;
+    QVector<rank_t> ranks;
+    for (auto it = per_phy.cbegin(); it != per_phy.cend(); ++it) {
+        rank_t r = { it.key(), 0, 0, 0 };
+        int timed = 0;
+        for (const _ST_FLAPEVENT & ev : it.value()) {
+            // a flap is a down and up; a change count of a missed flap counts both
+            r.flaps += ev.up ? qMax(1, ev.changes / 2) : 0;
+            if (ev.down_ms >= 0) {
+                r.max_ms = qMax(r.max_ms, ev.down_ms);
+                r.mean_ms += ev.down_ms;
+                timed++;
+            }
+        }
+        r.mean_ms = timed ? r.mean_ms / timed : 0;
+        ranks.append(r);
+    }
+    std::sort(ranks.begin(), ranks.end(), [](const rank_t & a, const rank_t & b) { return a.flaps > b.flaps; });
+
+    double minutes = qMax<qint64>(m_begin.secsTo(QDateTime::currentDateTime()), 1) / 60.0;
+    gAppendMessage(QString::asprintf("Flap monitor: %d phys changed over %.1f min", (int)ranks.size(), minutes));
+    for (const rank_t & r : ranks) {
+        int k = r.key >> 8, phy = r.key & 0xff;
+        QString name = QString::asprintf("  Expander-%d phy %d", k + 1, phy);
+        for (int sl = k*NSLOT_PEREXP; sl < (k+1)*NSLOT_PEREXP; ++sl) {
+            if (gDevices.slotPhyId(sl) == phy) {
+                name += QString::asprintf(" (slot %d)", sl + 1);
+            }
+        }
+        gAppendMessage(name + QString::asprintf(": %d flaps, %.1f/min, down mean %.0f ms max %lld ms",
+                                                r.flaps, r.flaps / minutes, r.mean_ms, r.max_ms));
+    }
+}
@@ -0,0 +1,61 @@
+#ifndef FLAP_MONITOR_H
+#define FLAP_MONITOR_H
+
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QMutex>
+#include <QThread>
+#include <QVector>
+#include <atomic>
+
+#include "widget.h"
+
+#define FLAP_MAX_PHYS 256
+
+typedef struct ST_FLAPEVENT {
+    QDateTime time;
+    int exp;
+    int phy;
+    bool up;                // link came up, else went down
+    qint64 down_ms;         // how long the link was down, when it came up; -1 if not seen
+    int rate;               // negotiated logical link rate after the transition
+    int changes;            // phy change count advanced by
+} _ST_FLAPEVENT;
+
+/*
+ * Polls REPORT GENERAL of every expander, which is one request per expander,
+ * and only on a change of the expander change count DISCOVERs the phys for
+ * their change count and negotiated rate. The interval shortens while links
+ * are changing and backs off when they are quiet.
+ */
+class FlapMonitor : public QThread
+{
+public:
+    FlapMonitor() : m_count(0), m_stop(false) {}
+    ~FlapMonitor() { end(); }
+
+    bool begin(int verbose);
+    void end();
+    void report();
+
+private:
+    void run() override;
+    void poll_phys(int k, qint64 now);
+    void record(const _ST_FLAPEVENT & ev);
+
+    smp_target_obj m_tobj[NEXPDR];
+    int m_phys[NEXPDR];
+    int m_change_count[NEXPDR];
+    int m_phy_changes[NEXPDR][FLAP_MAX_PHYS];
+    int m_phy_rate[NEXPDR][FLAP_MAX_PHYS];
+    qint64 m_down_at[NEXPDR][FLAP_MAX_PHYS];
+    int m_verbose;
+    int m_count;
+    std::atomic<bool> m_stop;
+    QElapsedTimer m_clock;
+    QDateTime m_begin;
+    QMutex m_mutex;
+    QVector<_ST_FLAPEVENT> m_events;
+};
+
+#endif // FLAP_MONITOR_H
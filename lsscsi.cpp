@@ -1,4 +1,6 @@
 #include <QString>
+#include <QHash>
+#include <QSet>
 #include <QRegularExpression>
 #include <byteswap.h>
 #include <dirent.h>
@@ -8,6 +10,8 @@
 
 #include "widget.h"
 #include "lsscsi.h"
+#include "mpi3mr_app.h"
+#include "ses.h"
 
 #define FT_OTHER 0
 #define FT_BLOCK 1
@@ -556,13 +560,48 @@ DiskInfo* findDiskBySerial(QVector<DiskInfo>& disks, const QString& serial) {
     return nullptr; // Not found
 }
 
-/* List SCSI devices (LUs). */
+/* Place the device by its SAS address in the SES slot map. Returns false if it is not in the map */
+static bool
+ses_set_slot(QString dir_name, QString dev_name, const QHash<uint64_t, int> & ses_map)
+{
+    QString value;
+    if (ses_map.isEmpty() || false == get_myValue(QString("%1/%2").arg(dir_name, dev_name), "sas_address", value)) {
+        return false;
+    }
+    auto it = ses_map.constFind(value.trimmed().toULongLong(0, 16));
+    if (it == ses_map.cend()) {
+        return false;
+    }
+    gDevices.setSlot(dir_name, dev_name, it.value());
+    return true;
+}
+
+/*
+ * List SCSI devices (LUs). HBA9600 devices are placed by the target map of
+ * the IOCs; the others are joined on SAS address with the SES Additional
+ * Element Status of the enclosures, and the devices not found there are
+ * placed as HBA9500 (enclosure_device) or HBA9600 (target distance) do.
+ */
 void
 list_sdevices(int vb)
 {
     int num, k, prev;
     struct dirent ** namelist;
     QString buff, name;
+    QHash<uint64_t, int> ses_map;
+    QHash<QString, int> tgt_map;
+    QSet<QString> placed;
+    bool ses_read = false;
+    // the SES map is read only once a device is missing in the target map
+    auto ses_lookup = [&](const QString & dev_name) {
+        if (false == ses_read) {
+            ses_read = true;
+            if (ses_slot_map(ses_map, vb) > 0 && vb) {
+                qDebug("%d SAS addresses in the SES slot map", (int)ses_map.size());
+            }
+        }
+        return ses_set_slot(buff, dev_name, ses_map);
+    };
 
     if (vb) {
         qDebug("listing...");
@@ -578,8 +617,18 @@ list_sdevices(int vb)
         return;
     }
 
+    if (cardType != ENUM_CARDTYPE::HBA9500 && mpi3mr_target_map(tgt_map, vb) > 0 && vb) {
+        qDebug("%d targets in the IOC target map", (int)tgt_map.size());
+    }
+
     for (prev = k = 0; k < num; ++k) {
         name = namelist[k]->d_name;
+        auto it = tgt_map.constFind(name.section(':', 0, 2));
+        if (it != tgt_map.cend()) {
+            gDevices.setSlot(buff, name, it.value());
+            placed.insert(name);
+            continue;
+        }
         QString dir_name = QString("%1/%2").arg(buff, name);
         if (enclosure_dir_scan(dir_name.toStdString().c_str())) {
             uint64_t wwid = expander_wwid(buff, name, vb);
@@ -588,12 +637,16 @@ list_sdevices(int vb)
             } else {
                 if (cardType == ENUM_CARDTYPE::HBA9600) {
                     for (; prev < k; ++prev) {
-                        gDevices.setSlot(buff, namelist[prev]->d_name, namelist[k]->d_name, wwid);
+                        if (false == placed.contains(namelist[prev]->d_name)) {
+                            gDevices.setSlot(buff, namelist[prev]->d_name, namelist[k]->d_name, wwid);
+                        }
                     }
                     prev = k + 1;
                 }
                 gControllers.setController(namelist[k]->d_name, wwid);
             }
+        } else if (ses_lookup(name)) {
+            placed.insert(name);
         } else if (cardType == ENUM_CARDTYPE::HBA9500) {
             /* HBA9500 disk has enclosure_device:ArrayDevicexx, whereas HBA9600 disk has not */
             gDevices.setSlot(buff, name, enclosure_device.name);
@@ -623,7 +676,7 @@ list_sdevices(int vb)
         for (const DriveInfo& drive : drives) {
             DiskInfo* disk = findDiskBySerial(disks, drive.serialNumber);
             if (disk) {
-                gDevices.setSlot(drive.slot, QString("[%1:%2]").arg(drive.eid).arg(drive.slot), disk->wwn, disk->name);
+                gDevices.setSlot(drive.slot, QString("[%1:%2]").arg(drive.eid).arg(drive.slot), disk->wwn, disk->name, disk->model);
             } else {
                 gAppendMessage(QString("Drive %1:%2 with SN %3 not found in real HDDs!").arg(drive.eid).arg(drive.slot).arg(drive.serialNumber));
             }
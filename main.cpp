@@ -1,5 +1,6 @@
 #include <QApplication>
 #include <getopt.h>
+#include <stdlib.h>
 
 #include "widget.h"
 
@@ -10,20 +11,25 @@
 #endif
 
 int verbose = 0;
+int sampleHz = 10;      // live slot statistics while fio runs, 0 to disable
 QApplication *gApp;
 
 static struct option long_options[] = {
     { "verbose", no_argument, 0, 'v' },
+    { "sample-hz", required_argument, 0, 's' },
     };
 
 int main(int argc, char *argv[])
 {
     int c;
-    while((c = getopt_long(argc, argv, "v", long_options, NULL)) != -1) {
+    while((c = getopt_long(argc, argv, "vs:", long_options, NULL)) != -1) {
         switch (c) {
         case 'v':
             ++verbose;
             break;
+        case 's':
+            sampleHz = qBound(0, atoi(optarg), 100);
+            break;
         }
     }
 
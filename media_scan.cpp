@@ -0,0 +1,274 @@
+#include <QCoreApplication>
+#include <QFile>
+#include <QHash>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSaveFile>
+
+#include "widget.h"
+#include "media_scan.h"
+#include "scsi_cmd.h"
+
+#define VERIFY_16           0x8f
+#define SCAN_CHUNK_BYTES    (256LL << 20)   // verified per command
+#define SCAN_TIMEOUT_MS     120000          // a chunk with media retries may take long
+#define CHECKPOINT_MS       30000
+#define PROGRESS_MS         60000
+#define REPORT_MAX_LBAS     16
+
+static void
+post_message(const QString & msg)
+{
+    // the message pane belongs to the GUI thread
+    QMetaObject::invokeMethod(QCoreApplication::instance(), [msg]() { gAppendMessage(msg); }, Qt::QueuedConnection);
+}
+
+/* Load the checkpoint and resume the drives found unfinished in it, in the calling thread */
+bool MediaScan::begin(const QVector<int> & slots, int vb)
+{
+    QHash<QString, QJsonObject> saved;
+    QFile file(MEDIA_SCAN_CHECKPOINT);
+    if (file.open(QIODevice::ReadOnly)) {
+        const QJsonArray drives = QJsonDocument::fromJson(file.readAll()).object().value("drives").toArray();
+        for (const QJsonValue & v : drives) {
+            saved.insert(v.toObject().value("wwid").toString(), v.toObject());
+        }
+        file.close();
+    }
+
+    m_verbose = vb;
+    m_stop = false;
+    m_slots.clear();
+    m_others = QJsonArray();
+    // the sg nodes and CPUs are taken here, the scan thread does not read gDevices
+    m_targets = scsi_slot_targets(slots);
+    int resumed = 0;
+    for (const _ST_SCSISLOT & t : m_targets) {
+        int sl = t.slot;
+        _ST_SCANSLOT s;
+        s.slot = sl;
+        s.wwid = gDevices.wwid(sl);
+        s.block = gDevices.block(sl);
+        s.blocks = 0;
+        s.block_len = 0;
+        s.next_lba = s.start_lba = 0;
+        s.busy_ms = 0;
+        s.state = 0;
+        QJsonObject o = saved.take(s.wwid);
+        uint64_t blocks = o.value("blocks").toDouble();
+        uint64_t next = o.value("next_lba").toDouble();
+        if (blocks > 0 && next < blocks) {
+            s.blocks = blocks;
+            s.block_len = o.value("block_len").toInt();
+            s.next_lba = s.start_lba = next;
+            for (const QJsonValue & lba : o.value("errors").toArray()) {
+                s.errors.append(lba.toDouble());
+            }
+            resumed++;
+        }
+        m_slots.append(s);
+    }
+    for (const QJsonObject & o : saved) {
+        m_others.append(o);
+    }
+    if (m_slots.isEmpty()) {
+        return false;
+    }
+
+    gAppendMessage(QString::asprintf("Media scan: %d drives, %d resumed from " MEDIA_SCAN_CHECKPOINT, (int)m_slots.size(), resumed));
+    m_begin = QDateTime::currentDateTime();
+    m_clock.start();
+    m_saved_ms = m_shown_ms = 0;
+    start();
+    return true;
+}
+
+void MediaScan::end()
+{
+    if (isRunning()) {
+        m_stop = true;
+        wait();
+    }
+}
+
+void MediaScan::run()
+{
+    QHash<int, int> index;
+    for (int i = 0; i < m_slots.size(); ++i) {
+        index.insert(m_slots[i].slot, i);
+    }
+
+    // VERIFY moves no data over the links, so every drive is kept busy
+    scsi_for_each_slot(m_targets, NSLOT_PEREXP, [this, &index](int sl, int fd) {
+        scan(index.value(sl), fd);
+    }, m_verbose);
+
+    checkpoint();
+    if (false == m_stop) {
+        // queued on the scan object, dropped if it is deleted before the report runs
+        QMetaObject::invokeMethod(this, [this]() { report(); }, Qt::QueuedConnection);
+    }
+}
+
+/* Verify one drive chunk by chunk from where it was, until done or stopped */
+void MediaScan::scan(int idx, int fd)
+{
+    _ST_SCANSLOT & s = m_slots[idx];
+    uint8_t sense[SCSI_SENSE_LEN];
+
+    if (0 == s.blocks) {
+        uint64_t blocks = 0;
+        uint32_t block_len = 0;
+        if (scsi_read_capacity16(fd, blocks, block_len, m_verbose) < 0 || 0 == block_len) {
+            QMutexLocker locker(&m_mutex);
+            s.state = -1;
+            post_message(QString::asprintf("Media scan: slot %d: READ CAPACITY failed", s.slot + 1));
+            return;
+        }
+        QMutexLocker locker(&m_mutex);
+        s.blocks = blocks;
+        s.block_len = block_len;
+    }
+    uint32_t chunk = qMax(1LL, SCAN_CHUNK_BYTES / s.block_len);
+
+    while (false == m_stop && s.next_lba < s.blocks) {
+        uint64_t lba = s.next_lba;
+        uint32_t n = (uint32_t) qMin((uint64_t) chunk, s.blocks - lba);
+        uint8_t cdb[16] = {VERIFY_16, 0};   // BYTCHK 0: the drive checks the media, no data out
+        for (int i = 0; i < 8; ++i) {
+            cdb[2 + i] = lba >> (56 - 8 * i);
+        }
+        for (int i = 0; i < 4; ++i) {
+            cdb[10 + i] = n >> (24 - 8 * i);
+        }
+
+        QElapsedTimer clock;
+        clock.start();
+        int res = scsi_cmd(fd, cdb, sizeof(cdb), SCSI_NONE, nullptr, 0, sense, SCAN_TIMEOUT_MS, m_verbose);
+
+        QMutexLocker locker(&m_mutex);
+        s.busy_ms += clock.elapsed();
+        if (res >= 0) {
+            s.next_lba = lba + n;
+        } else if (-2 == res && SENSE_KEY_MEDIUM_ERROR == scsi_sense_key(sense)) {
+            // go on past the bad block, or past the chunk if the drive did not say which
+            uint64_t bad;
+            if (scsi_sense_info(sense, bad) && bad >= lba && bad < lba + n) {
+                s.next_lba = bad + 1;
+            } else {
+                bad = lba;
+                s.next_lba = lba + n;
+            }
+            s.errors.append(bad);
+            post_message(QString::asprintf("Media scan: slot %d (%s): medium error at LBA %llu", s.slot + 1,
+                                           s.block.toStdString().c_str(), (unsigned long long) bad));
+        } else {
+            s.state = -1;
+            post_message(QString::asprintf("Media scan: slot %d (%s): VERIFY failed at LBA %llu, sense key %xh", s.slot + 1,
+                                           s.block.toStdString().c_str(), (unsigned long long) lba, (-2 == res) ? scsi_sense_key(sense) : 0));
+            break;
+        }
+        // the first worker due claims the checkpoint and the progress line
+        qint64 now = m_clock.elapsed();
+        bool save = now - m_saved_ms >= CHECKPOINT_MS;
+        bool show = now - m_shown_ms >= PROGRESS_MS;
+        if (save) {
+            m_saved_ms = now;
+        }
+        if (show) {
+            m_shown_ms = now;
+        }
+        locker.unlock();
+
+        if (save) {
+            checkpoint();
+        }
+        if (show) {
+            progress();
+        }
+    }
+    QMutexLocker locker(&m_mutex);
+    if (s.next_lba >= s.blocks) {
+        s.state = 1;
+    }
+}
+
+void MediaScan::checkpoint()
+{
+    QMutexLocker locker(&m_mutex);
+    m_saved_ms = m_clock.elapsed();
+
+    QJsonArray drives = m_others;
+    for (const _ST_SCANSLOT & s : m_slots) {
+        if (0 == s.blocks) {
+            continue;
+        }
+        QJsonArray errors;
+        for (uint64_t lba : s.errors) {
+            errors.append((double) lba);
+        }
+        QJsonObject o;
+        o.insert("wwid", s.wwid);
+        o.insert("block", s.block);
+        o.insert("blocks", (double) s.blocks);
+        o.insert("block_len", (int) s.block_len);
+        o.insert("next_lba", (double) s.next_lba);
+        o.insert("errors", errors);
+        drives.append(o);
+    }
+    QJsonObject root;
+    root.insert("updated", QDateTime::currentDateTime().toString(Qt::ISODate));
+    root.insert("drives", drives);
+
+    // written whole or not at all, a crash mid write keeps the previous one
+    QSaveFile file(MEDIA_SCAN_CHECKPOINT);
+    if (file.open(QIODevice::WriteOnly)) {
+        file.write(QJsonDocument(root).toJson());
+        file.commit();
+    } else {
+        qDebug() << "failed to write " << MEDIA_SCAN_CHECKPOINT;
+    }
+}
+
+/* One line for all the drives: how far and how fast */
+void MediaScan::progress()
+{
+    QMutexLocker locker(&m_mutex);
+    m_shown_ms = m_clock.elapsed();
+
+    double total = 0, done = 0, mbs = 0;
+    int errors = 0;
+    for (const _ST_SCANSLOT & s : m_slots) {
+        total += (double) s.blocks * s.block_len;
+        done += (double) s.next_lba * s.block_len;
+        errors += s.errors.size();
+        if (s.busy_ms > 0 && 0 == s.state) {
+            mbs += (double)(s.next_lba - s.start_lba) * s.block_len / 1000 / s.busy_ms;
+        }
+    }
+    post_message(QString::asprintf("Media scan: %.1f%% of %.1f TB, %.0f MB/s over the drives, %d medium errors",
+                                   total > 0 ? done * 100 / total : 0, total / 1e12, mbs, errors));
+}
+
+/* Per slot rate, progress and the LBAs of the medium errors */
+void MediaScan::report()
+{
+    QMutexLocker locker(&m_mutex);
+    qint64 secs = m_begin.secsTo(QDateTime::currentDateTime());
+
+    gAppendMessage(QString::asprintf("Media scan report, %lld s:", secs));
+    for (const _ST_SCANSLOT & s : m_slots) {
+        double rate = (s.busy_ms > 0) ? (double)(s.next_lba - s.start_lba) * s.block_len / 1000 / s.busy_ms : 0;
+        double pct = (s.blocks > 0) ? (double) s.next_lba * 100 / s.blocks : 0;
+        const char * state = (1 == s.state) ? "done" : ((s.state < 0) ? "failed" : "partial");
+        QString line = QString::asprintf("  slot %d (%s): %.1f%% %s, %.0f MB/s, %d medium errors", s.slot + 1,
+                                         s.block.toStdString().c_str(), pct, state, rate, (int)s.errors.size());
+        for (int i = 0; i < s.errors.size() && i < REPORT_MAX_LBAS; ++i) {
+            line += QString::asprintf("%s%llu", i ? ", " : ": LBA ", (unsigned long long) s.errors[i]);
+        }
+        if (s.errors.size() > REPORT_MAX_LBAS) {
+            line += ", ...";
+        }
+        gAppendMessage(line);
+    }
+}
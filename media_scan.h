@@ -0,0 +1,64 @@
+#ifndef MEDIA_SCAN_H
+#define MEDIA_SCAN_H
+
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QJsonArray>
+#include <QMutex>
+#include <QString>
+#include <QThread>
+#include <QVector>
+#include <atomic>
+
+#include "scsi_cmd.h"
+
+#define MEDIA_SCAN_CHECKPOINT   "media_scan.json"
+
+typedef struct ST_SCANSLOT {
+    int slot;
+    QString wwid;           // the drive is resumed by its WWID, the slot may change
+    QString block;
+    uint64_t blocks;        // 0 until READ CAPACITY
+    uint32_t block_len;
+    uint64_t next_lba;      // verified up to
+    uint64_t start_lba;     // where this session started
+    qint64 busy_ms;         // spent verifying in this session
+    int state;              // 0 scanning, 1 done, -1 stopped on an error
+    QVector<uint64_t> errors;   // LBAs of medium errors
+} _ST_SCANSLOT;
+
+/*
+ * Media scan by VERIFY(16) with BYTCHK=0: the drives read and check their own
+ * media, nothing crosses the links. All the slots are scanned concurrently
+ * in a thread of their own; progress is checkpointed to MEDIA_SCAN_CHECKPOINT
+ * so a scan stopped, or cut by a reboot, is resumed where it was.
+ */
+class MediaScan : public QThread
+{
+public:
+    MediaScan() : m_stop(false) {}
+    ~MediaScan() { end(); }
+
+    bool begin(const QVector<int> & slots, int verbose);
+    void end();
+    void report();
+
+private:
+    void run() override;
+    void scan(int idx, int fd);
+    void checkpoint();
+    void progress();
+
+    int m_verbose;
+    std::atomic<bool> m_stop;
+    QElapsedTimer m_clock;
+    qint64 m_saved_ms;      // last checkpoint
+    qint64 m_shown_ms;      // last progress message
+    QDateTime m_begin;
+    QMutex m_mutex;
+    QVector<_ST_SCANSLOT> m_slots;
+    QVector<_ST_SCSISLOT> m_targets;    // sg nodes and CPUs of the slots, copied from gDevices in begin()
+    QJsonArray m_others;    // checkpointed drives not in this scan, kept as they were
+};
+
+#endif // MEDIA_SCAN_H
@@ -0,0 +1,388 @@
+#include <QHash>
+#include <QMutex>
+#include <algorithm>
+#include <atomic>
+
+#include <string.h>
+
+#include "widget.h"
+#include "mode_pages.h"
+#include "scsi_cmd.h"
+
+#define MODE_SENSE_10       0x5a
+#define MODE_SELECT_10      0x55
+#define MODE_PC_CURRENT     0
+#define MODE_PC_CHANGEABLE  1
+#define MODE_PC_SAVED       3
+#define MODE_HDR_LEN        8           // mode parameter header(10)
+#define MODE_ALLOC_LEN      252
+#define MODE_PER_EXP        8           // commands in flight per expander
+
+/* Caching mode page */
+#define CACHING_WCE_BYTE    2
+#define CACHING_WCE         0x04        // write cache enable
+#define CACHING_RCD         0x01        // read cache disable
+#define CACHING_DRA_BYTE    12
+#define CACHING_DRA         0x20        // disable read-ahead
+/* Power Condition mode page */
+#define POWER_Y_BYTE        2
+#define POWER_STANDBY_Y     0x01
+#define POWER_TIMERS_BYTE   3
+#define POWER_TIMERS        0x0f        // IDLE_C, IDLE_B, IDLE_A, STANDBY_Z
+
+static const uint8_t MODE_PAGE_CODE[MODE_NPAGE] = { 0x08, 0x1a };
+
+typedef struct ST_MODEPROFILE {
+    const char * name;
+    int wce;                // 1 set, 0 clear, -1 as is
+    int rcd;
+    int dra;
+    int power;              // 0 every idle and standby timer off, -1 as is
+} _ST_MODEPROFILE;
+
+static const _ST_MODEPROFILE MODE_PROFILES[] = {
+    { "performance",    1,  0,  0,  0 },    // write back, read cache and read-ahead on, no power saving
+    { "write-through",  0,  0,  0, -1 },
+    { "no-read-ahead",  1,  0,  1, -1 },
+};
+
+/* The drives changed by mode_apply_profile() as they were before, for mode_rollback() */
+static QVector<_ST_MODEPAGES> originals;
+static bool originals_saved;
+static QMutex originals_mutex;
+
+static int
+mode_sense(int fd, int page, int pc, QByteArray & out, int vb)
+{
+    uint8_t cdb[10] = {MODE_SENSE_10, 0x08 /* DBD */, (uint8_t)((pc << 6) | page), 0, 0, 0, 0, 0, MODE_ALLOC_LEN, 0};
+    uint8_t buf[MODE_ALLOC_LEN];
+
+    memset(buf, 0, sizeof(buf));
+    int len = scsi_cmd(fd, cdb, sizeof(cdb), SCSI_READ, buf, sizeof(buf), nullptr, SCSI_TIMEOUT_MS, vb);
+    if (len < MODE_HDR_LEN + 2) {
+        return -1;
+    }
+    int off = MODE_HDR_LEN + ((buf[6] << 8) | buf[7]);
+    if (off + 2 > len || (buf[off] & 0x3f) != page || off + 2 + buf[off + 1] > len) {
+        return -1;
+    }
+    out = QByteArray((const char *) buf + off, 2 + buf[off + 1]);
+    return 0;
+}
+
+/* One page with SP set to save it as well; the header carries no block descriptor */
+static int
+mode_select(int fd, const QByteArray & page, bool save, int vb)
+{
+    uint8_t buf[MODE_ALLOC_LEN];
+    int len = MODE_HDR_LEN + page.size();
+    if (len > (int)sizeof(buf)) {
+        return -1;
+    }
+    memset(buf, 0, MODE_HDR_LEN);
+    memcpy(buf + MODE_HDR_LEN, page.constData(), page.size());
+    buf[MODE_HDR_LEN] &= 0x7f;      // PS is reserved in MODE SELECT
+
+    uint8_t cdb[10] = {MODE_SELECT_10, (uint8_t)(0x10 /* PF */ | (save ? 0x01 : 0)), 0, 0, 0, 0, 0,
+                       (uint8_t)(len >> 8), (uint8_t)len, 0};
+    return scsi_cmd(fd, cdb, sizeof(cdb), SCSI_WRITE, buf, len, nullptr, SCSI_TIMEOUT_MS, vb);
+}
+
+static void
+sense_pages(int fd, _ST_MODEPAGES & pages, int vb)
+{
+    for (int p = 0; p < MODE_NPAGE; ++p) {
+        mode_sense(fd, MODE_PAGE_CODE[p], MODE_PC_CURRENT, pages.current[p], vb);
+        mode_sense(fd, MODE_PAGE_CODE[p], MODE_PC_SAVED, pages.saved[p], vb);
+        mode_sense(fd, MODE_PAGE_CODE[p], MODE_PC_CHANGEABLE, pages.changeable[p], vb);
+    }
+}
+
+/*
+ * Current, saved and changeable values of the caching and power condition
+ * pages of the slots, a few drives of each expander at a time. Returns one
+ * entry per slot opened, in slot order.
+ */
+QVector<_ST_MODEPAGES>
+mode_sense_sweep(const QVector<int> & slots, int vb)
+{
+    QVector<_ST_MODEPAGES> all;
+    QMutex mutex;
+
+    scsi_for_each_slot(slots, MODE_PER_EXP, [&all, &mutex, vb](int sl, int fd) {
+        _ST_MODEPAGES pages;
+        pages.slot = sl;
+        sense_pages(fd, pages, vb);
+        QMutexLocker locker(&mutex);
+        all.append(pages);
+    }, vb);
+
+    std::sort(all.begin(), all.end(), [](const _ST_MODEPAGES & a, const _ST_MODEPAGES & b) {
+        return a.slot < b.slot;
+    });
+    return all;
+}
+
+static QString
+caching_str(const QByteArray & pg)
+{
+    if (pg.size() <= CACHING_DRA_BYTE) {
+        return "-";
+    }
+    return QString::asprintf("WCE=%d RCD=%d DRA=%d", (pg[CACHING_WCE_BYTE] & CACHING_WCE) ? 1 : 0,
+                             (pg[CACHING_WCE_BYTE] & CACHING_RCD) ? 1 : 0, (pg[CACHING_DRA_BYTE] & CACHING_DRA) ? 1 : 0);
+}
+
+static QString
+power_str(const QByteArray & pg)
+{
+    if (pg.size() <= POWER_TIMERS_BYTE) {
+        return "-";
+    }
+    QStringList on;
+    const char * names[] = { "standby_z", "idle_a", "idle_b", "idle_c" };
+    for (int b = 3; b >= 0; --b) {
+        if (pg[POWER_TIMERS_BYTE] & (1 << b)) {
+            on << names[b];
+        }
+    }
+    if (pg[POWER_Y_BYTE] & POWER_STANDBY_Y) {
+        on << "standby_y";
+    }
+    return on.isEmpty() ? QString("off") : on.join(" ");
+}
+
+/* Slot, WCE, RCD, DRA, power conditions and how the saved values differ, for the SG3 table */
+QStringList
+mode_audit_row(const _ST_MODEPAGES & pages)
+{
+    const QByteArray & c = pages.current[MODE_CACHING];
+    QStringList row;
+    row << QString::number(pages.slot + 1) << gDevices.block(pages.slot);
+    if (c.size() > CACHING_DRA_BYTE) {
+        row << ((c[CACHING_WCE_BYTE] & CACHING_WCE) ? "on" : "OFF")
+            << ((c[CACHING_WCE_BYTE] & CACHING_RCD) ? "OFF" : "on")
+            << ((c[CACHING_DRA_BYTE] & CACHING_DRA) ? "OFF" : "on");
+    } else {
+        row << "-" << "-" << "-";
+    }
+    row << power_str(pages.current[MODE_POWER]);
+
+    QStringList differs;
+    if (pages.saved[MODE_CACHING] != c && false == pages.saved[MODE_CACHING].isEmpty()) {
+        differs << "saved " + caching_str(pages.saved[MODE_CACHING]);
+    }
+    if (pages.saved[MODE_POWER] != pages.current[MODE_POWER] && false == pages.saved[MODE_POWER].isEmpty()) {
+        differs << "saved power " + power_str(pages.saved[MODE_POWER]);
+    }
+    row << (differs.isEmpty() ? QString("same") : differs.join(", "));
+    return row;
+}
+
+QStringList
+mode_profile_names()
+{
+    QStringList names;
+    for (const _ST_MODEPROFILE & p : MODE_PROFILES) {
+        names << p.name;
+    }
+    return names;
+}
+
+/* Set or clear the bits of a page wanted by the profile; false if one of them may not be changed */
+static bool
+set_bits(QByteArray & pg, const QByteArray & mask, int byte, uint8_t bits, int want)
+{
+    if (want < 0 || pg.size() <= byte) {
+        return true;
+    }
+    uint8_t v = want ? bits : 0;
+    if ((pg[byte] & bits) == v) {
+        return true;
+    }
+    if (mask.size() <= byte || (mask[byte] & bits) != bits) {
+        return false;
+    }
+    pg[byte] = (pg[byte] & ~bits) | v;
+    return true;
+}
+
+/* The pages with the profile applied, only those changed; empty if the drive cannot take it */
+static bool
+profile_pages(const _ST_MODEPROFILE & prof, const _ST_MODEPAGES & orig, QByteArray out[MODE_NPAGE])
+{
+    QByteArray c = orig.current[MODE_CACHING];
+    QByteArray p = orig.current[MODE_POWER];
+    bool ok = set_bits(c, orig.changeable[MODE_CACHING], CACHING_WCE_BYTE, CACHING_WCE, prof.wce) &&
+              set_bits(c, orig.changeable[MODE_CACHING], CACHING_WCE_BYTE, CACHING_RCD, prof.rcd) &&
+              set_bits(c, orig.changeable[MODE_CACHING], CACHING_DRA_BYTE, CACHING_DRA, prof.dra);
+    // a drive without the power condition page has no timers to turn off
+    if (prof.power >= 0 && false == p.isEmpty()) {
+        ok = ok && set_bits(p, orig.changeable[MODE_POWER], POWER_TIMERS_BYTE, POWER_TIMERS, prof.power) &&
+                   set_bits(p, orig.changeable[MODE_POWER], POWER_Y_BYTE, POWER_STANDBY_Y, prof.power);
+    }
+    out[MODE_CACHING] = (c != orig.current[MODE_CACHING]) ? c : QByteArray();
+    out[MODE_POWER] = (p != orig.current[MODE_POWER]) ? p : QByteArray();
+    return ok && false == orig.current[MODE_CACHING].isEmpty();
+}
+
+/* Put the pages of one drive back as captured: the saved values first, as SP also sets the current ones */
+static int
+restore_drive(int fd, const _ST_MODEPAGES & orig, bool saved, int vb)
+{
+    int failed = 0;
+    for (int p = 0; p < MODE_NPAGE; ++p) {
+        if (saved && false == orig.saved[p].isEmpty() && mode_select(fd, orig.saved[p], true, vb) < 0) {
+            failed++;
+        }
+        if (false == orig.current[p].isEmpty() && mode_select(fd, orig.current[p], false, vb) < 0) {
+            failed++;
+        }
+    }
+    return failed;
+}
+
+/*
+ * Push a profile to the slots by MODE SELECT, to the current values or the
+ * saved ones too, and read it back. The pages are captured first; if any
+ * drive refuses or does not read back as set, every drive is put back as it
+ * was. Returns the number of drives changed, or -1 if rolled back.
+ */
+int
+mode_apply_profile(const QVector<int> & slots, const QString & profile, bool save, int vb)
+{
+    const _ST_MODEPROFILE * prof = nullptr;
+    for (const _ST_MODEPROFILE & p : MODE_PROFILES) {
+        if (profile == p.name) {
+            prof = &p;
+        }
+    }
+    if (nullptr == prof) {
+        gAppendMessage("Unknown mode profile " + profile);
+        return -1;
+    }
+    if (mode_rollback_pending()) {
+        // the first capture is the one to go back to
+        mode_rollback(vb);
+    }
+
+    // the drives are known by WWID for the rollback, taken here as the workers do not read gDevices
+    QHash<int, QString> wwids;
+    for (int sl : slots) {
+        wwids.insert(sl, gDevices.wwid(sl));
+    }
+    QStringList failures;
+    QMutex mutex;
+    QVector<_ST_MODEPAGES> changed;
+    scsi_for_each_slot(slots, MODE_PER_EXP, [&](int sl, int fd) {
+        _ST_MODEPAGES orig;
+        QByteArray want[MODE_NPAGE];
+        orig.slot = sl;
+        orig.wwid = wwids.value(sl);
+        sense_pages(fd, orig, vb);
+        if (false == profile_pages(*prof, orig, want)) {
+            QMutexLocker locker(&mutex);
+            failures << QString::asprintf("slot %d: the profile bits are not changeable", sl + 1);
+            return;
+        }
+        int failed = 0;
+        bool touched = false;
+        for (int p = 0; p < MODE_NPAGE; ++p) {
+            if (want[p].isEmpty()) {
+                continue;
+            }
+            touched = true;
+            QByteArray back;
+            if (mode_select(fd, want[p], save, vb) < 0 ||
+                mode_sense(fd, MODE_PAGE_CODE[p], save ? MODE_PC_SAVED : MODE_PC_CURRENT, back, vb) < 0 ||
+                (back.at(0) & 0x3f) != (want[p].at(0) & 0x3f) || back.mid(2) != want[p].mid(2)) {
+                failed++;
+            }
+        }
+        QMutexLocker locker(&mutex);
+        if (touched) {
+            changed.append(orig);
+        }
+        if (failed) {
+            failures << QString::asprintf("slot %d: MODE SELECT failed or did not read back", sl + 1);
+        }
+    }, vb);
+
+    {
+        QMutexLocker locker(&originals_mutex);
+        originals = changed;
+        originals_saved = save;
+    }
+    if (false == failures.isEmpty()) {
+        for (const QString & f : failures) {
+            gAppendMessage("  " + f);
+        }
+        gAppendMessage(QString::asprintf("Mode profile %s failed on %d drives, rolled back", prof->name, (int)failures.size()));
+        mode_rollback(vb);
+        return -1;
+    }
+    gAppendMessage(QString::asprintf("Mode profile %s applied to %d of %d drives (%s), %d already had it", prof->name,
+                                     (int)changed.size(), (int)slots.size(), save ? "saved" : "current",
+                                     (int)(slots.size() - changed.size())));
+    return changed.size();
+}
+
+/*
+ * Put the drives changed by the last profile back to the pages captured
+ * before it, found by WWID; a drive no longer there is skipped, so the
+ * pages are never written to another drive swapped into its slot. Returns
+ * the number of drives which failed to restore.
+ */
+int
+mode_rollback(int vb)
+{
+    QVector<_ST_MODEPAGES> todo;
+    bool saved;
+    {
+        QMutexLocker locker(&originals_mutex);
+        todo.swap(originals);
+        saved = originals_saved;
+    }
+    if (todo.isEmpty()) {
+        return 0;
+    }
+
+    QVector<int> slots;
+    QHash<int, int> index;
+    int gone = 0;
+    for (int i = 0; i < todo.size(); ++i) {
+        int sl = -1;
+        for (int j = 0; j < NSLOT && false == todo[i].wwid.isEmpty(); ++j) {
+            if (gDevices.wwid(j) == todo[i].wwid) {
+                sl = j;
+                break;
+            }
+        }
+        if (sl < 0) {
+            gAppendMessage(QString::asprintf("  slot %d: %s is no longer there, not rolled back", todo[i].slot + 1,
+                                             todo[i].wwid.toStdString().c_str()));
+            gone++;
+            continue;
+        }
+        slots.append(sl);
+        index.insert(sl, i);
+    }
+    std::atomic<int> failed(0);
+    int done = scsi_for_each_slot(slots, MODE_PER_EXP, [&](int sl, int fd) {
+        if (restore_drive(fd, todo[index.value(sl)], saved, vb)) {
+            failed++;
+        }
+    }, vb);
+    failed += slots.size() - done;
+    gAppendMessage(QString::asprintf("Mode pages rolled back on %d drives, %d failed, %d gone",
+                                     (int)slots.size() - failed, (int)failed, gone));
+    return failed;
+}
+
+/* The number of drives a rollback would restore */
+int
+mode_rollback_pending()
+{
+    QMutexLocker locker(&originals_mutex);
+    return originals.size();
+}
@@ -0,0 +1,29 @@
+#ifndef MODE_PAGES_H
+#define MODE_PAGES_H
+
+#include <QByteArray>
+#include <QStringList>
+#include <QVector>
+
+typedef enum {
+    MODE_CACHING = 0,       // Caching mode page 08h
+    MODE_POWER,             // Power Condition mode page 1Ah
+    MODE_NPAGE
+} ENUM_MODEPAGE;
+
+typedef struct ST_MODEPAGES {
+    int slot;
+    QString wwid;                       // the drive the pages belong to, it may be swapped out of the slot
+    QByteArray current[MODE_NPAGE];     // the page without the mode parameter header, empty if not read
+    QByteArray saved[MODE_NPAGE];
+    QByteArray changeable[MODE_NPAGE];  // mask of the bits which MODE SELECT may change
+} _ST_MODEPAGES;
+
+QVector<_ST_MODEPAGES> mode_sense_sweep(const QVector<int> & slots, int verbose);
+QStringList mode_audit_row(const _ST_MODEPAGES & pages);
+QStringList mode_profile_names();
+int mode_apply_profile(const QVector<int> & slots, const QString & profile, bool save, int verbose);
+int mode_rollback(int verbose);
+int mode_rollback_pending();
+
+#endif // MODE_PAGES_H
@@ -0,0 +1,182 @@
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "widget.h"
+#include "mpath_failover.h"
+
+#define DIP_WINDOW_US   100000  // throughput is taken over windows this long
+#define BASELINE_US     5000000 // the steady state before the phy goes down
+#define RECOVERED       0.90    // of the baseline
+
+bool FailoverProbe::begin(const _ST_MPATH & mp, int interval_us)
+{
+    m_mp = mp;
+    m_paths = qMin(mp.blocks.size(), PROBE_MAX_PATHS);
+    m_interval = interval_us;
+    m_stop = false;
+    m_samples.clear();
+
+    m_fd[0] = open(("/sys/block/" + mp.dm + "/stat").toStdString().c_str(), O_RDONLY);
+    for (int i = 0; i < m_paths; i++) {
+        m_fd[i + 1] = open(("/sys/block/" + mp.blocks[i] + "/stat").toStdString().c_str(), O_RDONLY);
+    }
+    if (m_fd[0] < 0) {
+        end();
+        return false;
+    }
+    m_clock.start();
+    start();
+    return true;
+}
+
+void FailoverProbe::end()
+{
+    if (isRunning()) {
+        m_stop = true;
+        wait();
+    }
+    for (int i = 0; i <= m_paths; i++) {
+        if (m_fd[i] >= 0) {
+            close(m_fd[i]);
+            m_fd[i] = -1;
+        }
+    }
+    m_paths = -1;
+}
+
+void FailoverProbe::run()
+{
+    while (false == m_stop) {
+        sample();
+        QThread::usleep(m_interval);
+    }
+}
+
+/* Fields of the stat file as in SlotSampler::sample() */
+void FailoverProbe::sample()
+{
+    _ST_IOSAMPLE s = { elapsed_us(), 0, {0} };
+    char buf[256];
+
+    for (int i = 0; i <= m_paths; i++) {
+        ssize_t len = (m_fd[i] < 0) ? -1 : pread(m_fd[i], buf, sizeof(buf) - 1, 0);
+        if (len <= 0) {
+            continue;
+        }
+        buf[len] = '\0';
+        quint64 v[7] = {0};
+        char * p = buf;
+        for (int f = 0; f < 7; f++) {
+            v[f] = strtoull(p, &p, 10);
+        }
+        if (0 == i) {
+            s.ios = v[0] + v[4];
+        } else {
+            s.sectors[i - 1] = v[2] + v[6];
+        }
+    }
+    QMutexLocker locker(&m_mutex);
+    m_samples.append(s);
+}
+
+/* The path which moved the most sectors over the last window_ms, the active one */
+int FailoverProbe::busiest_path(int window_ms)
+{
+    QMutexLocker locker(&m_mutex);
+    if (m_samples.size() < 2) {
+        return 0;
+    }
+    const _ST_IOSAMPLE & last = m_samples.last();
+    int i = m_samples.size() - 1;
+    while (i > 0 && last.us - m_samples[i].us < window_ms * 1000) {
+        i--;
+    }
+    int busiest = 0;
+    for (int p = 1; p < m_paths; p++) {
+        if (last.sectors[p] - m_samples[i].sectors[p] > last.sectors[busiest] - m_samples[i].sectors[busiest]) {
+            busiest = p;
+        }
+    }
+    return busiest;
+}
+
+/*
+ * From the samples around the phy of path going down at down_us and up again
+ * at up_us: the longest stall of the device (no IO completed) after the phy
+ * went down, the lowest throughput over DIP_WINDOW_US against the baseline
+ * before, the time to get back to RECOVERED of the baseline, and the failback,
+ * when the path carries IO again after the phy is up.
+ */
+void FailoverProbe::report(int path, qint64 down_us, qint64 up_us, QTextStream & csv)
+{
+    QMutexLocker locker(&m_mutex);
+    const QVector<_ST_IOSAMPLE> & s = m_samples;
+    if (s.size() < 2) {
+        return;
+    }
+
+    // IOPS over the window ending at sample i
+    auto window_iops = [&s](int i) {
+        int j = i;
+        while (j > 0 && s[i].us - s[j].us < DIP_WINDOW_US) {
+            j--;
+        }
+        return (s[i].us > s[j].us) ? (s[i].ios - s[j].ios) * 1e6 / (s[i].us - s[j].us) : 0.0;
+    };
+
+    double baseline = 0;
+    int first = 0, last = 0;
+    for (int i = 0; i < s.size(); i++) {
+        if (s[i].us <= down_us - BASELINE_US) {
+            first = i;
+        }
+        if (s[i].us <= down_us) {
+            last = i;
+        }
+    }
+    if (s[last].us > s[first].us) {
+        baseline = (s[last].ios - s[first].ios) * 1e6 / (s[last].us - s[first].us);
+    }
+
+    // the stalls of the failover [0] and of the failback [1], from the phy going down / up
+    qint64 stall_us[2] = {0, 0}, stall_at[2] = {-1, -1}, recovered_us = -1, failback_us = -1;
+    double dip = baseline;
+    int idle = last;
+    for (int i = last + 1; i < s.size(); i++) {
+        if (s[i].ios != s[i - 1].ios || i == s.size() - 1) {
+            int phase = (s[idle].us < up_us) ? 0 : 1;
+            if (s[i].us - s[idle].us > stall_us[phase]) {
+                stall_us[phase] = s[i].us - s[idle].us;
+                stall_at[phase] = s[idle].us - (phase ? up_us : down_us);
+            }
+            idle = i;
+        }
+        if (s[i].us < up_us) {
+            double iops = window_iops(i);
+            dip = qMin(dip, iops);
+            if (recovered_us < 0 && dip < baseline * RECOVERED && iops >= baseline * RECOVERED) {
+                recovered_us = s[i].us - down_us;
+            }
+        } else if (failback_us < 0 && s[i].sectors[path] != s[i - 1].sectors[path]) {
+            failback_us = s[i].us - up_us;
+        }
+    }
+
+    int sl = m_mp.slots[path];
+    QString where = m_mp.name + " path " + m_mp.blocks[path] +
+                    ((sl < 0) ? QString() : QString::asprintf(" (Expander-%d slot %d)", sl / NSLOT_PEREXP + 1, sl + 1));
+    gAppendMessage("  " + where + QString::asprintf(": baseline %.0f IOPS", baseline));
+    gAppendMessage(QString::asprintf("    stall %.1f ms starting %.1f ms after the phy went down",
+                                     stall_us[0] / 1000.0, stall_at[0] / 1000.0));
+    gAppendMessage(QString::asprintf("    dip to %.0f IOPS (%.0f%%), ", dip, baseline ? dip / baseline * 100 : 0) +
+                   ((recovered_us < 0) ? QString("not recovered") : QString::asprintf("recovered in %.1f ms", recovered_us / 1000.0)));
+    gAppendMessage((failback_us < 0) ? QString("    no failback while the workload ran")
+                                     : QString::asprintf("    failback %.1f ms after the phy was up, stall %.1f ms",
+                                                         failback_us / 1000.0, stall_us[1] / 1000.0));
+
+    csv << m_mp.name << "," << m_mp.blocks[path] << "," << sl + 1 << "," << QString::number(baseline, 'f', 0) << ","
+        << QString::number(stall_us[0] / 1000.0, 'f', 1) << "," << QString::number(dip, 'f', 0) << ","
+        << QString::number(recovered_us / 1000.0, 'f', 1) << "," << QString::number(failback_us / 1000.0, 'f', 1) << ","
+        << QString::number(stall_us[1] / 1000.0, 'f', 1) << Qt::endl;
+}
@@ -0,0 +1,52 @@
+#ifndef MPATH_FAILOVER_H
+#define MPATH_FAILOVER_H
+
+#include <QElapsedTimer>
+#include <QMutex>
+#include <QTextStream>
+#include <QThread>
+#include <QVector>
+#include <atomic>
+
+#include "multipath.h"
+
+#define PROBE_MAX_PATHS 4
+
+typedef struct ST_IOSAMPLE {
+    qint64 us;                          // since the probe began
+    quint64 ios;                        // completed on the multipath device, reads + writes
+    quint64 sectors[PROBE_MAX_PATHS];   // moved on each path
+} _ST_IOSAMPLE;
+
+/*
+ * Samples the stat files of a multipath device and of its paths in a thread
+ * of its own at a high rate (pread of a handful of files), so a failover can
+ * be timed down to the sample interval while fio keeps the device busy.
+ */
+class FailoverProbe : public QThread
+{
+public:
+    FailoverProbe() : m_paths(-1), m_stop(false) {}
+    ~FailoverProbe() { end(); }
+
+    bool begin(const _ST_MPATH & mp, int interval_us);
+    void end();
+    qint64 elapsed_us() { return m_clock.nsecsElapsed() / 1000; }
+    int busiest_path(int window_ms);
+    void report(int path, qint64 down_us, qint64 up_us, QTextStream & csv);
+
+private:
+    void run() override;
+    void sample();
+
+    _ST_MPATH m_mp;
+    int m_fd[PROBE_MAX_PATHS + 1];      // the device, then its paths
+    int m_paths;
+    int m_interval;
+    std::atomic<bool> m_stop;
+    QElapsedTimer m_clock;
+    QMutex m_mutex;
+    QVector<_ST_IOSAMPLE> m_samples;
+};
+
+#endif // MPATH_FAILOVER_H
@@ -1,4 +1,8 @@
+#include <QDir>
+#include <QFileInfo>
+#include <QHash>
 #include <QWidget>
+#include <algorithm>
 
 #include <dirent.h>
 #include <linux/bsg.h>
@@ -7,6 +11,7 @@
 #include <scsi/sg.h>
 #include <sys/ioctl.h>
 
+#include "lsscsi.h"
 #include "mpi3mr.h"
 #include "mpi3mr_app.h"
 #include "smp_lib.h"
@@ -28,11 +33,12 @@ static struct mpi3mr_bsg_in_adpinfo adpinfo[NUM_IOC];
 static struct mpi3mr_ioc_facts ioc_facts[NUM_IOC];
 static struct mpi3mr_hba_sas_exp hba_sas_exp[NUM_IOC][NUM_EXP_PER_HBA];
 
-struct my_all_tgt_info {
-    struct mpi3mr_all_tgt_info tgt_info;
-    struct mpi3mr_device_map_info devmap_info[100];
-};
-static struct my_all_tgt_info alltgt_info[NUM_IOC];
+/* Config page headers of an IOC, by page type << 8 | page number, valid under the facts kept */
+typedef struct ST_CFGHDRCACHE {
+    struct mpi3mr_ioc_facts facts;
+    QHash<u16, struct mpi3_config_page_header> hdrs;
+} _ST_CFGHDRCACHE;
+static QHash<int, _ST_CFGHDRCACHE> cfg_hdr_cache;   // by IOC number
 
 /* To differentiate from MPI3 pass through commands */
 #define DRVBSG_OPCODE (0x1 << 31)
@@ -44,11 +50,12 @@ static struct my_all_tgt_info alltgt_info[NUM_IOC];
  */
 #define NUM_BYTES (sizeof(struct mpi3mr_bsg_packet) + (9 * sizeof(struct mpi3mr_buf_entry)))
 
-static char mbp_pool[NUM_BYTES];
-static struct mpi3mr_bsg_packet & mbp = *(struct mpi3mr_bsg_packet *)mbp_pool;
+/* per thread, so SMP requests to the expanders can be issued concurrently */
+static thread_local char mbp_pool[NUM_BYTES];
+static thread_local struct mpi3mr_bsg_packet & mbp = *(struct mpi3mr_bsg_packet *)mbp_pool;
 
-static char request_m[1024];
-static char reply_m[1024];
+static thread_local char request_m[1024];
+static thread_local char reply_m[1024];
 
 class mpi3_request
 {
@@ -323,8 +330,10 @@ int send_req_mpi3mr_bsg(int fd, int subvalue, int64_t target_sa, smp_req_resp *
     hdr.dout_xfer_len = rresp->request_len + mpi3rq.m_requestLen;
     hdr.dout_xferp = (uintptr_t) request_m;
 
+    /* a driver command returns data only, so it goes straight to the caller's buffer of any size */
+    bool direct = (0 == mpi3rq.m_replyLen);
     hdr.din_xfer_len = rresp->max_response_l + mpi3rq.m_replyLen;
-    hdr.din_xferp = (uintptr_t) reply_m;
+    hdr.din_xferp = direct ? (uintptr_t) rresp->response : (uintptr_t) reply_m;
 
     hdr.timeout = DEF_TIMEOUT_MS;
 
@@ -339,7 +348,9 @@ int send_req_mpi3mr_bsg(int fd, int subvalue, int64_t target_sa, smp_req_resp *
         return -1;
     }
 
-    memcpy(rresp->response, reply_m, rresp->max_response_l);
+    if (false == direct) {
+        memcpy(rresp->response, reply_m, rresp->max_response_l);
+    }
     void * mpi_reply = reply_m + rresp->max_response_l;
 
     /* was: rresp->act_response_l = -1; */
@@ -461,16 +472,16 @@ void mpi3mr_slot_discover(int vb)
 }
 
 /* Get adapter info command handler */
-static int populate_adpinfo(smp_target_obj * top, int vb)
+static int populate_adpinfo(smp_target_obj * top, struct mpi3mr_bsg_in_adpinfo & info, int vb)
 {
     smp_req_resp smp_rr;
 
-    memset(&(adpinfo[ioc_cnt]), 0, sizeof(adpinfo[ioc_cnt]));
+    memset(&info, 0, sizeof(info));
     memset(&smp_rr, 0, sizeof(smp_rr));
 
     smp_rr.mpi3mr_function = DRVBSG_OPCODE + MPI3MR_DRVBSG_OPCODE_ADPINFO;
-    smp_rr.max_response_l = sizeof(adpinfo[ioc_cnt]);
-    smp_rr.response = (u8*) &(adpinfo[ioc_cnt]);
+    smp_rr.max_response_l = sizeof(info);
+    smp_rr.response = (u8*) &info;
 
     int res = send_req_mpi3mr_bsg(top->fd, top->subvalue, 0, &smp_rr, vb);
     if (res) {
@@ -481,7 +492,7 @@ static int populate_adpinfo(smp_target_obj * top, int vb)
         qDebug("[send_req_mpi3mr_bsg] transport_error=%d", smp_rr.transport_err);
         return -1;
     }
-    if (smp_rr.act_response_l != sizeof(adpinfo[ioc_cnt])) {
+    if (smp_rr.act_response_l != sizeof(info)) {
         qDebug("[send_req_mpi3mr_bsg] adpinfo data length mismatch");
         return -1;
     }
@@ -489,33 +500,54 @@ static int populate_adpinfo(smp_target_obj * top, int vb)
     return 0;
 }
 
-/* Get all target information */
-static int get_all_tgt_info(smp_target_obj * top, int vb)
+/*
+ * Get all target information: the driver returns only the number of devices
+ * to a buffer of 8 bytes, so it is asked twice, the second time with a buffer
+ * sized to the devices. Devices added in between are left to the next call.
+ *
+ * Return: the number of devices mapped, negative on failure.
+ */
+static int get_all_tgt_info(smp_target_obj * top, QVector<struct mpi3mr_device_map_info> & devmap, int vb)
 {
+    constexpr int HDR_SIZE = offsetof(struct mpi3mr_all_tgt_info, dmi);
     smp_req_resp smp_rr;
-
-    memset(&(alltgt_info[ioc_cnt]), 0, sizeof(alltgt_info[ioc_cnt]));
-    memset(&smp_rr, 0, sizeof(smp_rr));
-
-    smp_rr.mpi3mr_function = DRVBSG_OPCODE + MPI3MR_DRVBSG_OPCODE_ALLTGTDEVINFO;
-    smp_rr.max_response_l = sizeof(alltgt_info[ioc_cnt]);
-    smp_rr.response = (u8*) &(alltgt_info[ioc_cnt]);
-
-    int res = send_req_mpi3mr_bsg(top->fd, top->subvalue, 0, &smp_rr, vb);
-    if (res) {
-        qDebug("[send_req_mpi3mr_bsg] failed, res=%d", res);
-        return -1;
-    }
-    if (smp_rr.transport_err) {
-        qDebug("[send_req_mpi3mr_bsg] transport_error=%d", smp_rr.transport_err);
-        return -1;
+    QByteArray buf(HDR_SIZE, 0);
+    int num = 0;
+
+    devmap.clear();
+    for (int pass = 0; pass < 2; ++pass) {
+        memset(&smp_rr, 0, sizeof(smp_rr));
+        smp_rr.mpi3mr_function = DRVBSG_OPCODE + MPI3MR_DRVBSG_OPCODE_ALLTGTDEVINFO;
+        smp_rr.max_response_l = buf.size();
+        smp_rr.response = (u8*) buf.data();
+
+        int res = send_req_mpi3mr_bsg(top->fd, top->subvalue, 0, &smp_rr, vb);
+        if (res) {
+            qDebug("[send_req_mpi3mr_bsg] failed, res=%d", res);
+            return -1;
+        }
+        if (smp_rr.transport_err) {
+            qDebug("[send_req_mpi3mr_bsg] transport_error=%d", smp_rr.transport_err);
+            return -1;
+        }
+        struct mpi3mr_all_tgt_info * info = (struct mpi3mr_all_tgt_info *) buf.data();
+        if (0 == pass) {
+            num = info->num_devices;
+            if (0 == num) {
+                return 0;
+            }
+            buf.fill(0, HDR_SIZE + num * sizeof(struct mpi3mr_device_map_info));
+        } else {
+            num = qMin(num, (int)info->num_devices);
+            for (int i = 0; i < num; ++i) {
+                devmap.append(info->dmi[i]);
+            }
+        }
     }
-    if (smp_rr.act_response_l != sizeof(alltgt_info[ioc_cnt])) {
-        qDebug("[send_req_mpi3mr_bsg] alltgt_info data length mismatch");
-        return -1;
+    if (vb) {
+        qDebug("%s: %d devices on IOC %d", __func__, num, top->subvalue);
     }
-
-    return 0;
+    return num;
 }
 
 /* Return: 0 on success, non-zero on failure. */
@@ -560,6 +592,12 @@ static int issue_iocfacts(smp_target_obj * top, int vb)
     ioc_facts[ioc_cnt].max_sasexpanders = facts_data.max_sas_expanders;
     ioc_facts[ioc_cnt].max_enclosures = facts_data.max_enclosures;
     ioc_facts[ioc_cnt].max_data_length = facts_data.max_data_length;
+    ioc_facts[ioc_cnt].max_reqs = facts_data.max_outstanding_requests;
+    ioc_facts[ioc_cnt].max_dev_per_tg = facts_data.max_devices_per_throttle_group;
+    ioc_facts[ioc_cnt].io_throttle_data_length = facts_data.io_throttle_data_length;
+    ioc_facts[ioc_cnt].max_io_throttle_group = facts_data.max_io_throttle_group;
+    ioc_facts[ioc_cnt].io_throttle_low = facts_data.io_throttle_low;
+    ioc_facts[ioc_cnt].io_throttle_high = facts_data.io_throttle_high;
     ioc_facts[ioc_cnt].fw_ver.build_num = facts_data.fw_version.build_num;
     ioc_facts[ioc_cnt].fw_ver.cust_id = facts_data.fw_version.customer_id;
     ioc_facts[ioc_cnt].fw_ver.ph_minor = facts_data.fw_version.phase_minor;
@@ -579,26 +617,48 @@ static int issue_iocfacts(smp_target_obj * top, int vb)
     return 0;
 }
 
+/*
+ * Headers do not change while the IOC is up: they are dropped when the
+ * adapter is not operational (in reset or faulted) or its facts change.
+ */
+static void cfg_hdr_validate(int ioc, const struct mpi3mr_bsg_in_adpinfo & info, const struct mpi3mr_ioc_facts & facts, int vb)
+{
+    _ST_CFGHDRCACHE & cache = cfg_hdr_cache[ioc];
+    if (MPI3MR_BSG_ADPSTATE_OPERATIONAL != info.adp_state || memcmp(&cache.facts, &facts, sizeof(facts))) {
+        if (vb && false == cache.hdrs.isEmpty()) {
+            qDebug("IOC %d reset or its facts changed, %lld config page headers dropped", ioc, (long long) cache.hdrs.size());
+        }
+        cache.hdrs.clear();
+        cache.facts = facts;
+    }
+}
+
 /**
- *  @form: The form to be used for addressing the page
+ *  Read the header of a config page once per IOC, the cached one after.
  *
  *  Return: 0 on success, non-zero on failure.
  */
-static int cfg_get_enclosure_pg0(smp_target_obj * top, struct mpi3_enclosure_page0 & encl_pg0, u32 form, int vb)
+static int cfg_get_page_header(smp_target_obj * top, u8 page_type, u8 page_number, struct mpi3_config_page_header & cfg_hdr, u32 form, int vb)
 {
-    struct mpi3_config_page_header cfg_hdr;
     struct mpi3_config_request cfg_req;
     smp_req_resp smp_rr;
+    u16 key = (page_type << 8) | page_number;
+
+    QHash<u16, struct mpi3_config_page_header> & hdrs = cfg_hdr_cache[top->subvalue].hdrs;
+    auto it = hdrs.constFind(key);
+    if (it != hdrs.cend()) {
+        cfg_hdr = it.value();
+        return 0;
+    }
 
-    memset(&encl_pg0, 0, sizeof(encl_pg0));
     memset(&cfg_hdr, 0, sizeof(cfg_hdr));
     memset(&cfg_req, 0, sizeof(cfg_req));
     memset(&smp_rr, 0, sizeof(smp_rr));
 
     cfg_req.function = MPI3_FUNCTION_CONFIG;
     cfg_req.action = MPI3_CONFIG_ACTION_PAGE_HEADER;
-    cfg_req.page_type = MPI3_CONFIG_PAGETYPE_ENCLOSURE;
-    cfg_req.page_number = 0;
+    cfg_req.page_type = page_type;
+    cfg_req.page_number = page_number;
     cfg_req.page_address = form;   // 0xffff ?a hacked value (not to config???)
     cfg_req.page_length = 0;    // page length == 0 to get page header??
 
@@ -609,7 +669,7 @@ static int cfg_get_enclosure_pg0(smp_target_obj * top, struct mpi3_enclosure_pag
 
     int res = send_req_mpi3mr_bsg(top->fd, top->subvalue, top->sas_addr64, &smp_rr, vb);
     if (res) {
-        qDebug("[send_req_mpi3mr_bsg] Enclosure page0 header read failed, res=%d", res);
+        qDebug("[send_req_mpi3mr_bsg] page 0x%02x/%d header read failed, res=%d", page_type, page_number, res);
         return -1;
     }
     if (smp_rr.transport_err) {
@@ -621,20 +681,57 @@ static int cfg_get_enclosure_pg0(smp_target_obj * top, struct mpi3_enclosure_pag
         return -1;
     }
 
+    hdrs.insert(key, cfg_hdr);
+    return 0;
+}
+
+/* A page read failed: its header may be stale, it is read again the next time */
+static void cfg_drop_page_header(smp_target_obj * top, u8 page_type, u8 page_number)
+{
+    cfg_hdr_cache[top->subvalue].hdrs.remove((page_type << 8) | page_number);
+}
+
+/**
+ *  @form: The form to be used for addressing the page
+ *
+ *  Return: 0 on success, non-zero on failure.
+ */
+static int cfg_get_enclosure_pg0(smp_target_obj * top, struct mpi3_enclosure_page0 & encl_pg0, u32 form, int vb)
+{
+    struct mpi3_config_page_header cfg_hdr;
+    struct mpi3_config_request cfg_req;
+    smp_req_resp smp_rr;
+
+    memset(&encl_pg0, 0, sizeof(encl_pg0));
+    memset(&cfg_req, 0, sizeof(cfg_req));
+    memset(&smp_rr, 0, sizeof(smp_rr));
+
+    if (cfg_get_page_header(top, MPI3_CONFIG_PAGETYPE_ENCLOSURE, 0, cfg_hdr, form, vb)) {
+        return -1;
+    }
+
+    cfg_req.function = MPI3_FUNCTION_CONFIG;
     cfg_req.action = MPI3_CONFIG_ACTION_READ_CURRENT;
+    cfg_req.page_type = MPI3_CONFIG_PAGETYPE_ENCLOSURE;
+    cfg_req.page_number = 0;
+    cfg_req.page_version = cfg_hdr.page_version;
+    cfg_req.page_address = form;   // 0xffff ?a hacked value (not to config???)
     cfg_req.page_length = sizeof(encl_pg0);
 
+    smp_rr.mpi3mr_function = MPI3_FUNCTION_CONFIG;
     smp_rr.mpi3mr_object = (void*) &cfg_req;
     smp_rr.max_response_l = sizeof(encl_pg0);
     smp_rr.response = (u8*) &encl_pg0;
 
-    res = send_req_mpi3mr_bsg(top->fd, top->subvalue, top->sas_addr64, &smp_rr, vb);
+    int res = send_req_mpi3mr_bsg(top->fd, top->subvalue, top->sas_addr64, &smp_rr, vb);
     if (res) {
         qDebug("[send_req_mpi3mr_bsg] Enclosure page0 read failed, res=%d", res);
+        cfg_drop_page_header(top, MPI3_CONFIG_PAGETYPE_ENCLOSURE, 0);
         return -1;
     }
     if (smp_rr.transport_err) {
         qDebug("[send_req_mpi3mr_bsg] transport_error=%d", smp_rr.transport_err);
+        cfg_drop_page_header(top, MPI3_CONFIG_PAGETYPE_ENCLOSURE, 0);
         return -1;
     }
     if (smp_rr.act_response_l != sizeof(encl_pg0)) {
@@ -665,50 +762,35 @@ static int cfg_get_sas_exp_pg0(smp_target_obj * top, struct mpi3_sas_expander_pa
     smp_req_resp smp_rr;
 
     memset(&exp_pg0, 0, sizeof(exp_pg0));
-    memset(&cfg_hdr, 0, sizeof(cfg_hdr));
     memset(&cfg_req, 0, sizeof(cfg_req));
     memset(&smp_rr, 0, sizeof(smp_rr));
 
-    cfg_req.function = MPI3_FUNCTION_CONFIG;
-    cfg_req.action = MPI3_CONFIG_ACTION_PAGE_HEADER;
-    cfg_req.page_type = MPI3_CONFIG_PAGETYPE_SAS_EXPANDER;
-    cfg_req.page_number = 0;
-    cfg_req.page_address = form;   // 0xffff ?a hacked value (not to config???)
-    cfg_req.page_length = 0;    // page length == 0 to get page header??
-
-    smp_rr.mpi3mr_function = MPI3_FUNCTION_CONFIG;
-    smp_rr.mpi3mr_object = (void*) &cfg_req;
-    smp_rr.max_response_l = sizeof(cfg_hdr);
-    smp_rr.response = (u8*) &cfg_hdr;
-
-    int res = send_req_mpi3mr_bsg(top->fd, top->subvalue, top->sas_addr64, &smp_rr, vb);
-    if (res) {
-        qDebug("[send_req_mpi3mr_bsg] SAS Expander page0 header read failed, res=%d", res);
-        return -1;
-    }
-    if (smp_rr.transport_err) {
-        qDebug("[send_req_mpi3mr_bsg] transport_error=%d", smp_rr.transport_err);
-        return -1;
-    }
-    if (smp_rr.act_response_l != sizeof(cfg_hdr)) {
-        qDebug("[send_req_mpi3mr_bsg] cfg_hdr data length mismatch");
+    if (cfg_get_page_header(top, MPI3_CONFIG_PAGETYPE_SAS_EXPANDER, 0, cfg_hdr, form, vb)) {
         return -1;
     }
 
+    cfg_req.function = MPI3_FUNCTION_CONFIG;
     cfg_req.action = MPI3_CONFIG_ACTION_READ_CURRENT;
+    cfg_req.page_type = MPI3_CONFIG_PAGETYPE_SAS_EXPANDER;
+    cfg_req.page_number = 0;
+    cfg_req.page_version = cfg_hdr.page_version;
+    cfg_req.page_address = form;   // 0xffff ?a hacked value (not to config???)
     cfg_req.page_length = sizeof(exp_pg0);
 
+    smp_rr.mpi3mr_function = MPI3_FUNCTION_CONFIG;
     smp_rr.mpi3mr_object = (void*) &cfg_req;
     smp_rr.max_response_l = sizeof(exp_pg0);
     smp_rr.response = (u8*) &exp_pg0;
 
-    res = send_req_mpi3mr_bsg(top->fd, top->subvalue, top->sas_addr64, &smp_rr, vb);
+    int res = send_req_mpi3mr_bsg(top->fd, top->subvalue, top->sas_addr64, &smp_rr, vb);
     if (res) {
         qDebug("[send_req_mpi3mr_bsg] SAS Expander page0 read failed, res=%d", res);
+        cfg_drop_page_header(top, MPI3_CONFIG_PAGETYPE_SAS_EXPANDER, 0);
         return -1;
     }
     if (smp_rr.transport_err) {
         qDebug("[send_req_mpi3mr_bsg] transport_error=%d", smp_rr.transport_err);
+        cfg_drop_page_header(top, MPI3_CONFIG_PAGETYPE_SAS_EXPANDER, 0);
         return -1;
     }
     if (smp_rr.act_response_l != sizeof(exp_pg0)) {
@@ -869,7 +951,6 @@ void mpi3mr_iocfacts(int vb)
     memset(adpinfo, 0, sizeof(adpinfo));
     memset(ioc_facts, 0, sizeof(ioc_facts));
     memset(hba_sas_exp, 0, sizeof(hba_sas_exp));
-    memset(alltgt_info, 0, sizeof(alltgt_info));
 
     num = scandir(dev_bsg, &namelist, mpi3mrdev_scan_select, alphasort);
     if (num <= 0) {  /* HBA mid level may not be loaded */
@@ -897,20 +978,15 @@ void mpi3mr_iocfacts(int vb)
             continue;
         }
 
-        res = populate_adpinfo(&tobj, vb);
-        if (res < 0) {
-            qDebug("Exit status %d indicates error detected", res);
-        }
-#if 0  /// remark due to being unused
-        res = get_all_tgt_info(&tobj, vb);
+        res = populate_adpinfo(&tobj, adpinfo[ioc_cnt], vb);
         if (res < 0) {
             qDebug("Exit status %d indicates error detected", res);
         }
-#endif
         res = issue_iocfacts(&tobj, vb);
         if (res < 0) {
             qDebug("Exit status %d indicates error detected", res);
         }
+        cfg_hdr_validate(tobj.subvalue, adpinfo[ioc_cnt], ioc_facts[ioc_cnt], vb);
         /**
          * By hacking, 'form' value gets started with a value 0xffff
          */
@@ -998,6 +1074,143 @@ void mpi3mr_iocfacts(int vb)
     free(namelist);
 }
 
+/* The SCSI host of an IOC: the one under its PCI function, -1 if not found */
+static int ioc_host_no(const struct mpi3mr_bsg_in_adpinfo & info)
+{
+    QString pci = QString::asprintf("/%04x:%02x:%02x.%x/host", info.pci_seg_id, info.pci_bus, info.pci_dev, info.pci_func);
+    const QStringList hosts = QDir("/sys/class/scsi_host").entryList(QStringList() << "host*", QDir::Dirs | QDir::System);
+    for (const QString & host : hosts) {
+        if (QFileInfo("/sys/class/scsi_host/" + host).canonicalFilePath().contains(pci)) {
+            return host.mid(4).toInt();
+        }
+    }
+    return -1;
+}
+
+/* The "h:c:t" of every SES device with the index of its expander taken from the enclosure id */
+static QHash<QString, int> enclosure_targets()
+{
+    QHash<QString, int> seps;
+    const QStringList names = QDir("/sys/class/enclosure").entryList(QDir::Dirs | QDir::NoDotAndDotDot);
+    for (const QString & name : names) {
+        QString dir = "/sys/class/enclosure/" + name;
+        QString id, hctl = QFileInfo(QFileInfo(dir + "/device").canonicalFilePath()).fileName();
+        if (get_myValue(dir, "id", id) && hctl.count(':') == 3) {
+            seps.insert(hctl.section(':', 0, 2), WWID_TO_INDEX(id.trimmed().toULongLong(nullptr, 16)));
+        }
+    }
+    return seps;
+}
+
+/*
+ * "h:c:t" to slot index of the HBA9600 devices, from one ALLTGTDEVINFO per
+ * IOC. The slot is the target distance to the SES device of the expander,
+ * as list_sdevices() places the devices walking sysfs: the devices between
+ * two SES devices in target order belong to the latter.
+ *
+ * Return: the number of devices mapped.
+ */
+int mpi3mr_target_map(QHash<QString, int> & map, int vb)
+{
+    int num;
+    struct dirent ** namelist;
+    smp_target_obj tobj;
+
+    map.clear();
+    num = scandir(dev_bsg, &namelist, mpi3mrdev_scan_select, alphasort);
+    if (num <= 0) {
+        return 0;
+    }
+
+    const QHash<QString, int> seps = enclosure_targets();
+    for (int k = 0; k < num; ++k) {
+        QString device_name = QString("%1/%2").arg(dev_bsg, namelist[k]->d_name);
+        if (smp_initiator_open(device_name, I_SGV4_MPI, &tobj, vb) < 0) {
+            continue;
+        }
+
+        struct mpi3mr_bsg_in_adpinfo info;
+        QVector<struct mpi3mr_device_map_info> devmap;
+        int host = -1;
+        if (0 == populate_adpinfo(&tobj, info, vb) && get_all_tgt_info(&tobj, devmap, vb) > 0) {
+            host = ioc_host_no(info);
+        }
+        smp_initiator_close(&tobj);
+        if (host < 0) {
+            continue;
+        }
+
+        // the devices not exposed to the SCSI midlayer are out
+        devmap.erase(std::remove_if(devmap.begin(), devmap.end(),
+                [](const struct mpi3mr_device_map_info & d) { return 0xff == d.bus_id; }), devmap.end());
+        std::sort(devmap.begin(), devmap.end(),
+                [](const struct mpi3mr_device_map_info & a, const struct mpi3mr_device_map_info & b) {
+                    return (a.bus_id != b.bus_id) ? a.bus_id < b.bus_id : a.target_id < b.target_id;
+                });
+
+        for (int i = 0, prev = 0; i < devmap.size(); ++i) {
+            QString key = QString("%1:%2:%3").arg(host).arg(devmap[i].bus_id).arg(devmap[i].target_id);
+            auto sep = seps.constFind(key);
+            if (sep == seps.cend()) {
+                continue;
+            }
+            for (; prev < i; ++prev) {
+                const struct mpi3mr_device_map_info & d = devmap[prev];
+                int dist = devmap[i].target_id - d.target_id;
+                if (d.bus_id != devmap[i].bus_id || dist <= 0 || dist > NSLOT_PEREXP) {
+                    continue;
+                }
+                map.insert(QString("%1:%2:%3").arg(host).arg(d.bus_id).arg(d.target_id), (sep.value() + 1) * NSLOT_PEREXP - dist);
+                if (vb > 1) {
+                    qDebug("handle 0x%04x, persistent id %u, %d:%u:%u in slot %d", d.handle, d.perst_id,
+                           host, d.bus_id, d.target_id, (sep.value() + 1) * NSLOT_PEREXP - dist + 1);
+                }
+            }
+            prev = i + 1;
+        }
+    }
+
+    for (int k = 0; k < num; ++k) {
+        free(namelist[k]);
+    }
+    free(namelist);
+    return map.size();
+}
+
+/**
+ * IO throttling, the tightest of all the IOCs: IOs of data_kb or more are
+ * accounted in throttle groups, and diverted when the group outstanding
+ * exceeds high_mb. The throttle data length is in 4 KiB units and the
+ * watermarks in MiB; an IOC without throttle groups does not throttle.
+ *
+ * Return: the smallest maximum outstanding requests of the IOCs, 0 if no IOC is found.
+ */
+int get_iocthrottle(int & data_kb, int & high_mb, int & groups)
+{
+    int max_reqs = 0;
+
+    data_kb = high_mb = groups = 0;
+    for (int i = 0; i < ioc_cnt; i++) {
+        if (ioc_facts[i].max_reqs > 0 && (0 == max_reqs || ioc_facts[i].max_reqs < max_reqs)) {
+            max_reqs = ioc_facts[i].max_reqs;
+        }
+        if (0 == ioc_facts[i].max_io_throttle_group) {
+            continue;
+        }
+        int kb = ioc_facts[i].io_throttle_data_length * 4;
+        if (kb > 0 && (0 == data_kb || kb < data_kb)) {
+            data_kb = kb;
+        }
+        if (ioc_facts[i].io_throttle_high > 0 && (0 == high_mb || ioc_facts[i].io_throttle_high < high_mb)) {
+            high_mb = ioc_facts[i].io_throttle_high;
+        }
+        if (0 == groups || ioc_facts[i].max_io_throttle_group < groups) {
+            groups = ioc_facts[i].max_io_throttle_group;
+        }
+    }
+    return max_reqs;
+}
+
 QString get_infofacts()
 {
     QString s;
@@ -1015,6 +1228,9 @@ QString get_infofacts()
                 p_card, adpinfo[i].pci_seg_id, adpinfo[i].pci_bus, adpinfo[i].pci_dev, adpinfo[i].pci_func,
                 fwver->gen_major, fwver->gen_minor, fwver->ph_major, fwver->ph_minor, fwver->cust_id, fwver->build_num,
                 mpiver->major, mpiver->minor);
+        s += QString::asprintf("Max Requests: %d, IO Throttle: data length %d KB, groups %d, low/high %d/%d MB\n",
+                ioc_facts[i].max_reqs, ioc_facts[i].io_throttle_data_length * 4, ioc_facts[i].max_io_throttle_group,
+                ioc_facts[i].io_throttle_low, ioc_facts[i].io_throttle_high);
 
         for (int e = 0; e < NUM_EXP_PER_HBA; e += 2) {
             if (0 != hba_sas_exp[i][e].sas_address) {
@@ -1,12 +1,16 @@
 #ifndef MPI3MR_APP_H
 #define MPI3MR_APP_H
 
+#include <QHash>
+
 #include "smp_lib.h"
 
 int send_req_mpi3mr_bsg(int fd, int subvalue, int64_t target_sa, smp_req_resp * rresp, int verbose);
 void mpi3mr_discover(int verbose);
 void mpi3mr_slot_discover(int verbose);
 void mpi3mr_iocfacts(int verbose);
+int mpi3mr_target_map(QHash<QString, int> & map, int verbose);
+int get_iocthrottle(int & data_kb, int & high_mb, int & groups);
 QString get_infofacts();
 
 #endif // MPI3MR_APP_H
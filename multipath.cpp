@@ -0,0 +1,185 @@
+#include <QDir>
+#include <QFile>
+#include <algorithm>
+
+#include "widget.h"
+#include "multipath.h"
+
+#define ONE_SIDED   0.90    // a path carrying more than this share leaves the other idle
+
+static QVector<_ST_MPATH> groups;
+
+static QString
+read_line(const QString & path)
+{
+    QFile file(path);
+    if (false == file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        return QString();
+    }
+    return QString(file.readLine()).trimmed();
+}
+
+static int
+slot_of_block(const QString & block)
+{
+    for (int i = 0; i < NSLOT; i++) {
+        if (false == gDevices.slotVacant(i) && gDevices.block(i) == block) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/* The dm-multipath device holding the block device, "dm-N", or empty */
+static QString
+dm_holder(const QString & block)
+{
+    const QStringList holders = QDir("/sys/block/" + block + "/holders").entryList(QStringList("dm-*"), QDir::Dirs | QDir::NoDotAndDotDot);
+    for (const QString & dm : holders) {
+        if (read_line("/sys/block/" + dm + "/dm/uuid").startsWith("mpath-")) {
+            return dm;
+        }
+    }
+    return QString();
+}
+
+/*
+ * Group the occupied slots by the WWID of their logical unit: the two ports
+ * of a dual-ported drive come in through different expanders. A group under
+ * dm-multipath takes its paths from the slaves of the multipath device, so a
+ * path not placed in a slot is listed too. Returns the number of groups.
+ */
+int
+mpath_scan(int vb)
+{
+    QMap<QString, QVector<int>> by_wwid;
+
+    groups.clear();
+    for (int i = 0; i < NSLOT; i++) {
+        if (false == gDevices.slotVacant(i) && false == gDevices.wwid(i).isEmpty()) {
+            by_wwid[gDevices.wwid(i)].append(i);
+        }
+    }
+
+    for (auto it = by_wwid.cbegin(); it != by_wwid.cend(); ++it) {
+        _ST_MPATH mp;
+        mp.wwid = it.key();
+        for (int sl : it.value()) {
+            if (mp.dm.isEmpty()) {
+                mp.dm = dm_holder(gDevices.block(sl));
+            }
+        }
+        if (false == mp.dm.isEmpty()) {
+            mp.name = read_line("/sys/block/" + mp.dm + "/dm/name");
+            mp.blocks = QDir("/sys/block/" + mp.dm + "/slaves").entryList(QDir::Dirs | QDir::NoDotAndDotDot);
+            for (const QString & block : mp.blocks) {
+                mp.slots.append(slot_of_block(block));
+            }
+        } else {
+            for (int sl : it.value()) {
+                mp.blocks.append(gDevices.block(sl));
+                mp.slots.append(sl);
+            }
+        }
+        if (mp.blocks.size() < 2) {
+            continue;
+        }
+        for (int i = 0; i < mp.blocks.size(); i++) {
+            if (mp.slots[i] >= 0) {
+                gDevices.setSlotMpath(mp.slots[i], QString::asprintf("path %d of %d", i + 1, (int)mp.blocks.size()) +
+                                      (mp.dm.isEmpty() ? ", no multipath device" : " of " + mp.name + " (" + mp.dm + ")"));
+            }
+        }
+        if (vb) {
+            qDebug() << mp.wwid << mp.dm << mp.name << mp.blocks;
+        }
+        groups.append(mp);
+    }
+    return groups.size();
+}
+
+const QVector<_ST_MPATH> &
+mpath_groups()
+{
+    return groups;
+}
+
+/* Sectors read and written so far on every path, keyed by block name */
+QMap<QString, quint64>
+mpath_sectors()
+{
+    QMap<QString, quint64> sectors;
+    for (const _ST_MPATH & mp : groups) {
+        for (const QString & block : mp.blocks) {
+            QStringList stat = read_line("/sys/block/" + block + "/stat").split(' ', Qt::SkipEmptyParts);
+            if (stat.size() > 6) {
+                sectors.insert(block, stat[2].toULongLong() + stat[6].toULongLong());
+            }
+        }
+    }
+    return sectors;
+}
+
+static QString
+path_name(const _ST_MPATH & mp, int i)
+{
+    int sl = mp.slots[i];
+    if (sl < 0) {
+        return mp.blocks[i] + " (not in a slot)";
+    }
+    return mp.blocks[i] + QString::asprintf(" (Expander-%d slot %d)", sl / NSLOT_PEREXP + 1, sl + 1);
+}
+
+/*
+ * The throughput of every path of the multipath devices from the sectors
+ * moved between the samples, the share of each path in its device, and the
+ * total per expander: a device whose I/O all went down one path is not
+ * balanced across the expanders.
+ */
+void
+mpath_balance_report(const QMap<QString, quint64> & before, const QMap<QString, quint64> & after,
+                     double seconds, QTextStream & csv)
+{
+    double exp_mbs[NEXPDR] = {0};
+    int one_sided = 0, measured = 0;
+
+    csv << "device,path,expander,slot,MBps,share" << Qt::endl;
+    for (const _ST_MPATH & mp : groups) {
+        if (mp.dm.isEmpty()) {
+            continue;
+        }
+        QVector<double> mbs;
+        double total = 0;
+        for (const QString & block : mp.blocks) {
+            double mb = (after.value(block) - before.value(block)) * 512.0 / 1000000 / qMax(seconds, 1.0);
+            mbs.append(mb);
+            total += mb;
+        }
+        if (0 == total) {
+            continue;
+        }
+        measured++;
+        double top = *std::max_element(mbs.cbegin(), mbs.cend()) / total;
+        one_sided += (top > ONE_SIDED);
+        gAppendMessage(QString::asprintf("  %s (%s): %.1f MB/s%s", mp.name.toStdString().c_str(), mp.dm.toStdString().c_str(),
+                                         total, (top > ONE_SIDED) ? ", one-sided" : ""));
+        for (int i = 0; i < mp.blocks.size(); i++) {
+            int sl = mp.slots[i];
+            if (sl >= 0) {
+                exp_mbs[sl / NSLOT_PEREXP] += mbs[i];
+            }
+            gAppendMessage(QString::asprintf("    %-40s %8.1f MB/s %5.1f%%", path_name(mp, i).toStdString().c_str(),
+                                             mbs[i], mbs[i] / total * 100));
+            csv << mp.name << "," << mp.blocks[i] << "," << ((sl < 0) ? 0 : sl / NSLOT_PEREXP + 1) << ","
+                << sl + 1 << "," << QString::number(mbs[i], 'f', 1) << "," << QString::number(mbs[i] / total, 'f', 3) << Qt::endl;
+        }
+    }
+
+    QString per_exp;
+    for (int k = 0; k < NEXPDR; ++k) {
+        if (exp_mbs[k] > 0) {
+            per_exp += QString::asprintf("  Expander-%d %.1f MB/s", k + 1, exp_mbs[k]);
+        }
+    }
+    gAppendMessage(QString::asprintf("Path balance: %d of %d multipath devices one-sided;", one_sided, measured) + per_exp);
+}
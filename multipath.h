@@ -0,0 +1,23 @@
+#ifndef MULTIPATH_H
+#define MULTIPATH_H
+
+#include <QMap>
+#include <QStringList>
+#include <QTextStream>
+#include <QVector>
+
+typedef struct ST_MPATH {
+    QString wwid;           // of the logical unit, the same through either port
+    QString dm;             // kernel name "dm-N" of the multipath device, empty if none
+    QString name;           // device-mapper name, e.g. "mpatha"
+    QStringList blocks;     // the paths, "sdX"
+    QVector<int> slots;     // slot of each path, -1 if the path is not in a slot
+} _ST_MPATH;
+
+int mpath_scan(int verbose);
+const QVector<_ST_MPATH> & mpath_groups();
+QMap<QString, quint64> mpath_sectors();
+void mpath_balance_report(const QMap<QString, quint64> & before, const QMap<QString, quint64> & after,
+                          double seconds, QTextStream & csv);
+
+#endif // MULTIPATH_H
@@ -0,0 +1,229 @@
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QMap>
+#include <QProcess>
+#include <QRegularExpression>
+#include <QSet>
+
+#include <sched.h>
+
+#include "widget.h"
+#include "numa_affinity.h"
+
+extern int verbose;
+
+static QMap<QString, _ST_HBANUMA> hba_numa;    // keyed by PCI address
+static int node_count = -1;
+static int mem_policy = -1;                     // fio supports numa_mem_policy
+
+static QString
+read_line(const QString & path)
+{
+    QFile file(path);
+    if (false == file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        return QString();
+    }
+    return QString(file.readLine()).trimmed();
+}
+
+/* CPU list format of sysfs and procfs: "0-15,32-47" */
+static QSet<int>
+parse_cpulist(const QString & list)
+{
+    QSet<int> cpus;
+    for (const QString & part : list.split(',', Qt::SkipEmptyParts)) {
+        QStringList range = part.split('-');
+        int lo = range[0].toInt();
+        int hi = (range.size() > 1) ? range[1].toInt() : lo;
+        for (int c = lo; c <= hi; c++) {
+            cpus.insert(c);
+        }
+    }
+    return cpus;
+}
+
+static int
+online_nodes()
+{
+    if (node_count < 0) {
+        node_count = parse_cpulist(read_line("/sys/devices/system/node/online")).size();
+    }
+    return node_count;
+}
+
+/* numa_mem_policy is only there when fio is built with libnuma */
+static bool
+fio_mem_policy()
+{
+    if (mem_policy < 0) {
+        QProcess fio;
+        fio.start("fio", QStringList() << "--cmdhelp=numa_mem_policy");
+        fio.waitForFinished(3000);
+        QString help = fio.readAllStandardOutput() + fio.readAllStandardError();
+        mem_policy = (0 == fio.exitCode() && help.contains("numa_mem_policy") && false == help.contains("unsupported")) ? 1 : 0;
+    }
+    return 0 != mem_policy;
+}
+
+/* The PCI function nearest to the SCSI host in the device path of the block device */
+static QString
+block_to_pci(const QString & block)
+{
+    static const QRegularExpression pci_re("^[0-9a-f]{4}:[0-9a-f]{2}:[0-9a-f]{2}\\.[0-7]$");
+    QString path = QFileInfo("/sys/block/" + block + "/device").canonicalFilePath();
+    QString pci;
+
+    for (const QString & part : path.split('/', Qt::SkipEmptyParts)) {
+        if (part.startsWith("host")) {
+            break;
+        }
+        if (pci_re.match(part).hasMatch()) {
+            pci = part;
+        }
+    }
+    return pci;
+}
+
+static void
+resolve_hba(_ST_HBANUMA & hba, int vb)
+{
+    QString dev = "/sys/bus/pci/devices/" + hba.pci;
+    QString node = read_line(dev + "/numa_node");
+
+    hba.node = node.isEmpty() ? -1 : node.toInt();
+    hba.cpulist = read_line(dev + "/local_cpulist");
+    hba.irqs = hba.irqs_remote = hba.irqs_cross = 0;
+    if (hba.node < 0) {
+        return;
+    }
+
+    QMap<int, int> cpu_node;
+    for (int n : parse_cpulist(read_line("/sys/devices/system/node/online"))) {
+        for (int c : parse_cpulist(read_line(QString("/sys/devices/system/node/node%1/cpulist").arg(n)))) {
+            cpu_node[c] = n;
+        }
+    }
+
+    const QStringList irqs = QDir(dev + "/msi_irqs").entryList(QDir::Files | QDir::NoDotAndDotDot);
+    for (const QString & irq : irqs) {
+        // effective affinity is where the interrupt is delivered, if the kernel tells
+        QString list = read_line("/proc/irq/" + irq + "/effective_affinity_list");
+        if (list.isEmpty()) {
+            list = read_line("/proc/irq/" + irq + "/smp_affinity_list");
+        }
+        QSet<int> nodes;
+        for (int c : parse_cpulist(list)) {
+            nodes.insert(cpu_node.value(c, -1));
+        }
+        hba.irqs++;
+        if (nodes.size() > 1) {
+            hba.irqs_cross++;
+        }
+        if (false == nodes.isEmpty() && false == nodes.contains(hba.node)) {
+            hba.irqs_remote++;
+        }
+    }
+    if (vb) {
+        qDebug("%s: %s node %d cpus %s, %d irqs", __func__, hba.pci.toStdString().c_str(), hba.node,
+               hba.cpulist.toStdString().c_str(), hba.irqs);
+    }
+    if (hba.irqs_cross > 0) {
+        gAppendMessage(QString::asprintf("Warning: HBA %s (node %d): %d of %d MSI-X IRQs have affinity across sockets",
+                                         hba.pci.toStdString().c_str(), hba.node, hba.irqs_cross, hba.irqs));
+    }
+}
+
+/* Forget the HBAs resolved, e.g. on a refresh */
+void
+numa_reset()
+{
+    hba_numa.clear();
+}
+
+/* Returns nullptr if the HBA of the slot can not be resolved */
+const _ST_HBANUMA *
+numa_slot_hba(int sl)
+{
+    if (gDevices.slotVacant(sl)) {
+        return nullptr;
+    }
+    QString pci = block_to_pci(gDevices.block(sl));
+    if (pci.isEmpty()) {
+        return nullptr;
+    }
+    if (false == hba_numa.contains(pci)) {
+        _ST_HBANUMA hba;
+        hba.pci = pci;
+        resolve_hba(hba, verbose);
+        hba_numa.insert(pci, hba);
+    }
+    return &hba_numa[pci];
+}
+
+/*
+ * fio options to run the job of a slot on the CPUs and memory local to its
+ * HBA. Nothing is placed on a single node host or when the node is unknown.
+ */
+QStringList
+numa_job_options(int sl)
+{
+    QStringList opts;
+    const _ST_HBANUMA * hba = numa_slot_hba(sl);
+
+    if (online_nodes() > 1 && nullptr != hba && hba->node >= 0 && false == hba->cpulist.isEmpty()) {
+        opts << "cpus_allowed=" + hba->cpulist
+             << "cpus_allowed_policy=shared";
+        if (fio_mem_policy()) {
+            opts << QString("numa_mem_policy=bind:%1").arg(hba->node);
+        }
+    }
+    return opts;
+}
+
+/*
+ * The CPUs to run a native job of the slot on, local to its HBA; empty on a
+ * single node host or when the node is unknown. Called in the GUI thread.
+ */
+QString
+numa_slot_cpus(int sl)
+{
+    const _ST_HBANUMA * hba = numa_slot_hba(sl);
+    if (online_nodes() <= 1 || nullptr == hba || hba->node < 0) {
+        return QString();
+    }
+    return hba->cpulist;
+}
+
+/* Pin the calling thread (a native job) to a CPU list from numa_slot_cpus() */
+bool
+numa_pin_thread(const QString & cpulist)
+{
+    if (cpulist.isEmpty()) {
+        return false;
+    }
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int c : parse_cpulist(cpulist)) {
+        CPU_SET(c, &set);
+    }
+    return 0 == sched_setaffinity(0, sizeof(set), &set);
+}
+
+/* One line per HBA resolved for the Info tab */
+QString
+numa_describe()
+{
+    QString s;
+    for (int i = 0; i < NSLOT; i++) {
+        numa_slot_hba(i);
+    }
+    for (const _ST_HBANUMA & hba : hba_numa) {
+        s += QString::asprintf("HBA %s: NUMA node %d, local CPUs %s, MSI-X %d (%d remote, %d across sockets)\n",
+                               hba.pci.toStdString().c_str(), hba.node, hba.cpulist.toStdString().c_str(),
+                               hba.irqs, hba.irqs_remote, hba.irqs_cross);
+    }
+    s.chop(1);
+    return s;
+}
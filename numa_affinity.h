@@ -0,0 +1,23 @@
+#ifndef NUMA_AFFINITY_H
+#define NUMA_AFFINITY_H
+
+#include <QString>
+#include <QStringList>
+
+typedef struct ST_HBANUMA {
+    QString pci;            // PCI address of the HBA, e.g. 0000:41:00.0
+    int node;               // NUMA node, -1 if the platform does not tell
+    QString cpulist;        // CPUs local to the HBA
+    int irqs;               // MSI-X vectors
+    int irqs_remote;        // vectors whose affinity has no CPU of the HBA's node
+    int irqs_cross;         // vectors whose affinity spans nodes
+} _ST_HBANUMA;
+
+void numa_reset();
+const _ST_HBANUMA * numa_slot_hba(int sl);
+QStringList numa_job_options(int sl);
+QString numa_slot_cpus(int sl);
+bool numa_pin_thread(const QString & cpulist);
+QString numa_describe();
+
+#endif // NUMA_AFFINITY_H
@@ -0,0 +1,262 @@
+#include <QColor>
+#include <QFile>
+#include <QMap>
+#include <QTextStream>
+
+#include "phy_events.h"
+
+#define SMP_FN_REPORT_PHY_EVENT_RESP_LEN    (16 + 12 * 16 + 4)
+#define PEAK_FIRST          4       // sources from here on are peak value detectors
+#define HEAT_COLUMNS        24      // the run is folded into this many columns at most
+
+/* Phy event sources (SAS-2 phy event source codes) */
+static const uint8_t event_src[PHY_EVENT_SOURCES] = { 0x05, 0x23, 0x24, 0x26, 0x2b, 0x2c };
+static const char * event_name[PHY_EVENT_SOURCES] = {
+    "elasticity buffer overflow",
+    "tx retry-class OPEN_REJECT",
+    "rx retry-class OPEN_REJECT",
+    "rx AIP (WAITING ON CONNECTION)",
+    "peak tx pathway blocked",
+    "peak tx arbitration wait"
+};
+
+static inline uint32_t
+get_be32(const uint8_t * p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+/* CONFIGURE PHY EVENT with the sources above, peaks cleared. Returns as smp_function() */
+static int
+configure_phy_event(smp_target_obj * top, int phy_id, int vb)
+{
+    uint8_t smp_req[12 + PHY_EVENT_SOURCES * 8 + 4] = {SMP_FRAME_TYPE_REQ, SMP_FN_CONFIG_PHY_EVENT};
+    uint8_t rp[8];
+
+    smp_req[3] = (sizeof(smp_req) - 8) / 4;     /* Request Length: in dwords */
+    smp_req[6] = 0x1;                           /* CLEAR PEAKS */
+    smp_req[9] = phy_id;
+    smp_req[10] = 2;                            /* Descriptor Length: 8 bytes, in dwords */
+    smp_req[11] = PHY_EVENT_SOURCES;
+    for (int i = 0; i < PHY_EVENT_SOURCES; i++) {
+        smp_req[12 + i * 8 + 3] = event_src[i]; /* peak value detector threshold left 0 */
+    }
+    return smp_function(top, smp_req, sizeof(smp_req), rp, sizeof(rp), vb);
+}
+
+/* REPORT PHY EVENT, values placed in the order of event_src. Returns as smp_function() */
+static int
+report_phy_event(smp_target_obj * top, int phy_id, uint32_t * value, int vb)
+{
+    uint8_t smp_req[] = {SMP_FRAME_TYPE_REQ, SMP_FN_REPORT_PHY_EVENT, 0, 2,
+                         0, 0, 0, 0,  0, 0, 0, 0,  0, 0, 0, 0};
+    uint8_t rp[SMP_FN_REPORT_PHY_EVENT_RESP_LEN];
+
+    smp_req[2] = qMin((int)(sizeof(rp) - 8) / 4, 0xff);    /* Allocated Response Len */
+    smp_req[9] = phy_id;
+    int len = smp_function(top, smp_req, sizeof(smp_req), rp, sizeof(rp), vb);
+    if (len < 16) {
+        return (len < 0) ? len : -1;
+    }
+    int dlen = rp[14] ? rp[14] * 4 : 12;
+    for (int d = 0; d < rp[15] && 16 + (d + 1) * dlen <= len; d++) {
+        const uint8_t * dp = rp + 16 + d * dlen;
+        for (int i = 0; i < PHY_EVENT_SOURCES; i++) {
+            if (dp[3] == event_src[i]) {
+                value[i] = get_be32(dp + 4);
+            }
+        }
+    }
+    return 0;
+}
+
+/*
+ * Open the expanders and program their phys here in the calling thread, then
+ * sample in the monitor thread. Returns false if no phy could be programmed.
+ */
+bool PhyEventMonitor::begin(int interval_ms, int vb)
+{
+    m_interval = interval_ms;
+    m_verbose = vb;
+    m_stop = false;
+    m_samples.clear();
+
+    int programmed = 0;
+    IntfEnum sel = (cardType == ENUM_CARDTYPE::HBA9500) ? I_SGV4 : I_SGV4_MPI;
+    for (int k = 0; k < NEXPDR; ++k) {
+        m_tobj[k].opened = 0;
+        m_phys[k] = 0;
+        if (gControllers.bsgPath(k).isEmpty() || smp_initiator_open(gControllers.bsgPath(k), sel, &m_tobj[k], vb) < 0) {
+            continue;
+        }
+        m_tobj[k].sas_addr64 = gControllers.wwid64(k);
+        m_phys[k] = qMax(smp_num_phys(&m_tobj[k], vb), 0);
+        for (int phy = 0; phy < m_phys[k]; ++phy) {
+            if (0 == configure_phy_event(&m_tobj[k], phy, vb)) {
+                programmed++;
+            }
+        }
+        m_count++;
+    }
+    if (0 == programmed) {
+        gAppendMessage("Phy events: no expander phy accepts CONFIGURE PHY EVENT");
+        end();
+        return false;
+    }
+
+    m_clock.start();
+    start();
+    return true;
+}
+
+void PhyEventMonitor::end()
+{
+    if (isRunning()) {
+        m_stop = true;
+        wait();
+        sample();   // the closing sample, after the workload
+    }
+    for (int k = 0; k < NEXPDR && m_count > 0; ++k) {
+        if (m_tobj[k].opened) {
+            smp_initiator_close(&m_tobj[k]);
+        }
+    }
+    m_count = 0;
+}
+
+void PhyEventMonitor::run()
+{
+    while (false == m_stop) {
+        sample();
+        for (int t = 0; t < m_interval && false == m_stop; t += 50) {
+            msleep(50);
+        }
+    }
+}
+
+void PhyEventMonitor::sample()
+{
+    qint64 ms = m_clock.elapsed();
+    QVector<_ST_PHYEVENTS> batch;
+
+    for (int k = 0; k < NEXPDR; ++k) {
+        if (0 == m_tobj[k].opened) {
+            continue;
+        }
+        for (int phy = 0; phy < m_phys[k]; ++phy) {
+            _ST_PHYEVENTS ev = { ms, k, phy, {0} };
+            if (0 == report_phy_event(&m_tobj[k], phy, ev.value, m_verbose)) {
+                batch.append(ev);
+            }
+        }
+    }
+    QMutexLocker locker(&m_mutex);
+    m_samples += batch;
+}
+
+/*
+ * The congestion of a phy over an interval: OPEN_REJECTs (retry), AIPs waiting
+ * on connection and elasticity buffer overflows counted, per second.
+ */
+static double
+congestion(const _ST_PHYEVENTS & a, const _ST_PHYEVENTS & b)
+{
+    double secs = qMax<qint64>(b.ms - a.ms, 1) / 1000.0;
+    uint32_t n = 0;
+    for (int i = 0; i < PEAK_FIRST; i++) {
+        n += b.value[i] - a.value[i];
+    }
+    return n / secs;
+}
+
+/* Peak arbitration wait time: microseconds, or milliseconds when bit 15 is set */
+static double
+arb_wait_us(uint32_t v)
+{
+    return (v & 0x8000) ? (v & 0x7fff) * 1000.0 : (v & 0x7fff);
+}
+
+/*
+ * Write every sample to csv, and show a heatmap of the phys that saw any
+ * congestion: one row per phy, columns over the time since the workload began.
+ */
+void PhyEventMonitor::report(const QString & csv)
+{
+    QMutexLocker locker(&m_mutex);
+    if (m_samples.isEmpty()) {
+        return;
+    }
+
+    QFile file(csv);
+    if (file.open(QIODevice::WriteOnly | QIODevice::Text)) {
+        QTextStream stream(&file);
+        stream << "ms,expander,phy";
+        for (int i = 0; i < PHY_EVENT_SOURCES; i++) {
+            stream << "," << event_name[i];
+        }
+        stream << Qt::endl;
+        for (const _ST_PHYEVENTS & ev : m_samples) {
+            stream << ev.ms << "," << ev.exp + 1 << "," << ev.phy;
+            for (int i = 0; i < PHY_EVENT_SOURCES; i++) {
+                stream << "," << ev.value[i];
+            }
+            stream << Qt::endl;
+        }
+        file.close();
+    }
+
+    // samples of each phy in time order
+    QMap<int, QVector<_ST_PHYEVENTS>> series;
+    for (const _ST_PHYEVENTS & ev : m_samples) {
+        series[(ev.exp << 8) | ev.phy].append(ev);
+    }
+    qint64 span = m_samples.last().ms;
+    int columns = qBound(1, (int) (span / qMax(m_interval, 1)), HEAT_COLUMNS);
+    double col_ms = qMax<double>(span, 1) / columns;
+
+    double top = 0;
+    QMap<int, QVector<double>> heat;
+    for (auto it = series.cbegin(); it != series.cend(); ++it) {
+        const QVector<_ST_PHYEVENTS> & s = it.value();
+        QVector<double> row(columns, 0);
+        bool busy = false;
+        for (int i = 1; i < s.size(); i++) {
+            int c = qMin(columns - 1, (int) (s[i].ms / col_ms));
+            row[c] = qMax(row[c], congestion(s[i - 1], s[i]));
+            busy |= row[c] > 0;
+            top = qMax(top, row[c]);
+        }
+        if (busy) {
+            heat.insert(it.key(), row);
+        }
+    }
+
+    gAppendMessage(QString::asprintf("Phy events: %d phys congested over %.0f s, samples in ", (int)heat.size(), span / 1000.0) + csv);
+    if (heat.isEmpty()) {
+        return;
+    }
+
+    QString html = "<table cellspacing=0 cellpadding=2><tr><td>phy \\ s</td>";
+    for (int c = 0; c < columns; c++) {
+        html += QString::asprintf("<td>%.0f</td>", c * col_ms / 1000);
+    }
+    html += "<td>peak arb wait</td></tr>";
+    for (auto it = heat.cbegin(); it != heat.cend(); ++it) {
+        int k = it.key() >> 8, phy = it.key() & 0xff;
+        QString name = QString::asprintf("Exp-%d phy %d", k + 1, phy);
+        for (int sl = k*NSLOT_PEREXP; sl < (k+1)*NSLOT_PEREXP; ++sl) {
+            if (gDevices.slotPhyId(sl) == phy && false == gDevices.slotVacant(sl)) {
+                name += " " + gDevices.block(sl);
+            }
+        }
+        html += "<tr><td>" + name + "</td>";
+        for (double v : it.value()) {
+            int level = (top > 0) ? (int) (v * 9 / top) : 0;
+            QString color = v > 0 ? QColor::fromHsv(120 - level * 13, 160, 255).name() : "#ffffff";
+            html += QString("<td bgcolor=\"%1\">%2</td>").arg(color).arg(v, 0, 'f', 0);
+        }
+        html += QString::asprintf("<td>%.0f us</td></tr>", arb_wait_us(series[it.key()].last().value[PEAK_FIRST + 1]));
+    }
+    html += "</table>";
+    gAppendMessage(html);
+}
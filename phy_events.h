@@ -0,0 +1,51 @@
+#ifndef PHY_EVENTS_H
+#define PHY_EVENTS_H
+
+#include <QElapsedTimer>
+#include <QMutex>
+#include <QThread>
+#include <QVector>
+#include <atomic>
+
+#include "widget.h"
+
+#define PHY_EVENT_SOURCES   6
+
+typedef struct ST_PHYEVENTS {
+    qint64 ms;                          // since the monitor began
+    int exp;
+    int phy;
+    uint32_t value[PHY_EVENT_SOURCES];  // counts, and peak values from PEAK_FIRST on
+} _ST_PHYEVENTS;
+
+/*
+ * Programs the phy event sources of every expander phy (CONFIGURE PHY EVENT)
+ * and reads them back (REPORT PHY EVENT) on an interval in a thread of its
+ * own while a workload runs, for a congestion heatmap over time.
+ */
+class PhyEventMonitor : public QThread
+{
+public:
+    PhyEventMonitor() : m_count(0), m_stop(false) {}
+    ~PhyEventMonitor() { end(); }
+
+    bool begin(int interval_ms, int verbose);
+    void end();
+    void report(const QString & csv);
+
+private:
+    void run() override;
+    void sample();
+
+    smp_target_obj m_tobj[NEXPDR];
+    int m_phys[NEXPDR];
+    int m_interval;
+    int m_verbose;
+    int m_count;
+    std::atomic<bool> m_stop;
+    QElapsedTimer m_clock;
+    QMutex m_mutex;
+    QVector<_ST_PHYEVENTS> m_samples;
+};
+
+#endif // PHY_EVENTS_H
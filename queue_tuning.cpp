@@ -0,0 +1,165 @@
+#include <QFile>
+
+#include "widget.h"
+#include "queue_tuning.h"
+
+#define QUEUE_NPARAM    6
+
+/* In the order written: the scheduler bounds nr_requests, so it goes first */
+static const char * QUEUE_ATTR[QUEUE_NPARAM] = {
+    "queue/scheduler", "queue/nr_requests", "queue/read_ahead_kb",
+    "queue/rq_affinity", "queue/max_sectors_kb", "device/queue_depth"
+};
+
+typedef struct ST_QUEUEPROFILE {
+    const char * name;
+    const char * value[QUEUE_NPARAM];   // nullptr to leave, "max" for max_hw_sectors_kb
+} _ST_QUEUEPROFILE;
+
+static const _ST_QUEUEPROFILE QUEUE_PROFILES[] = {
+    { "throughput",     { "none",        "256", "4096", "2", "max",     "64" } },
+    { "latency",        { "none",        "64",  "0",    "2", nullptr,   "32" } },
+    { "hdd-deadline",   { "mq-deadline", "256", "128",  "1", nullptr,   "32" } },
+};
+
+static QString
+read_attr(const QString & path)
+{
+    QFile file(path);
+    if (false == file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        return QString();
+    }
+    QString value = QString(file.readLine()).trimmed();
+    // the scheduler in use is the one in brackets: "mq-deadline kyber [none]"
+    int open = value.indexOf('['), close = value.indexOf(']');
+    return (open >= 0 && close > open) ? value.mid(open + 1, close - open - 1) : value;
+}
+
+static bool
+write_attr(const QString & path, const QString & value, int vb)
+{
+    QFile file(path);
+    bool ok = file.open(QIODevice::WriteOnly | QIODevice::Text) && file.write(value.toLatin1()) == value.size();
+    file.close();
+    if (false == ok && vb) {
+        qDebug() << "failed to write " << value << " to " << path;
+    }
+    return ok;
+}
+
+static const _ST_QUEUEPROFILE *
+find_profile(const QString & name)
+{
+    for (const _ST_QUEUEPROFILE & p : QUEUE_PROFILES) {
+        if (name == p.name) {
+            return &p;
+        }
+    }
+    return nullptr;
+}
+
+QStringList
+queue_profile_names()
+{
+    QStringList names;
+    for (const _ST_QUEUEPROFILE & p : QUEUE_PROFILES) {
+        names << p.name;
+    }
+    return names;
+}
+
+/* "scheduler=none nr_requests=256 ...", the settings a profile asks for */
+QString
+queue_profile_desc(const QString & profile)
+{
+    const _ST_QUEUEPROFILE * prof = find_profile(profile);
+    QStringList desc;
+    for (int a = 0; prof && a < QUEUE_NPARAM; ++a) {
+        if (prof->value[a]) {
+            desc << QString(QUEUE_ATTR[a]).section('/', 1) + "=" + prof->value[a];
+        }
+    }
+    return desc.join(' ');
+}
+
+/*
+ * Write a profile to the block queue and SCSI device attributes of the
+ * slots, the values there before kept in snapshot for the restore. The
+ * settings read back per slot go to effect, "name=value" with the writes
+ * refused marked, to record what the runs really had. Returns the number of
+ * attributes which failed to be written.
+ */
+int
+queue_tuning_apply(const QVector<int> & slots, const QString & profile, QVector<_ST_QUEUEPARAM> & snapshot,
+                   QMap<int, QString> & effect, int vb)
+{
+    const _ST_QUEUEPROFILE * prof = find_profile(profile);
+    int failed = 0;
+
+    snapshot.clear();
+    effect.clear();
+    if (nullptr == prof) {
+        return 0;
+    }
+    for (int sl : slots) {
+        // every value read before any is written, a new scheduler resets nr_requests
+        QString dir = "/sys/block/" + gDevices.block(sl) + "/";
+        int first = snapshot.size();
+        bool resched = false;
+        QStringList want;
+        for (int a = 0; a < QUEUE_NPARAM; ++a) {
+            if (nullptr == prof->value[a]) {
+                continue;
+            }
+            QString path = dir + QUEUE_ATTR[a];
+            QString value = prof->value[a];
+            if ("max" == value) {
+                value = read_attr(dir + "queue/max_hw_sectors_kb");
+            }
+            QString was = read_attr(path);
+            if (was.isEmpty() || value.isEmpty() || (was == value && false == resched)) {
+                continue;
+            }
+            snapshot.append({ sl, path, was });
+            want << value;
+            resched |= (0 == a);
+        }
+        QStringList refused;
+        for (int i = first; i < snapshot.size(); ++i) {
+            if (false == write_attr(snapshot[i].path, want[i - first], vb)) {
+                refused << snapshot[i].path;
+                failed++;
+            }
+        }
+
+        QStringList desc;
+        for (int a = 0; a < QUEUE_NPARAM; ++a) {
+            QString now = read_attr(dir + QUEUE_ATTR[a]);
+            if (nullptr == prof->value[a] || now.isEmpty()) {
+                continue;
+            }
+            desc << QString(QUEUE_ATTR[a]).section('/', 1) + "=" + now + (refused.contains(dir + QUEUE_ATTR[a]) ? " (refused)" : "");
+        }
+        effect.insert(sl, desc.join(' '));
+    }
+    if (failed) {
+        gAppendMessage(QString::asprintf("Queue profile %s: %d settings refused, see the debug output", prof->name, failed));
+    }
+    return failed;
+}
+
+/* Back to the values of the snapshot, the scheduler of a slot again before the rest */
+int
+queue_tuning_restore(const QVector<_ST_QUEUEPARAM> & snapshot, int vb)
+{
+    int failed = 0;
+    for (int i = 0; i < snapshot.size(); ++i) {
+        if (false == write_attr(snapshot[i].path, snapshot[i].value, vb)) {
+            failed++;
+        }
+    }
+    if (failed) {
+        gAppendMessage(QString::asprintf("Queue settings: %d of %d failed to restore", failed, (int)snapshot.size()));
+    }
+    return failed;
+}
@@ -0,0 +1,22 @@
+#ifndef QUEUE_TUNING_H
+#define QUEUE_TUNING_H
+
+#include <QMap>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+/* A sysfs attribute of a slot as it was before a profile was applied */
+typedef struct ST_QUEUEPARAM {
+    int slot;
+    QString path;
+    QString value;
+} _ST_QUEUEPARAM;
+
+QStringList queue_profile_names();
+QString queue_profile_desc(const QString & profile);
+int queue_tuning_apply(const QVector<int> & slots, const QString & profile, QVector<_ST_QUEUEPARAM> & snapshot,
+                       QMap<int, QString> & effect, int verbose);
+int queue_tuning_restore(const QVector<_ST_QUEUEPARAM> & snapshot, int verbose);
+
+#endif // QUEUE_TUNING_H
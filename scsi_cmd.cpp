@@ -0,0 +1,221 @@
+#include <QCoreApplication>
+#include <QDebug>
+#include <QDir>
+#include <QThread>
+#include <atomic>
+
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <scsi/sg.h>
+#include <sys/ioctl.h>
+
+#include "widget.h"
+#include "scsi_cmd.h"
+#include "numa_affinity.h"
+
+#define SAM_STAT_GOOD               0x00
+#define SAM_STAT_CHECK_CONDITION    0x02
+#define SERVICE_ACTION_IN_16        0x9e
+#define SAI_READ_CAPACITY_16        0x10
+
+/* An sg or block device for SG_IO. Returns the file descriptor, or -1 */
+int
+scsi_open(const QString & device, bool rw)
+{
+    int fd = open(device.toStdString().c_str(), (rw ? O_RDWR : O_RDONLY) | O_NONBLOCK);
+    if (fd < 0) {
+        qDebug() << "failed to open " << device;
+    }
+    return fd;
+}
+
+/*
+ * Send a SCSI command through SG_IO. sense (SCSI_SENSE_LEN) may be nullptr.
+ * Returns the number of bytes transferred, -1 if the ioctl failed, -2 on
+ * CHECK CONDITION, -3 on any other status or transport error.
+ */
+int
+scsi_cmd(int fd, const uint8_t * cdb, int cdb_len, int dir, uint8_t * buf, int len,
+         uint8_t * sense, int timeout_ms, int vb)
+{
+    sg_io_hdr_t hdr;
+    uint8_t sb[SCSI_SENSE_LEN];
+
+    memset(&hdr, 0, sizeof(hdr));
+    memset(sb, 0, sizeof(sb));
+    hdr.interface_id = 'S';
+    hdr.cmdp = (unsigned char *) cdb;
+    hdr.cmd_len = cdb_len;
+    hdr.dxfer_direction = (SCSI_READ == dir) ? SG_DXFER_FROM_DEV : (SCSI_WRITE == dir) ? SG_DXFER_TO_DEV : SG_DXFER_NONE;
+    hdr.dxferp = buf;
+    hdr.dxfer_len = (SCSI_NONE == dir) ? 0 : len;
+    hdr.sbp = sb;
+    hdr.mx_sb_len = sizeof(sb);
+    hdr.timeout = timeout_ms;
+
+    if (ioctl(fd, SG_IO, &hdr) < 0) {
+        if (vb) {
+            perror("scsi_cmd: SG_IO ioctl");
+        }
+        return -1;
+    }
+    if (sense) {
+        memcpy(sense, sb, sizeof(sb));
+    }
+    if (SAM_STAT_CHECK_CONDITION == hdr.status) {
+        if (vb) {
+            qDebug("scsi_cmd: opcode 0x%02x check condition, sense key 0x%x asc 0x%02x ascq 0x%02x",
+                   cdb[0], scsi_sense_key(sb), (sb[0] & 0x7f) >= 0x72 ? sb[2] : sb[12], (sb[0] & 0x7f) >= 0x72 ? sb[3] : sb[13]);
+        }
+        return -2;
+    }
+    if (SAM_STAT_GOOD != hdr.status || hdr.host_status || (hdr.driver_status & 0xf)) {
+        if (vb) {
+            qDebug("scsi_cmd: opcode 0x%02x status 0x%x host 0x%x driver 0x%x",
+                   cdb[0], hdr.status, hdr.host_status, hdr.driver_status);
+        }
+        return -3;
+    }
+    return (SCSI_NONE == dir) ? 0 : len - hdr.resid;
+}
+
+/* Sense key of fixed (70h/71h) or descriptor (72h/73h) format sense data */
+int
+scsi_sense_key(const uint8_t * sense)
+{
+    return (((sense[0] & 0x7f) >= 0x72) ? sense[1] : sense[2]) & 0xf;
+}
+
+/*
+ * The INFORMATION field of the sense data, which is the first LBA in error
+ * for a medium error. Returns false if the field is not valid.
+ */
+bool
+scsi_sense_info(const uint8_t * sense, uint64_t & info)
+{
+    if ((sense[0] & 0x7f) >= 0x72) {
+        // descriptor format: look for the information descriptor
+        for (int pos = 8; pos + 12 <= 8 + sense[7] && pos + 12 <= SCSI_SENSE_LEN; pos += 2 + sense[pos + 1]) {
+            if (0 == sense[pos] && (sense[pos + 2] & 0x80)) {
+                info = 0;
+                for (int i = 4; i < 12; ++i) {
+                    info = (info << 8) | sense[pos + i];
+                }
+                return true;
+            }
+        }
+        return false;
+    }
+    if (0 == (sense[0] & 0x80)) {
+        return false;
+    }
+    info = ((uint32_t)sense[3] << 24) | (sense[4] << 16) | (sense[5] << 8) | sense[6];
+    return true;
+}
+
+/* READ CAPACITY(16): the number of logical blocks and their length. Returns scsi_cmd() */
+int
+scsi_read_capacity16(int fd, uint64_t & blocks, uint32_t & block_len, int vb)
+{
+    uint8_t cdb[16] = {SERVICE_ACTION_IN_16, SAI_READ_CAPACITY_16, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 32, 0, 0};
+    uint8_t buf[32];
+
+    int len = scsi_cmd(fd, cdb, sizeof(cdb), SCSI_READ, buf, sizeof(buf), nullptr, SCSI_TIMEOUT_MS, vb);
+    if (len >= 12) {
+        blocks = 1;
+        for (int i = 0; i < 8; ++i) {
+            blocks += (uint64_t)buf[i] << (56 - 8 * i);
+        }
+        block_len = ((uint32_t)buf[8] << 24) | (buf[9] << 16) | (buf[10] << 8) | buf[11];
+    } else if (len >= 0) {
+        len = -3;
+    }
+    return len;
+}
+
+/* The sg node of a block device, "/dev/sgN", or the block device itself if it has none */
+QString
+scsi_sg_node(const QString & block)
+{
+    QStringList sg = QDir("/sys/block/" + block + "/device/scsi_generic").entryList(QDir::Dirs | QDir::NoDotAndDotDot);
+    return "/dev/" + (sg.isEmpty() ? block : sg[0]);
+}
+
+/*
+ * The sg node and local CPUs of the occupied slots, taken from gDevices in
+ * the GUI thread so the workers run on a copy the GUI can not change
+ */
+QVector<_ST_SCSISLOT>
+scsi_slot_targets(const QVector<int> & slots)
+{
+    QVector<_ST_SCSISLOT> targets;
+    for (int sl : slots) {
+        if ((unsigned)sl < NSLOT && false == gDevices.slotVacant(sl)) {
+            _ST_SCSISLOT t;
+            t.slot = sl;
+            t.node = scsi_sg_node(gDevices.block(sl));
+            t.cpus = numa_slot_cpus(sl);
+            targets.append(t);
+        }
+    }
+    return targets;
+}
+
+/*
+ * Run fn(slot, fd) on every target, the sg node opened read-write, with up to
+ * per_expander slots of an expander at a time; the expanders run in parallel.
+ * fn runs in worker threads, pinned to the CPUs of the target, and must not
+ * touch the GUI or gDevices. Returns the number of slots run.
+ */
+int
+scsi_for_each_slot(const QVector<_ST_SCSISLOT> & targets, int per_expander, const std::function<void(int, int)> & fn, int vb)
+{
+    QVector<_ST_SCSISLOT> queue[NEXPDR];
+    std::atomic<int> next[NEXPDR];
+    std::atomic<int> count(0);
+    QVector<QThread *> workers;
+
+    for (const _ST_SCSISLOT & t : targets) {
+        if ((unsigned)t.slot < NSLOT) {
+            queue[t.slot / NSLOT_PEREXP].append(t);
+        }
+    }
+    for (int k = 0; k < NEXPDR; ++k) {
+        next[k] = 0;
+        for (int w = 0; w < qMin(per_expander, (int)queue[k].size()); ++w) {
+            workers.append(QThread::create([&, k]() {
+                for (int i = next[k]++; i < queue[k].size(); i = next[k]++) {
+                    const _ST_SCSISLOT & t = queue[k].at(i);
+                    numa_pin_thread(t.cpus);
+                    int fd = scsi_open(t.node, true);
+                    if (fd >= 0) {
+                        fn(t.slot, fd);
+                        close(fd);
+                        count++;
+                    }
+                }
+            }));
+            workers.last()->start();
+        }
+    }
+    if (vb) {
+        qDebug("%s: %d slots on %d workers", __func__, (int)targets.size(), (int)workers.size());
+    }
+
+    // keep the GUI alive while the drives are worked on
+    for (QThread * worker : workers) {
+        while (false == worker->wait(10)) {
+            QCoreApplication::processEvents();
+        }
+        delete worker;
+    }
+    return count;
+}
+
+/* scsi_for_each_slot() on the occupied slots of the list, from the GUI thread */
+int
+scsi_for_each_slot(const QVector<int> & slots, int per_expander, const std::function<void(int, int)> & fn, int vb)
+{
+    return scsi_for_each_slot(scsi_slot_targets(slots), per_expander, fn, vb);
+}
@@ -0,0 +1,39 @@
+#ifndef SCSI_CMD_H
+#define SCSI_CMD_H
+
+#include <QString>
+#include <QVector>
+#include <functional>
+#include <stdint.h>
+
+#define SCSI_TIMEOUT_MS     20000
+#define SCSI_SENSE_LEN      32
+
+#define SENSE_KEY_NOT_READY         0x2
+#define SENSE_KEY_MEDIUM_ERROR      0x3
+
+typedef enum {
+    SCSI_NONE = 0,
+    SCSI_READ,          // data in
+    SCSI_WRITE          // data out
+} ENUM_SCSIDIR;
+
+int scsi_open(const QString & device, bool rw);
+int scsi_cmd(int fd, const uint8_t * cdb, int cdb_len, int dir, uint8_t * buf, int len,
+             uint8_t * sense, int timeout_ms, int verbose);
+int scsi_sense_key(const uint8_t * sense);
+bool scsi_sense_info(const uint8_t * sense, uint64_t & info);
+int scsi_read_capacity16(int fd, uint64_t & blocks, uint32_t & block_len, int verbose);
+QString scsi_sg_node(const QString & block);
+
+typedef struct ST_SCSISLOT {
+    int slot;
+    QString node;           // sg node, or the block device if it has none
+    QString cpus;           // CPUs local to the HBA the worker is pinned to, empty if not pinned
+} _ST_SCSISLOT;
+
+QVector<_ST_SCSISLOT> scsi_slot_targets(const QVector<int> & slots);
+int scsi_for_each_slot(const QVector<_ST_SCSISLOT> & targets, int per_expander, const std::function<void(int, int)> & fn, int verbose);
+int scsi_for_each_slot(const QVector<int> & slots, int per_expander, const std::function<void(int, int)> & fn, int verbose);
+
+#endif // SCSI_CMD_H
@@ -0,0 +1,461 @@
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QMap>
+
+#include <string.h>
+#include <unistd.h>
+
+#include "widget.h"
+#include "ses.h"
+#include "scsi_cmd.h"
+#include "lsscsi.h"
+
+#define SES_PAGE_CONFIG     0x01
+#define SES_PAGE_STATUS     0x02
+#define SES_PAGE_DESC       0x07
+#define SES_PAGE_AES        0x0a
+#define SAS_PROTOCOL_ID     0x6
+#define SES_MAX_PAGE_LEN    0xfffc
+
+static QVector<_ST_ENCLOSURE> enclosures;
+
+static inline uint32_t
+get_be32(const uint8_t * p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static inline int
+get_be16(const uint8_t * p)
+{
+    return (p[0] << 8) | p[1];
+}
+
+static inline uint64_t
+get_be64(const uint8_t * p)
+{
+    return ((uint64_t)get_be32(p) << 32) | get_be32(p + 4);
+}
+
+/* The sg device of every enclosure services device, with its enclosure logical identifier */
+static QMap<QString, uint64_t>
+enclosure_sgs()
+{
+    QMap<QString, uint64_t> sgs;
+    const QStringList names = QDir("/sys/class/enclosure").entryList(QDir::Dirs | QDir::NoDotAndDotDot);
+    for (const QString & name : names) {
+        QString dir = "/sys/class/enclosure/" + name;
+        QStringList sg = QDir(dir + "/device/scsi_generic").entryList(QDir::Dirs | QDir::NoDotAndDotDot);
+        if (false == sg.isEmpty()) {
+            QString id;
+            get_myValue(dir, "id", id);
+            sgs.insert("/dev/" + sg[0], id.trimmed().toULongLong(nullptr, 16));
+        }
+    }
+    return sgs;
+}
+
+/* The expander the enclosure belongs to: within the expander's block of SAS addresses */
+static int
+enclosure_expander(uint64_t id)
+{
+    int k = WWID_TO_INDEX(id);
+    return (false == gControllers.bsgPath(k).isEmpty() && gControllers.wwid64(k) >> 6 == id >> 6) ? k : -1;
+}
+
+/* RECEIVE DIAGNOSTIC RESULTS of a page. Returns the page length, or negative as scsi_cmd() */
+int
+ses_receive_diag(const QString & sg, int page, QByteArray & data, int vb)
+{
+    uint8_t cdb[6] = { 0x1c, 0x01, (uint8_t)page, SES_MAX_PAGE_LEN >> 8, SES_MAX_PAGE_LEN & 0xff, 0 };
+
+    int fd = scsi_open(sg, false);
+    if (fd < 0) {
+        return -1;
+    }
+    data.resize(SES_MAX_PAGE_LEN);
+    int len = scsi_cmd(fd, cdb, sizeof(cdb), SCSI_READ, (uint8_t *) data.data(), data.size(), nullptr, SCSI_TIMEOUT_MS, vb);
+    close(fd);
+    if (len < 4 || (uint8_t) data[0] != page) {
+        data.clear();
+        return (len < 0) ? len : -3;
+    }
+    data.resize(qMin(len, 4 + get_be16((const uint8_t *) data.constData() + 2)));
+    return data.size();
+}
+
+/* SEND DIAGNOSTIC with the page (PF set). Returns 0, or negative as scsi_cmd() */
+int
+ses_send_diag(const QString & sg, const QByteArray & data, int vb)
+{
+    uint8_t cdb[6] = { 0x1d, 0x10, 0, (uint8_t)(data.size() >> 8), (uint8_t)(data.size() & 0xff), 0 };
+
+    int fd = scsi_open(sg, true);
+    if (fd < 0) {
+        return -1;
+    }
+    int res = scsi_cmd(fd, cdb, sizeof(cdb), SCSI_WRITE, (uint8_t *) data.constData(), data.size(), nullptr, SCSI_TIMEOUT_MS, vb);
+    close(fd);
+    return (res < 0) ? res : 0;
+}
+
+/*
+ * Element list from the Configuration page: the type descriptor headers of
+ * all subenclosures, in the order their elements appear in the Enclosure
+ * Status page, each type an overall element and its individual elements.
+ * The texts come from the Element Descriptor page, in the same order.
+ */
+static bool
+parse_config(_ST_ENCLOSURE & encl, const QByteArray & cfg, const QByteArray & desc)
+{
+    const uint8_t * p = (const uint8_t *) cfg.constData();
+    int len = cfg.size();
+    if (len < 8) {
+        return false;
+    }
+    int num_sub = p[1] + 1, pos = 8, types = 0;
+    for (int s = 0; s < num_sub && pos + 4 <= len; s++) {
+        types += p[pos + 2];
+        pos += 4 + p[pos + 3];
+    }
+    if (pos + types * 4 > len) {
+        return false;
+    }
+
+    const uint8_t * d = (const uint8_t *) desc.constData();
+    int dpos = 8, dlen = desc.size();
+    auto next_desc = [&]() {
+        QString text;
+        if (dpos + 4 <= dlen) {
+            int n = get_be16(d + dpos + 2);
+            text = QString::fromLatin1((const char *) d + dpos + 4, qMin(n, dlen - dpos - 4)).trimmed();
+            dpos += 4 + n;
+        }
+        return text;
+    };
+
+    encl.elems.clear();
+    encl.gen = get_be32(p + 4);
+    QMap<int, int> count;       // elements so far per type, over the subenclosures
+    int offset = 8;
+    for (int t = 0; t < types; t++) {
+        const uint8_t * th = p + pos + t * 4;
+        offset += 4;            // the overall status element
+        next_desc();
+        for (int i = 0; i < th[1]; i++) {
+            _ST_SESELEM e = { th[0], count[th[0]]++, -1, offset, next_desc(), {0} };
+            encl.elems.append(e);
+            offset += 4;
+        }
+    }
+    return true;
+}
+
+static void
+apply_status(_ST_ENCLOSURE & encl)
+{
+    const uint8_t * p = (const uint8_t *) encl.page2.constData();
+    for (_ST_SESELEM & e : encl.elems) {
+        if (e.offset + 4 <= encl.page2.size()) {
+            memcpy(e.status, p + e.offset, 4);
+        }
+    }
+}
+
+typedef struct {
+    int elem;               // element index in the status page, -1 if not given
+    bool overall;           // the index counts the overall elements too (EIIOE)
+    int slot;
+    QVector<uint64_t> sas;  // SAS addresses of the drive phys
+} aes_slot_t;
+
+/*
+ * Device slot descriptors of the Additional Element Status page of the
+ * enclosure id. A descriptor lists the phys of the drive in the slot; when
+ * some are attached to the enclosure's own expander only those are taken, the
+ * other port of a dual-ported drive is mapped by the enclosure of the other
+ * expander. The slot is the device slot number (as DISCOVER reports it), or
+ * else the descriptor order within the expander's slots.
+ */
+static QVector<aes_slot_t>
+parse_aes(const QByteArray & aes, uint64_t id)
+{
+    QVector<aes_slot_t> slots;
+    // the expanders may not be discovered yet, the index is taken from the address as they are
+    int k = WWID_TO_INDEX(id);
+    const uint8_t * p = (const uint8_t *) aes.constData();
+    int len = aes.size(), index = 0;
+
+    for (int pos = 8; pos + 2 <= len; pos += 2 + p[pos + 1], index++) {
+        const uint8_t * d = p + pos;
+        bool eip = d[0] & 0x10;
+        if ((d[0] & 0x80) || SAS_PROTOCOL_ID != (d[0] & 0xf) || pos + 2 + d[1] > len) {
+            continue;
+        }
+        const uint8_t * sas = d + (eip ? 4 : 2);
+        if (0 != (sas[1] >> 6)) {
+            continue;   // not a device slot descriptor
+        }
+        aes_slot_t slot = { eip ? d[3] : -1, eip && 1 == (d[2] & 0x3),
+                            (eip && 0xff != sas[3]) ? sas[3] - 1 : k * NSLOT_PEREXP + index, {} };
+        if ((unsigned)slot.slot >= NSLOT) {
+            continue;
+        }
+        const uint8_t * phys = sas + (eip ? 4 : 2);
+        int num = qMin((int)sas[0], (int)(d + 2 + d[1] - phys) / 28);
+        bool own = false;
+        for (int n = 0; n < num; n++) {
+            own |= (get_be64(phys + n * 28 + 4) >> 6 == id >> 6);
+        }
+        for (int n = 0; n < num; n++) {
+            const uint8_t * phy = phys + n * 28;
+            uint64_t attached = get_be64(phy + 4), sa = get_be64(phy + 12);
+            if (0 != sa && (false == own || attached >> 6 == id >> 6)) {
+                slot.sas.append(sa);
+            }
+        }
+        slots.append(slot);
+    }
+    return slots;
+}
+
+/* The slot of every device slot element, from Additional Element Status */
+static void
+apply_aes(_ST_ENCLOSURE & encl, const QByteArray & aes)
+{
+    int nth = 0;
+    for (const aes_slot_t & slot : parse_aes(aes, encl.id)) {
+        if (slot.overall) {
+            for (_ST_SESELEM & e : encl.elems) {
+                if (e.offset == 8 + slot.elem * 4) {
+                    e.slot = slot.slot;
+                }
+            }
+            continue;
+        }
+        if (slot.elem >= 0 && slot.elem < encl.elems.size()) {
+            encl.elems[slot.elem].slot = slot.slot;
+            continue;
+        }
+        // without element indexes the descriptors follow the device slot elements in order
+        for (int seen = 0, i = 0; i < encl.elems.size(); i++) {
+            int type = encl.elems[i].type;
+            if ((SES_DEVICE_SLOT == type || SES_ARRAY_SLOT == type) && seen++ == nth) {
+                encl.elems[i].slot = slot.slot;
+                break;
+            }
+        }
+        nth++;
+    }
+}
+
+/*
+ * Read the Enclosure Status page of every enclosure services device; only
+ * when its generation code moved (or the first time) the Configuration,
+ * Element Descriptor and Additional Element Status pages are read again.
+ * Returns the number of enclosures.
+ */
+int
+ses_refresh(int vb)
+{
+    QMap<QString, _ST_ENCLOSURE> cached;
+    for (const _ST_ENCLOSURE & encl : enclosures) {
+        cached.insert(encl.sg, encl);
+    }
+    enclosures.clear();
+
+    const QMap<QString, uint64_t> sgs = enclosure_sgs();
+    for (auto it = sgs.cbegin(); it != sgs.cend(); ++it) {
+        QString sg = it.key();
+        _ST_ENCLOSURE encl = cached.value(sg, _ST_ENCLOSURE());
+        encl.sg = sg;
+        encl.id = it.value();
+        encl.exp = enclosure_expander(encl.id);
+
+        if (ses_receive_diag(sg, SES_PAGE_STATUS, encl.page2, vb) < 8) {
+            qDebug() << "SES status page failed to read on " << sg;
+            continue;
+        }
+        uint32_t gen = get_be32((const uint8_t *) encl.page2.constData() + 4);
+        if (encl.elems.isEmpty() || gen != encl.gen) {
+            QByteArray cfg, desc;
+            // descriptors are optional; a failed read only leaves the texts empty
+            ses_receive_diag(sg, SES_PAGE_DESC, desc, vb);
+            if (ses_receive_diag(sg, SES_PAGE_CONFIG, cfg, vb) < 8 || false == parse_config(encl, cfg, desc)) {
+                qDebug() << "SES configuration page failed to read on " << sg;
+                continue;
+            }
+            QByteArray aes;
+            if (ses_receive_diag(sg, SES_PAGE_AES, aes, vb) >= 8) {
+                apply_aes(encl, aes);
+            }
+            if (encl.gen != gen) {
+                // the configuration changed again in between, the next refresh picks it up
+                encl.gen = 0;
+            }
+            if (vb) {
+                qDebug() << sg << " configuration read, " << encl.elems.size() << " elements";
+            }
+        }
+        apply_status(encl);
+        enclosures.append(encl);
+    }
+    return enclosures.size();
+}
+
+/*
+ * SAS address to slot index from the Additional Element Status page of every
+ * enclosure, one read each. Returns the number of SAS addresses mapped.
+ */
+int
+ses_slot_map(QHash<uint64_t, int> & map, int vb)
+{
+    map.clear();
+    const QMap<QString, uint64_t> sgs = enclosure_sgs();
+    for (auto it = sgs.cbegin(); it != sgs.cend(); ++it) {
+        QByteArray aes;
+        if (ses_receive_diag(it.key(), SES_PAGE_AES, aes, vb) < 8) {
+            continue;
+        }
+        for (const aes_slot_t & slot : parse_aes(aes, it.value())) {
+            for (uint64_t sa : slot.sas) {
+                if (false == map.contains(sa)) {
+                    map.insert(sa, slot.slot);
+                }
+                if (vb > 1) {
+                    qDebug("SES: %lx in slot %d", sa, slot.slot + 1);
+                }
+            }
+        }
+    }
+    return map.size();
+}
+
+/*
+ * IDENT or FAULT (led) set or cleared on the device slots given, by one
+ * Enclosure Control page write per enclosure; the other elements are not
+ * selected, so their LEDs stay as the enclosure, an operator or another
+ * tool left them. Returns the number of enclosures written.
+ */
+int
+ses_set_leds(const QVector<int> & slots, int led, bool on, int vb)
+{
+    int written = 0;
+
+    ses_refresh(vb);
+    for (const _ST_ENCLOSURE & encl : enclosures) {
+        QByteArray ctl = encl.page2;
+        uint8_t * p = (uint8_t *) ctl.data();
+        int touched = 0;
+
+        // the generation code of the status read is kept, it has to match
+        p[1] = 0;
+        memset(p + 8, 0, ctl.size() - 8);
+        for (const _ST_SESELEM & e : encl.elems) {
+            if ((SES_DEVICE_SLOT != e.type && SES_ARRAY_SLOT != e.type) || e.slot < 0 || e.offset + 4 > ctl.size()
+                || false == slots.contains(e.slot)) {
+                continue;
+            }
+            bool ident = (SES_LED_IDENT == led) ? on : (e.status[2] & 0x02);
+            bool fault = (SES_LED_FAULT == led) ? on : (e.status[3] & 0x20);
+            uint8_t * c = p + e.offset;
+            c[0] = 0x80;                                            // SELECT
+            c[1] = (SES_ARRAY_SLOT == e.type) ? e.status[1] : 0;    // array state as it is
+            c[2] = (e.status[2] & 0x40) | (ident ? 0x02 : 0);       // DO NOT REMOVE, RQST IDENT
+            c[3] = (fault ? 0x20 : 0) | (e.status[3] & 0x10);       // RQST FAULT, DEVICE OFF
+            touched++;
+        }
+        if (0 == touched) {
+            continue;
+        }
+        if (0 == ses_send_diag(encl.sg, ctl, vb)) {
+            written++;
+        } else {
+            gAppendMessage("SES control page failed to write on " + encl.sg);
+        }
+    }
+    return written;
+}
+
+QVector<_ST_ENCLOSURE> &
+ses_enclosures()
+{
+    return enclosures;
+}
+
+const char *
+ses_status_str(int code)
+{
+    static const char * str[] = { "unsupported", "OK", "critical", "noncritical", "unrecoverable",
+                                  "not installed", "unknown", "not available", "no access" };
+    return ((code & 0xf) < 9) ? str[code & 0xf] : "reserved";
+}
+
+static QString
+element_name(const _ST_SESELEM & e, const char * what)
+{
+    return e.desc.isEmpty() ? QString::asprintf("%s %d", what, e.index) : e.desc;
+}
+
+/* Slots not OK, every temperature sensor, cooling element and power supply */
+void
+ses_report()
+{
+    for (const _ST_ENCLOSURE & encl : enclosures) {
+        QString head = QString::asprintf("Enclosure %lX (%s)", encl.id, encl.sg.toStdString().c_str());
+        if (encl.exp >= 0) {
+            head += QString::asprintf(" on Expander-%d", encl.exp + 1);
+        }
+        const uint8_t * p = (const uint8_t *) encl.page2.constData();
+        // INVOP, INFO, NON-CRIT, CRIT, UNRECOV of the enclosure status page
+        if (p[1] & 0x1f) {
+            head += QString::asprintf(": %s%s%s%s%s", (p[1] & 0x10) ? "INVOP " : "", (p[1] & 0x08) ? "INFO " : "",
+                                      (p[1] & 0x04) ? "NONCRIT " : "", (p[1] & 0x02) ? "CRIT " : "",
+                                      (p[1] & 0x01) ? "UNRECOV" : "");
+        }
+        gAppendMessage(head);
+
+        int slots = 0, faulty = 0;
+        QStringList temps, fans;
+        for (const _ST_SESELEM & e : encl.elems) {
+            int code = e.status[0] & 0xf;
+            switch (e.type) {
+            case SES_DEVICE_SLOT:
+            case SES_ARRAY_SLOT:
+                slots++;
+                if ((1 != code && 5 != code) || (e.status[3] & 0x60)) {
+                    faulty++;
+                    gAppendMessage("  " + element_name(e, "slot") + QString::asprintf(": %s%s%s", ses_status_str(code),
+                                   (e.status[3] & 0x40) ? ", fault sensed" : "", (e.status[3] & 0x20) ? ", fault requested" : ""));
+                }
+                break;
+            case SES_TEMPERATURE:
+                if (e.status[2]) {
+                    temps << element_name(e, "sensor") + QString::asprintf(" %d C", e.status[2] - 20) +
+                             ((1 == code) ? "" : QString(" (") + ses_status_str(code) + ")");
+                }
+                break;
+            case SES_COOLING:
+                fans << element_name(e, "fan") + QString::asprintf(" %d rpm", (((e.status[1] & 0x7) << 8) | e.status[2]) * 10) +
+                        ((1 == code) ? "" : QString(" (") + ses_status_str(code) + ")");
+                break;
+            case SES_POWER_SUPPLY:
+                gAppendMessage("  " + element_name(e, "PSU") + QString::asprintf(": %s%s%s%s%s", ses_status_str(code),
+                               (e.status[3] & 0x40) ? ", fail" : "", (e.status[3] & 0x10) ? ", off" : "",
+                               (e.status[3] & 0x02) ? ", AC fail" : "", (e.status[3] & 0x01) ? ", DC fail" : ""));
+                break;
+            }
+        }
+        gAppendMessage(QString::asprintf("  %d slots, %d not OK", slots, faulty));
+        if (false == temps.isEmpty()) {
+            gAppendMessage("  Temperature: " + temps.join(", "));
+        }
+        if (false == fans.isEmpty()) {
+            gAppendMessage("  Cooling: " + fans.join(", "));
+        }
+    }
+    if (enclosures.isEmpty()) {
+        gAppendMessage("SES: no enclosure services device found");
+    }
+}
@@ -0,0 +1,50 @@
+#ifndef SES_H
+#define SES_H
+
+#include <QByteArray>
+#include <QHash>
+#include <QString>
+#include <QVector>
+
+/* SES element type codes */
+typedef enum {
+    SES_DEVICE_SLOT     = 0x01,
+    SES_POWER_SUPPLY    = 0x02,
+    SES_COOLING         = 0x03,
+    SES_TEMPERATURE     = 0x04,
+    SES_ARRAY_SLOT      = 0x17
+} ENUM_SESTYPE;
+
+typedef enum {
+    SES_LED_IDENT = 0,
+    SES_LED_FAULT
+} ENUM_SESLED;
+
+typedef struct ST_SESELEM {
+    int type;               // ENUM_SESTYPE or any other element type
+    int index;              // within the elements of its type in the enclosure, from 0
+    int slot;               // slot index of a device slot from Additional Element Status, -1 if unknown
+    int offset;             // of its status element in the Enclosure Status page
+    QString desc;           // Element Descriptor text
+    uint8_t status[4];      // status element as last read
+} _ST_SESELEM;
+
+typedef struct ST_ENCLOSURE {
+    QString sg;             // "/dev/sgN" of the enclosure services device
+    uint64_t id;            // enclosure logical identifier
+    int exp;                // expander index, -1 if not one of the expanders
+    uint32_t gen;           // generation code of the configuration cached
+    QByteArray page2;       // Enclosure Status page as last read
+    QVector<_ST_SESELEM> elems;
+} _ST_ENCLOSURE;
+
+int ses_refresh(int verbose);
+int ses_slot_map(QHash<uint64_t, int> & map, int verbose);
+QVector<_ST_ENCLOSURE> & ses_enclosures();
+int ses_receive_diag(const QString & sg, int page, QByteArray & data, int verbose);
+int ses_send_diag(const QString & sg, const QByteArray & data, int verbose);
+int ses_set_leds(const QVector<int> & slots, int led, bool on, int verbose);
+const char * ses_status_str(int code);
+void ses_report();
+
+#endif // SES_H
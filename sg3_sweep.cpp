@@ -0,0 +1,204 @@
+#include <QElapsedTimer>
+#include <QMutex>
+#include <algorithm>
+
+#include <string.h>
+
+#include "widget.h"
+#include "sg3_sweep.h"
+#include "scsi_cmd.h"
+
+#define INQUIRY                 0x12
+#define TEST_UNIT_READY         0x00
+#define INQ_ALLOC_LEN           252
+#define SG3_PER_EXP             8       // commands in flight per expander
+
+static const char * SG3_CMD_NAME[SG3_NCMD] = {
+    "INQUIRY", "VPD 80h", "VPD 83h", "VPD B0h", "VPD B1h", "READ CAPACITY(16)", "TEST UNIT READY"
+};
+
+static inline uint32_t
+get_be32(const uint8_t * p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static inline int
+get_be16(const uint8_t * p)
+{
+    return (p[0] << 8) | p[1];
+}
+
+static QString
+ascii(const uint8_t * p, int len)
+{
+    return QString::fromLatin1((const char *) p, len).trimmed();
+}
+
+/* One command timed; the latency is kept with its result */
+static int
+timed_cmd(int fd, _ST_SG3INFO & info, int cmd, const uint8_t * cdb, int cdb_len, int dir,
+          uint8_t * buf, int len, uint8_t * sense, int vb)
+{
+    QElapsedTimer clock;
+    clock.start();
+    info.result[cmd] = scsi_cmd(fd, cdb, cdb_len, dir, buf, len, sense, SCSI_TIMEOUT_MS, vb);
+    info.lat_us[cmd] = clock.nsecsElapsed() / 1000;
+    return info.result[cmd];
+}
+
+static int
+inquiry(int fd, _ST_SG3INFO & info, int cmd, int page, uint8_t * buf, int vb)
+{
+    uint8_t cdb[6] = {INQUIRY, (uint8_t)(page >= 0), (uint8_t)(page >= 0 ? page : 0), 0, INQ_ALLOC_LEN, 0};
+    memset(buf, 0, INQ_ALLOC_LEN);
+    int len = timed_cmd(fd, info, cmd, cdb, sizeof(cdb), SCSI_READ, buf, INQ_ALLOC_LEN, nullptr, vb);
+    // a VPD page must come back as the page asked for
+    return (len >= 4 && (page < 0 || buf[1] == page)) ? len : -1;
+}
+
+/* The NAA designator of the logical unit in the Device Identification page */
+static QString
+naa_designator(const uint8_t * vp, int len)
+{
+    int end = qMin(len, 4 + get_be16(vp + 2));
+    for (int pos = 4; pos + 4 <= end; pos += 4 + vp[pos + 3]) {
+        const uint8_t * d = vp + pos;
+        int dlen = d[3];
+        if ((d[1] & 0xf) == 3 && (d[1] & 0x30) == 0 && pos + 4 + dlen <= end) {
+            QString hex;
+            for (int i = 0; i < dlen; ++i) {
+                hex += QString::asprintf("%02x", d[4 + i]);
+            }
+            return hex;
+        }
+    }
+    return QString();
+}
+
+static void
+sweep_slot(int fd, _ST_SG3INFO & info, int vb)
+{
+    uint8_t buf[INQ_ALLOC_LEN];
+    uint8_t sense[SCSI_SENSE_LEN];
+
+    int len = inquiry(fd, info, SG3_INQUIRY, -1, buf, vb);
+    if (len >= 36) {
+        info.vendor = ascii(buf + 8, 8);
+        info.model = ascii(buf + 16, 16);
+        info.firmware = ascii(buf + 32, 4);
+    }
+    len = inquiry(fd, info, SG3_VPD_SERIAL, 0x80, buf, vb);
+    if (len > 4) {
+        info.serial = ascii(buf + 4, qMin(len, 4 + get_be16(buf + 2)) - 4);
+    }
+    len = inquiry(fd, info, SG3_VPD_DEVID, 0x83, buf, vb);
+    if (len > 4) {
+        info.naa = naa_designator(buf, len);
+    }
+    len = inquiry(fd, info, SG3_VPD_LIMITS, 0xb0, buf, vb);
+    if (len >= 16) {
+        info.max_xfer = get_be32(buf + 8);
+        info.opt_xfer = get_be32(buf + 12);
+    }
+    len = inquiry(fd, info, SG3_VPD_CHARS, 0xb1, buf, vb);
+    if (len >= 6) {
+        info.rotation = get_be16(buf + 4);
+    }
+
+    QElapsedTimer clock;
+    clock.start();
+    info.result[SG3_READ_CAPACITY] = scsi_read_capacity16(fd, info.blocks, info.block_len, vb);
+    info.lat_us[SG3_READ_CAPACITY] = clock.nsecsElapsed() / 1000;
+
+    uint8_t tur[6] = {TEST_UNIT_READY, 0, 0, 0, 0, 0};
+    len = timed_cmd(fd, info, SG3_TUR, tur, sizeof(tur), SCSI_NONE, nullptr, 0, sense, vb);
+    info.ready = (len >= 0) ? 0 : ((-2 == len) ? scsi_sense_key(sense) : -1);
+}
+
+/*
+ * Identify the slots: INQUIRY, its VPD pages, READ CAPACITY(16) and TEST UNIT
+ * READY to every drive, a few drives of each expander at a time and the
+ * expanders in parallel. Returns one entry per slot opened, in slot order.
+ */
+QVector<_ST_SG3INFO>
+sg3_sweep(const QVector<int> & slots, int vb)
+{
+    QVector<_ST_SG3INFO> infos;
+    QMutex mutex;
+
+    scsi_for_each_slot(slots, SG3_PER_EXP, [&infos, &mutex, vb](int sl, int fd) {
+        _ST_SG3INFO info;
+        info.slot = sl;
+        info.rotation = 0;
+        info.blocks = 0;
+        info.block_len = 0;
+        info.opt_xfer = info.max_xfer = 0;
+        info.ready = -1;
+        for (int c = 0; c < SG3_NCMD; ++c) {
+            info.result[c] = -1;
+            info.lat_us[c] = 0;
+        }
+        sweep_slot(fd, info, vb);
+        QMutexLocker locker(&mutex);
+        infos.append(info);
+    }, vb);
+
+    std::sort(infos.begin(), infos.end(), [](const _ST_SG3INFO & a, const _ST_SG3INFO & b) {
+        return a.slot < b.slot;
+    });
+    return infos;
+}
+
+QString
+sg3_rotation_str(int rotation)
+{
+    if (1 == rotation) {
+        return "SSD";
+    }
+    return (rotation >= 0x401 && rotation < 0xffff) ? QString::number(rotation) + " rpm" : QString("-");
+}
+
+QString
+sg3_capacity_str(const _ST_SG3INFO & info)
+{
+    if (0 == info.blocks) {
+        return "-";
+    }
+    return QString::asprintf("%.2f TB (%u)", (double) info.blocks * info.block_len / 1e12, info.block_len);
+}
+
+/* Latency of each command over the drives, and the failures */
+void
+sg3_latency_report(const QVector<_ST_SG3INFO> & infos, qint64 elapsed_ms)
+{
+    gAppendMessage(QString::asprintf("SG3 sweep: %d drives in %lld ms", (int)infos.size(), elapsed_ms));
+    for (int c = 0; c < SG3_NCMD; ++c) {
+        QVector<qint64> lat;
+        int failed = 0;
+        for (const _ST_SG3INFO & info : infos) {
+            if (info.result[c] >= 0) {
+                lat.append(info.lat_us[c]);
+            } else {
+                failed++;
+            }
+        }
+        if (lat.isEmpty()) {
+            gAppendMessage(QString::asprintf("  %-18s all %d failed", SG3_CMD_NAME[c], failed));
+            continue;
+        }
+        std::sort(lat.begin(), lat.end());
+        qint64 sum = 0;
+        for (qint64 us : lat) {
+            sum += us;
+        }
+        gAppendMessage(QString::asprintf("  %-18s mean %6lld us, median %6lld us, max %6lld us%s", SG3_CMD_NAME[c],
+                                         sum / lat.size(), lat[lat.size() / 2], lat.last(),
+                                         failed ? QString::asprintf(", %d failed", failed).toStdString().c_str() : ""));
+    }
+    for (const _ST_SG3INFO & info : infos) {
+        if (info.ready > 0) {
+            gAppendMessage(QString::asprintf("  slot %d: not ready, sense key %xh", info.slot + 1, info.ready));
+        }
+    }
+}
@@ -0,0 +1,41 @@
+#ifndef SG3_SWEEP_H
+#define SG3_SWEEP_H
+
+#include <QString>
+#include <QVector>
+#include <stdint.h>
+
+typedef enum {
+    SG3_INQUIRY = 0,
+    SG3_VPD_SERIAL,         // VPD 80h Unit Serial Number
+    SG3_VPD_DEVID,          // VPD 83h Device Identification
+    SG3_VPD_LIMITS,         // VPD B0h Block Limits
+    SG3_VPD_CHARS,          // VPD B1h Block Device Characteristics
+    SG3_READ_CAPACITY,      // READ CAPACITY(16)
+    SG3_TUR,                // TEST UNIT READY
+    SG3_NCMD
+} ENUM_SG3CMD;
+
+typedef struct ST_SG3INFO {
+    int slot;
+    QString vendor;
+    QString model;
+    QString firmware;
+    QString serial;
+    QString naa;            // logical unit NAA designator in hex, empty if none
+    int rotation;           // 0 not reported, 1 non-rotating, else rpm
+    uint64_t blocks;
+    uint32_t block_len;
+    uint32_t opt_xfer;      // optimal transfer length in blocks, 0 if not reported
+    uint32_t max_xfer;      // maximum transfer length in blocks, 0 if not reported
+    int ready;              // TEST UNIT READY: 0 ready, else the sense key, -1 if failed
+    int result[SG3_NCMD];   // scsi_cmd() return of each command
+    qint64 lat_us[SG3_NCMD];
+} _ST_SG3INFO;
+
+QVector<_ST_SG3INFO> sg3_sweep(const QVector<int> & slots, int verbose);
+void sg3_latency_report(const QVector<_ST_SG3INFO> & infos, qint64 elapsed_ms);
+QString sg3_rotation_str(int rotation);
+QString sg3_capacity_str(const _ST_SG3INFO & info);
+
+#endif // SG3_SWEEP_H
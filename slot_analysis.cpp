@@ -0,0 +1,141 @@
+#include <QMap>
+#include <QStringList>
+#include <QVector>
+#include <algorithm>
+
+#include "widget.h"
+#include "slot_analysis.h"
+
+#define MIN_GROUP       3       // fewer drives than this make no statistics
+#define BW_SHORTFALL    0.75    // flagged when below this fraction of the group median
+#define LAT_EXCESS      2.0     // flagged when above this multiple of the group median
+#define ROBUST_Z        3.5     // modified z-score threshold (Iglewicz and Hoaglin)
+
+#define PERF_FLAGS      (ENUM_SLOTFLAG::SLOW_BW | ENUM_SLOTFLAG::TAIL_LAT | ENUM_SLOTFLAG::LOAD_DROP)
+
+static double
+median(QVector<double> v)
+{
+    std::sort(v.begin(), v.end());
+    int n = v.size();
+    return (n & 1) ? v[n / 2] : (v[n / 2 - 1] + v[n / 2]) / 2;
+}
+
+/* Modified z-score based on the median absolute deviation; a zero MAD means any deviation counts */
+static double
+robust_z(double x, double med, double mad)
+{
+    if (0 == mad) {
+        return (x == med) ? 0 : ((x > med) ? ROBUST_Z : -ROBUST_Z);
+    }
+    return 0.6745 * (x - med) / mad;
+}
+
+static double
+mad(const QVector<double> & v, double med)
+{
+    QVector<double> dev;
+    for (double x : v) {
+        dev.append(qAbs(x - med));
+    }
+    return median(dev);
+}
+
+/* Drives are only comparable to drives of the same model (or expander) running the same workload */
+static QString
+group_key(int sl, bool by_model)
+{
+    QString key = by_model ? gDevices.model(sl) : QString("Expander-%1").arg(sl / NSLOT_PEREXP + 1);
+    return key + " " + gDevices.perf(sl).workload;
+}
+
+/* Returns the ratio of loaded to solo bandwidth, or 0 if the slot was not measured both ways */
+static double
+load_ratio(int sl)
+{
+    const _ST_SLOTPERF & perf = gDevices.perf(sl);
+    const _ST_SLOTPERF & solo = gDevices.solo(sl);
+    if (perf.njobs > 1 && solo.njobs == 1 && solo.bw_kbs > 0 && solo.workload == perf.workload) {
+        return perf.bw_kbs / solo.bw_kbs;
+    }
+    return 0;
+}
+
+static void
+scan_group(const QString & key, const QVector<int> & slots, int * flags, QStringList & report)
+{
+    QVector<double> bw, p99, ratio;
+    for (int sl : slots) {
+        bw.append(gDevices.perf(sl).bw_kbs);
+        p99.append(gDevices.perf(sl).p99_us);
+        if (load_ratio(sl) > 0) {
+            ratio.append(load_ratio(sl));
+        }
+    }
+
+    double med_bw = median(bw), mad_bw = mad(bw, med_bw);
+    double med_p99 = median(p99), mad_p99 = mad(p99, med_p99);
+    double med_ratio = (ratio.size() >= MIN_GROUP) ? median(ratio) : 0;
+    double mad_ratio = (ratio.size() >= MIN_GROUP) ? mad(ratio, med_ratio) : 0;
+
+    for (int sl : slots) {
+        const _ST_SLOTPERF & perf = gDevices.perf(sl);
+        QString head = QString::asprintf("  slot %d (%s): ", sl + 1, gDevices.block(sl).toStdString().c_str());
+
+        if (perf.bw_kbs < med_bw * BW_SHORTFALL && robust_z(perf.bw_kbs, med_bw, mad_bw) <= -ROBUST_Z) {
+            flags[sl] |= ENUM_SLOTFLAG::SLOW_BW;
+            report << head + QString::asprintf("%.1f MiB/s vs median %.1f MiB/s", perf.bw_kbs / 1024, med_bw / 1024) + " in [" + key + "]";
+        }
+        if (perf.p99_us > med_p99 * LAT_EXCESS && robust_z(perf.p99_us, med_p99, mad_p99) >= ROBUST_Z) {
+            flags[sl] |= ENUM_SLOTFLAG::TAIL_LAT;
+            report << head + QString::asprintf("p99 %.0f us vs median %.0f us", perf.p99_us, med_p99) + " in [" + key + "]";
+        }
+        double r = load_ratio(sl);
+        if (med_ratio > 0 && r > 0 && r < med_ratio * BW_SHORTFALL && robust_z(r, med_ratio, mad_ratio) <= -ROBUST_Z) {
+            flags[sl] |= ENUM_SLOTFLAG::LOAD_DROP;
+            report << head + QString::asprintf("keeps %.0f%% of its solo bandwidth under load vs median %.0f%%", r * 100, med_ratio * 100) + " in [" + key + "]";
+        }
+    }
+}
+
+/*
+ * Flag the statistical outliers among the slots measured, grouping drives by
+ * model and by expander. Returns the number of slots flagged.
+ */
+int
+slot_outlier_scan(int vb)
+{
+    int flags[NSLOT] = {0};
+    int measured = 0, flagged = 0;
+    QStringList report;
+
+    for (int by_model = 1; by_model >= 0; --by_model) {
+        QMap<QString, QVector<int>> groups;
+        for (int i = 0; i < NSLOT; i++) {
+            if (false == gDevices.slotVacant(i) && gDevices.perf(i).njobs > 0) {
+                groups[group_key(i, by_model)].append(i);
+                measured += by_model;
+            }
+        }
+        for (auto it = groups.cbegin(); it != groups.cend(); ++it) {
+            if (it.value().size() >= MIN_GROUP) {
+                scan_group(it.key(), it.value(), flags, report);
+            } else if (vb) {
+                qDebug() << "too few drives to compare in group " << it.key();
+            }
+        }
+    }
+
+    for (int i = 0; i < NSLOT; i++) {
+        gDevices.setSlotFlags(i, (gDevices.slotFlags(i) & ~PERF_FLAGS) | flags[i]);
+        if (flags[i]) {
+            flagged++;
+        }
+    }
+
+    gAppendMessage(QString::asprintf("Outlier scan: %d of %d measured slots flagged", flagged, measured));
+    for (const QString & line : report) {
+        gAppendMessage(line);
+    }
+    return flagged;
+}
@@ -0,0 +1,6 @@
+#ifndef SLOT_ANALYSIS_H
+#define SLOT_ANALYSIS_H
+
+int slot_outlier_scan(int verbose);
+
+#endif // SLOT_ANALYSIS_H
@@ -0,0 +1,119 @@
+#include <QColor>
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "slot_sampler.h"
+
+#define PAINT_HZ        2       // stylesheets are too costly to repaint at the sample rate
+#define HEAT_LEVELS     10
+
+SlotSampler::SlotSampler()
+{
+    for (int i = 0; i < NSLOT; i++) {
+        fd[i] = -1;
+    }
+    QObject::connect(&timer, &QTimer::timeout, [this]() { sample(); });
+}
+
+void SlotSampler::start(int hz)
+{
+    stop();
+    if (hz <= 0) {
+        return;
+    }
+
+    for (int i = 0; i < NSLOT; i++) {
+        rates[i] = _ST_SLOTRATE();
+        last_ns[i] = 0;
+        level[i] = 0;
+        if (false == gDevices.slotVacant(i)) {
+            QString path = "/sys/block/" + gDevices.block(i) + "/stat";
+            fd[i] = open(path.toStdString().c_str(), O_RDONLY);
+        }
+    }
+    samples = 0;
+    paint_every = qMax(1, hz / PAINT_HZ);
+    clock.start();
+    timer.start(1000 / hz);
+    sample();
+}
+
+void SlotSampler::stop()
+{
+    timer.stop();
+    for (int i = 0; i < NSLOT; i++) {
+        if (fd[i] >= 0) {
+            close(fd[i]);
+            fd[i] = -1;
+            gDevices.setSlotHeat(i, QString(), QString());
+        }
+    }
+}
+
+/*
+ * Fields of the stat file: read IOs, merges, sectors, ticks, write IOs, merges,
+ * sectors, ticks, in flight, io ticks, time in queue (see the kernel's
+ * Documentation/block/stat.rst); sectors are 512 bytes, ticks milliseconds.
+ */
+void SlotSampler::sample()
+{
+    char buf[256];
+    qint64 now = clock.nsecsElapsed();
+
+    for (int i = 0; i < NSLOT; i++) {
+        if (fd[i] < 0) {
+            continue;
+        }
+        ssize_t len = pread(fd[i], buf, sizeof(buf) - 1, 0);
+        if (len <= 0) {
+            continue;
+        }
+        buf[len] = '\0';
+
+        quint64 v[BLK_STAT_FIELDS] = {0};
+        char * p = buf;
+        for (int f = 0; f < BLK_STAT_FIELDS; f++) {
+            v[f] = strtoull(p, &p, 10);
+        }
+
+        if (last_ns[i] > 0) {
+            double dt = (now - last_ns[i]) / 1e9;
+            quint64 ios = (v[0] - last[i][0]) + (v[4] - last[i][4]);
+            quint64 ticks = (v[3] - last[i][3]) + (v[7] - last[i][7]);
+            rates[i].iops = ios / dt;
+            rates[i].mbs = ((v[2] - last[i][2]) + (v[6] - last[i][6])) * 512 / dt / 1e6;
+            rates[i].qdepth = (v[10] - last[i][10]) / (dt * 1000);
+            rates[i].util = qMin(100.0, (v[9] - last[i][9]) / (dt * 10));
+            rates[i].await_ms = ios ? (double) ticks / ios : 0;
+        }
+        memcpy(last[i], v, sizeof(v));
+        last_ns[i] = now;
+    }
+
+    if (0 == (++samples % paint_every)) {
+        paint();
+    }
+}
+
+/* Utilization from green (idle) to red (busy), repainted only when the level changes */
+void SlotSampler::paint()
+{
+    for (int i = 0; i < NSLOT; i++) {
+        if (fd[i] < 0) {
+            continue;
+        }
+        const _ST_SLOTRATE & r = rates[i];
+        QString tip = QString::asprintf("live: %.0f IOPS, %.1f MB/s, qd %.1f, util %.0f%%, await %.2f ms",
+                                        r.iops, r.mbs, r.qdepth, r.util, r.await_ms);
+        int lv = (r.util > 0) ? 1 + (int) (r.util * (HEAT_LEVELS - 1) / 100) : 0;
+        if (lv != level[i]) {
+            level[i] = lv;
+            gDevices.setSlotHeat(i, lv ? QColor::fromHsv(120 - 120 * (lv - 1) / (HEAT_LEVELS - 1), 160, 255).name() : QString(), tip);
+        } else {
+            gDevices.setSlotTip(i, tip);
+        }
+    }
+}
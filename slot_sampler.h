@@ -0,0 +1,50 @@
+#ifndef SLOT_SAMPLER_H
+#define SLOT_SAMPLER_H
+
+#include <QElapsedTimer>
+#include <QTimer>
+
+#include "widget.h"
+
+#define BLK_STAT_FIELDS 11
+
+typedef struct ST_SLOTRATE {
+    double iops;
+    double mbs;             // MB/s read + write
+    double qdepth;          // average requests in the queue
+    double util;            // % of the time busy
+    double await_ms;        // average time an IO took, queueing included
+} _ST_SLOTRATE;
+
+/*
+ * Samples /sys/block/<dev>/stat of the occupied slots on a timer of the GUI
+ * thread; the files are kept open and re-read with pread, so a sample costs
+ * one system call per slot. The heatmap is repainted at a lower rate.
+ */
+class SlotSampler
+{
+public:
+    SlotSampler();
+    ~SlotSampler() { stop(); }
+
+    void start(int hz);
+    void stop();
+    bool running() { return timer.isActive(); }
+    const _ST_SLOTRATE & rate(int sl) { return rates[((unsigned)sl < NSLOT) ? sl : 0]; }
+
+private:
+    void sample();
+    void paint();
+
+    QTimer timer;
+    QElapsedTimer clock;
+    int fd[NSLOT];
+    quint64 last[NSLOT][BLK_STAT_FIELDS];
+    qint64 last_ns[NSLOT];
+    _ST_SLOTRATE rates[NSLOT];
+    int level[NSLOT];       // heat level painted
+    int samples;
+    int paint_every;
+};
+
+#endif // SLOT_SAMPLER_H
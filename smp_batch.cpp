@@ -0,0 +1,578 @@
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QMap>
+#include <QThread>
+
+#include "smp_batch.h"
+#include "bw_model.h"
+
+#define SMP_FN_REPORT_PHY_ERR_LOG_RESP_LEN  32
+
+static inline uint32_t
+get_be32(const uint8_t * p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+/*
+ * Run fn on every expander discovered, each in a thread of its own. The
+ * expanders are opened here in the calling thread, where failures can be
+ * reported; fn must not touch the GUI. Returns the number of expanders run.
+ */
+int
+smp_for_each_expander(const std::function<void(int, smp_target_obj *)> & fn, int vb)
+{
+    smp_target_obj tobj[NEXPDR];
+    QThread * thread[NEXPDR] = { nullptr };
+    int count = 0;
+
+    IntfEnum sel = (cardType == ENUM_CARDTYPE::HBA9500) ? I_SGV4 : I_SGV4_MPI;
+    for (int k = 0; k < NEXPDR; ++k) {
+        tobj[k].opened = 0;
+        if (gControllers.bsgPath(k).isEmpty()) {
+            continue;
+        }
+        if (smp_initiator_open(gControllers.bsgPath(k), sel, &tobj[k], vb) < 0) {
+            continue;
+        }
+        // assign sas address for path-through
+        tobj[k].sas_addr64 = gControllers.wwid64(k);
+        thread[k] = QThread::create(fn, k, &tobj[k]);
+        thread[k]->start();
+        count++;
+    }
+
+    // keep the GUI alive while the expanders are worked on
+    for (int k = 0; k < NEXPDR; ++k) {
+        if (nullptr != thread[k]) {
+            while (false == thread[k]->wait(10)) {
+                QCoreApplication::processEvents();
+            }
+            delete thread[k];
+            smp_initiator_close(&tobj[k]);
+        }
+    }
+    return count;
+}
+
+/* REPORT PHY ERROR LOG of one phy. Returns 0 on success, else as smp_function() */
+static int
+report_phy_err_log(smp_target_obj * top, int phy_id, _ST_PHYERR & err, int vb)
+{
+    uint8_t smp_req[] = {SMP_FRAME_TYPE_REQ, SMP_FN_REPORT_PHY_ERR_LOG, 0, 2,
+                         0, 0, 0, 0,  0, 0, 0, 0,  0, 0, 0, 0};
+    uint8_t rp[SMP_FN_REPORT_PHY_ERR_LOG_RESP_LEN];
+
+    smp_req[2] = (sizeof(rp) - 8) / 4;  /* Allocated Response Len */
+    smp_req[9] = phy_id;
+    int len = smp_function(top, smp_req, sizeof(smp_req), rp, sizeof(rp), vb);
+    if (len < 28) {
+        err.phy_id = -1;
+        return (len < 0) ? len : -1;
+    }
+    err.phy_id = rp[9];
+    err.invalid_dword = get_be32(rp + 12);
+    err.disparity = get_be32(rp + 16);
+    err.loss_sync = get_be32(rp + 20);
+    err.reset_problem = get_be32(rp + 24);
+    return 0;
+}
+
+/*
+ * Error counters of every phy of every expander, the expanders read
+ * concurrently. Returns the number of phys read.
+ */
+int
+smp_errlog_snapshot(_ST_ERRSNAPSHOT & snap, int vb)
+{
+    for (int k = 0; k < NEXPDR; ++k) {
+        snap.phys[k].clear();
+    }
+    snap.time = QDateTime::currentDateTime();
+
+    smp_for_each_expander([&snap, vb](int k, smp_target_obj * top) {
+        int num = smp_num_phys(top, vb);
+        snap.phys[k].resize(qMax(num, 0));
+        for (int phy = 0; phy < num; ++phy) {
+            report_phy_err_log(top, phy, snap.phys[k][phy], vb);
+        }
+    }, vb);
+
+    int count = 0;
+    for (int k = 0; k < NEXPDR; ++k) {
+        for (const _ST_PHYERR & err : snap.phys[k]) {
+            count += (err.phy_id >= 0);
+        }
+    }
+    return count;
+}
+
+/*
+ * The counters saturate at FFFFFFFFh rather than wrap, so one lower than
+ * before was reset in between (e.g. by a hard reset of the phy) and counts
+ * from zero since.
+ */
+static uint32_t
+err_count(uint32_t b, uint32_t a)
+{
+    return (a >= b) ? a - b : a;
+}
+
+static QString
+err_field(const char * name, uint32_t b, uint32_t a)
+{
+    return QString::asprintf("%s +%u%s", name, err_count(b, a), (a < b) ? " (counter reset)" : "");
+}
+
+static QString
+err_delta(const _ST_PHYERR & b, const _ST_PHYERR & a)
+{
+    return err_field("invalid dword", b.invalid_dword, a.invalid_dword) + ", " +
+           err_field("disparity", b.disparity, a.disparity) + ", " +
+           err_field("loss of sync", b.loss_sync, a.loss_sync) + ", " +
+           err_field("reset problem", b.reset_problem, a.reset_problem);
+}
+
+/* Only errors counted since the snapshot before, a counter reset alone is no change */
+static bool
+err_changed(const _ST_PHYERR & b, const _ST_PHYERR & a)
+{
+    return b.phy_id >= 0 && a.phy_id >= 0 &&
+           (err_count(b.invalid_dword, a.invalid_dword) > 0 || err_count(b.disparity, a.disparity) > 0 ||
+            err_count(b.loss_sync, a.loss_sync) > 0 || err_count(b.reset_problem, a.reset_problem) > 0);
+}
+
+/*
+ * The phys whose error counters went up between the snapshots, or are not
+ * zero if there is no snapshot before; the slot phys next to the latest
+ * throughput measured on them.
+ */
+void
+smp_errlog_report(const _ST_ERRSNAPSHOT & before, const _ST_ERRSNAPSHOT & after)
+{
+    bool based = before.time.isValid();
+    int changed = 0;
+
+    for (int k = 0; k < NEXPDR; ++k) {
+        int num = based ? qMin(before.phys[k].size(), after.phys[k].size()) : after.phys[k].size();
+        for (int phy = 0; phy < num; ++phy) {
+            _ST_PHYERR zero = { phy, 0, 0, 0, 0 };
+            const _ST_PHYERR & b = based ? before.phys[k][phy] : zero;
+            const _ST_PHYERR & a = after.phys[k][phy];
+            if (false == err_changed(b, a)) {
+                continue;
+            }
+            QString where = QString::asprintf("  Expander-%d phy %d", k+1, phy);
+            for (int sl = k*NSLOT_PEREXP; sl < (k+1)*NSLOT_PEREXP; ++sl) {
+                if (gDevices.slotPhyId(sl) == phy) {
+                    where += QString::asprintf(" (slot %d", sl + 1);
+                    if (false == gDevices.slotVacant(sl)) {
+                        where += " " + gDevices.block(sl);
+                        const _ST_SLOTPERF & perf = gDevices.perf(sl);
+                        if (perf.njobs > 0) {
+                            where += QString::asprintf(", %s %.1f MiB/s", perf.workload.toStdString().c_str(), perf.bw_kbs / 1024);
+                        }
+                    }
+                    where += ")";
+                    break;
+                }
+            }
+            gAppendMessage(where + ": " + err_delta(b, a));
+            changed++;
+        }
+    }
+    if (based) {
+        gAppendMessage(QString::asprintf("Phy error log: %d phys with errors in %lld s", changed, before.time.secsTo(after.time)));
+    } else {
+        gAppendMessage(QString::asprintf("Phy error log: %d phys with errors", changed));
+    }
+}
+
+static inline uint64_t
+get_be64(const uint8_t * p)
+{
+    return ((uint64_t)get_be32(p) << 32) | get_be32(p + 4);
+}
+
+/*
+ * DISCOVER of every phy of every expander, the expanders concurrently.
+ * Returns the number of phys discovered.
+ */
+int
+smp_discover_all(QVector<_ST_PHYLINK> phys[NEXPDR], int vb)
+{
+    for (int k = 0; k < NEXPDR; ++k) {
+        phys[k].clear();
+    }
+
+    smp_for_each_expander([phys, vb](int k, smp_target_obj * top) {
+        uint8_t rp[SMP_FN_DISCOVER_RESP_LEN];
+        int num = smp_num_phys(top, vb);
+        for (int phy = 0; phy < num; ++phy) {
+            _ST_PHYLINK link = { phy, 0, 0, 0, 0, 0, 0, 0 };
+            int len = smp_discover_phy(top, phy, rp, sizeof(rp), vb);
+            if (len > 41) {
+                link.adt = (0x70 & rp[12]) >> 4;
+                link.attached_sa = get_be64(rp + 24);
+                link.negot = rp[13] & 0xf;
+                link.hw_max = rp[41] & 0xf;
+                link.prog_max = (rp[41] >> 4) & 0xf;
+                link.hw_min = rp[40] & 0xf;
+                link.prog_min = (rp[40] >> 4) & 0xf;
+            }
+            phys[k].append(link);
+        }
+    }, vb);
+
+    int count = 0;
+    for (int k = 0; k < NEXPDR; ++k) {
+        count += phys[k].size();
+    }
+    return count;
+}
+
+/* The rate a phy can run at: the lower of its hardware and programmed maximum */
+static int
+link_capability(const _ST_PHYLINK & link)
+{
+    if (0 == linkrate_mbps(link.prog_max)) {
+        return link.hw_max;
+    }
+    return (linkrate_mbps(link.prog_max) < linkrate_mbps(link.hw_max)) ? link.prog_max : link.hw_max;
+}
+
+static int
+slot_of_phy(int k, int phy)
+{
+    for (int sl = k*NSLOT_PEREXP; sl < (k+1)*NSLOT_PEREXP; ++sl) {
+        if (gDevices.slotPhyId(sl) == phy) {
+            return sl;
+        }
+    }
+    return -1;
+}
+
+/*
+ * Flag the links up below what they are capable of. A drive phy counts when
+ * it is below both the capability of the phy and the best rate of the drives
+ * of the same model, since the drive itself may be the slower end. Wide port
+ * lanes are grouped by the attached SAS address; a lane is taken as down when
+ * a phy of the same aligned group of 4 has nothing attached. Returns the
+ * number of links flagged.
+ */
+int
+smp_link_audit(int vb)
+{
+    QVector<_ST_PHYLINK> phys[NEXPDR];
+    if (0 == smp_discover_all(phys, vb)) {
+        gAppendMessage("Link audit: no expander phy discovered");
+        return 0;
+    }
+
+    // the best rate each drive model has come up at
+    QMap<QString, int> model_best;
+    int slot_negot[NSLOT] = {0};
+    for (int k = 0; k < NEXPDR; ++k) {
+        for (const _ST_PHYLINK & link : phys[k]) {
+            int sl = slot_of_phy(k, link.phy_id);
+            if (sl >= 0 && false == gDevices.slotVacant(sl) && linkrate_mbps(link.negot) > 0) {
+                slot_negot[sl] = link.negot;
+                int & best = model_best[gDevices.model(sl)];
+                if (linkrate_mbps(link.negot) > linkrate_mbps(best)) {
+                    best = link.negot;
+                }
+            }
+        }
+    }
+
+    int flagged = 0;
+    for (int k = 0; k < NEXPDR; ++k) {
+        if (phys[k].isEmpty()) {
+            continue;
+        }
+        int lost = 0, drives = 0, lanes = 0;
+
+        // drive phys
+        for (const _ST_PHYLINK & link : phys[k]) {
+            int sl = slot_of_phy(k, link.phy_id);
+            if (sl < 0 || gDevices.slotVacant(sl) || 0 == slot_negot[sl]) {
+                continue;
+            }
+            int cap = link_capability(link);
+            int peer = model_best.value(gDevices.model(sl));
+            int want = (linkrate_mbps(peer) < linkrate_mbps(cap)) ? peer : cap;
+            int flags = gDevices.slotFlags(sl) & ~ENUM_SLOTFLAG::LINK_DOWN;
+            if (linkrate_mbps(link.negot) < linkrate_mbps(want)) {
+                gAppendMessage(QString::asprintf("  Expander-%d phy %d (slot %d %s): %s Gbps, capable of %s Gbps (%s peers at %s Gbps)",
+                               k+1, link.phy_id, sl + 1, gDevices.block(sl).toStdString().c_str(),
+                               linkrate_str(link.negot), linkrate_str(cap),
+                               gDevices.model(sl).toStdString().c_str(), linkrate_str(peer)));
+                lost += linkrate_mbps(want) - linkrate_mbps(link.negot);
+                flags |= ENUM_SLOTFLAG::LINK_DOWN;
+                drives++;
+            }
+            gDevices.setSlotFlags(sl, flags);
+        }
+
+        // wide ports: the phys attached to the same expander or initiator
+        QMap<uint64_t, QVector<int>> ports;
+        for (const _ST_PHYLINK & link : phys[k]) {
+            if (link.adt >= 2 || (link.adt == 1 && slot_of_phy(k, link.phy_id) < 0)) {
+                ports[link.attached_sa].append(link.phy_id);
+            }
+        }
+        for (auto it = ports.cbegin(); it != ports.cend(); ++it) {
+            const QVector<int> & up = it.value();
+            int base = up[0] & ~3;
+            int down = 0, rate = 0;
+            for (int phy = base; phy < base + 4 && phy < phys[k].size(); ++phy) {
+                if (false == up.contains(phy) && 0 == phys[k][phy].adt) {
+                    down++;
+                }
+            }
+            for (int phy : up) {
+                const _ST_PHYLINK & link = phys[k][phy];
+                rate = qMax(rate, link_capability(link));
+                if (linkrate_mbps(link.negot) < linkrate_mbps(link_capability(link))) {
+                    gAppendMessage(QString::asprintf("  Expander-%d phy %d (port %lX): %s Gbps, capable of %s Gbps",
+                                   k+1, phy, it.key(), linkrate_str(link.negot), linkrate_str(link_capability(link))));
+                    lost += linkrate_mbps(link_capability(link)) - linkrate_mbps(link.negot);
+                    lanes++;
+                }
+            }
+            // the phys of the port group make it wide, also with a single lane left up
+            int group = up.size() + down;
+            if (down > 0 && group > 1) {
+                gAppendMessage(QString::asprintf("  Expander-%d port %lX: %d of %d lanes up",
+                               k+1, it.key(), (int) up.size(), group));
+                lost += down * linkrate_mbps(rate);
+                lanes += down;
+            }
+        }
+
+        if (drives || lanes) {
+            gAppendMessage(QString::asprintf("Expander-%d: %d drive links and %d port lanes below capability, %d MB/s lost",
+                                             k+1, drives, lanes, lost));
+        }
+        flagged += drives + lanes;
+    }
+    gAppendMessage(QString::asprintf("Link audit: %d links flagged", flagged));
+    return flagged;
+}
+
+#define PHYCTL_POLL_MS          5
+#define DISCOVER_CHANGE_COUNT   42  // PHY CHANGE COUNT in the DISCOVER response
+#define NEGOT_PHY_DISABLED      1
+
+/*
+ * PHY CONTROL on the phys of ops, the expanders concurrently, then DISCOVER
+ * only the phys touched until each is in the state expected or the deadline
+ * expires: disabled for DISABLE, and for HARD RESET up again after having
+ * gone down (or after its change count moved, if the reset was quicker than
+ * the polling). With programmed link rates the operation is a LINK RESET,
+ * and the phy has to come up with the rates programmed. Returns the number
+ * of phys which reached their state.
+ */
+int
+smp_phy_control_batch(QVector<_ST_PHYCTL> ops[NEXPDR], int deadline_ms, int vb)
+{
+    for (int k = 0; k < NEXPDR; ++k) {
+        for (_ST_PHYCTL & op : ops[k]) {
+            // left so if the expander is not run, it has no bsg node or failed to open
+            op.result = -3;
+            op.negot = 0;
+            op.was_down = false;
+            op.down_ms = op.up_ms = -1;
+        }
+    }
+
+    smp_for_each_expander([ops, deadline_ms, vb](int k, smp_target_obj * top) {
+        int num = ops[k].size();
+        if (0 == num) {
+            return;
+        }
+        uint8_t rp[SMP_FN_DISCOVER_RESP_LEN];
+        QVector<int> changes(num, -1);
+        QVector<bool> was_up(num, false);
+        QVector<bool> seen_up(num, false);
+        QVector<qint64> sent(num, 0);
+        QElapsedTimer clock;
+        int pending = 0;
+
+        // the states to compare against, then the requests back to back
+        for (int i = 0; i < num; ++i) {
+            ops[k][i].result = -1;
+            if (smp_discover_phy(top, ops[k][i].phy_id, rp, sizeof(rp), vb) > DISCOVER_CHANGE_COUNT) {
+                changes[i] = rp[DISCOVER_CHANGE_COUNT];
+                was_up[i] = seen_up[i] = linkrate_mbps(rp[13] & 0xf) > 0;
+                ops[k][i].was_down = false == was_up[i];
+            }
+        }
+        clock.start();
+        for (int i = 0; i < num; ++i) {
+            sent[i] = clock.elapsed();
+            const _ST_PHYCTL & op = ops[k][i];
+            int res = (op.prog_min || op.prog_max) ? phy_control_rate(top, op.phy_id, 1, op.prog_min, op.prog_max, vb)
+                                                   : phy_control(top, op.phy_id, op.disable, vb);
+            if (0 == res) {
+                ops[k][i].result = -2;
+                pending++;
+            }
+        }
+
+        while (pending > 0 && clock.elapsed() < deadline_ms) {
+            for (int i = 0; i < num; ++i) {
+                _ST_PHYCTL & op = ops[k][i];
+                if (-2 != op.result || smp_discover_phy(top, op.phy_id, rp, sizeof(rp), vb) <= DISCOVER_CHANGE_COUNT) {
+                    continue;
+                }
+                qint64 ms = clock.elapsed() - sent[i];
+                bool up = linkrate_mbps(rp[13] & 0xf) > 0;
+                op.negot = rp[13] & 0xf;
+                // down only counts once the link has been seen going from up to down
+                if (up) {
+                    seen_up[i] = true;
+                } else if (seen_up[i] && op.down_ms < 0) {
+                    op.down_ms = ms;
+                }
+                bool done = op.disable ? (NEGOT_PHY_DISABLED == op.negot)
+                                       : (up && (op.down_ms >= 0 || false == was_up[i] || rp[DISCOVER_CHANGE_COUNT] != changes[i]));
+                if (op.prog_min && op.prog_min != (rp[40] >> 4)) {
+                    done = false;
+                }
+                if (op.prog_max && op.prog_max != (rp[41] >> 4)) {
+                    done = false;
+                }
+                if (done) {
+                    if (up) {
+                        op.up_ms = ms;
+                    }
+                    op.result = 0;
+                    pending--;
+                }
+            }
+            QThread::msleep(PHYCTL_POLL_MS);
+        }
+    }, vb);
+
+    int count = 0;
+    for (int k = 0; k < NEXPDR; ++k) {
+        for (const _ST_PHYCTL & op : ops[k]) {
+            count += (0 == op.result);
+        }
+    }
+    return count;
+}
+
+void
+smp_phy_control_report(const QVector<_ST_PHYCTL> ops[NEXPDR])
+{
+    for (int k = 0; k < NEXPDR; ++k) {
+        if (false == ops[k].isEmpty() && -3 == ops[k][0].result) {
+            gAppendMessage(QString::asprintf("  Expander-%d: no SMP access, %d phys skipped", k+1, (int)ops[k].size()));
+            continue;
+        }
+        for (const _ST_PHYCTL & op : ops[k]) {
+            QString msg = QString::asprintf("  Expander-%d phy %d", k+1, op.phy_id);
+            if (op.slot >= 0) {
+                msg += QString::asprintf(" (slot %d)", op.slot + 1);
+            }
+            if (op.prog_max) {
+                msg += QString(": max ") + linkrate_str(op.prog_max) + " Gbps";
+            } else {
+                msg += op.disable ? ": disable" : ": reset";
+            }
+            if (-1 == op.result) {
+                gAppendMessage(msg + " request failed");
+                continue;
+            }
+            if (op.was_down) {
+                msg += ", was down";
+            } else if (op.down_ms >= 0) {
+                msg += QString::asprintf(", down in %lld ms", op.down_ms);
+            }
+            if (op.up_ms >= 0) {
+                msg += QString::asprintf(", up at %s Gbps in %lld ms", linkrate_str(op.negot), op.up_ms);
+            }
+            if (-2 == op.result) {
+                msg += QString::asprintf(", not %s by the deadline", op.disable ? "disabled" : "up");
+            }
+            gAppendMessage(msg);
+        }
+    }
+}
+
+static const _ST_PHYLINK *
+saved_link(const QVector<_ST_PHYLINK> saved[NEXPDR], int k, int phy)
+{
+    for (const _ST_PHYLINK & link : saved[k]) {
+        if (link.phy_id == phy) {
+            return &link;
+        }
+    }
+    return nullptr;
+}
+
+/*
+ * Cap the phys of the slots at max_rate (no higher than their hardware
+ * maximum), lowering the programmed minimum to the hardware one where it is
+ * above the cap, and wait for the links up at it. saved is the DISCOVER of
+ * the phys from before, by smp_discover_all(). The slots verified up with
+ * the rates programmed go to verified. Returns their number, or -1 if none
+ * was capped.
+ */
+int
+smp_link_rate_apply(const QVector<int> & slots, int max_rate, const QVector<_ST_PHYLINK> saved[NEXPDR],
+                    QVector<int> & verified, int deadline_ms, int vb)
+{
+    QVector<_ST_PHYCTL> ops[NEXPDR];
+    int count = 0;
+
+    verified.clear();
+
+    for (int sl : slots) {
+        int k = sl / NSLOT_PEREXP;
+        const _ST_PHYLINK * link = saved_link(saved, k, gDevices.slotPhyId(sl));
+        if (nullptr == link || 0 == link->prog_max) {
+            gAppendMessage(QString::asprintf("  slot %d: link rate not programmable", sl + 1));
+            continue;
+        }
+        _ST_PHYCTL op = { link->phy_id, sl, false };
+        op.prog_max = (linkrate_mbps(max_rate) < linkrate_mbps(link->hw_max)) ? max_rate : link->hw_max;
+        op.prog_min = (linkrate_mbps(link->prog_min) > linkrate_mbps(op.prog_max)) ? link->hw_min : 0;
+        ops[k].append(op);
+        count++;
+    }
+    if (0 == count) {
+        return -1;
+    }
+    int done = smp_phy_control_batch(ops, deadline_ms, vb);
+    smp_phy_control_report(ops);
+    for (int k = 0; k < NEXPDR; ++k) {
+        for (const _ST_PHYCTL & op : ops[k]) {
+            if (0 == op.result) {
+                verified.append(op.slot);
+            }
+        }
+    }
+    return done;
+}
+
+/* Put the programmed link rates of the phys of the slots back as saved. Returns as smp_phy_control_batch() */
+int
+smp_link_rate_restore(const QVector<int> & slots, const QVector<_ST_PHYLINK> saved[NEXPDR], int deadline_ms, int vb)
+{
+    QVector<_ST_PHYCTL> ops[NEXPDR];
+
+    for (int sl : slots) {
+        int k = sl / NSLOT_PEREXP;
+        const _ST_PHYLINK * link = saved_link(saved, k, gDevices.slotPhyId(sl));
+        if (nullptr != link && link->prog_max) {
+            _ST_PHYCTL op = { link->phy_id, sl, false, link->prog_min, link->prog_max };
+            ops[k].append(op);
+        }
+    }
+    int done = smp_phy_control_batch(ops, deadline_ms, vb);
+    smp_phy_control_report(ops);
+    return done;
+}
@@ -0,0 +1,59 @@
+#ifndef SMP_BATCH_H
+#define SMP_BATCH_H
+
+#include <QDateTime>
+#include <QVector>
+#include <functional>
+
+#include "widget.h"
+
+typedef struct ST_PHYERR {
+    int phy_id;             // -1 if the phy could not be read
+    uint32_t invalid_dword;
+    uint32_t disparity;     // running disparity errors
+    uint32_t loss_sync;     // loss of dword synchronization
+    uint32_t reset_problem; // phy reset problems
+} _ST_PHYERR;
+
+typedef struct ST_ERRSNAPSHOT {
+    QDateTime time;
+    QVector<_ST_PHYERR> phys[NEXPDR];
+} _ST_ERRSNAPSHOT;
+
+typedef struct ST_PHYLINK {
+    int phy_id;
+    int adt;                // attached device type, 0 for none
+    uint64_t attached_sa;
+    int negot;              // negotiated logical link rate
+    int hw_max;             // hardware maximum link rate
+    int prog_max;           // programmed maximum link rate
+    int hw_min;             // hardware minimum link rate
+    int prog_min;           // programmed minimum link rate
+} _ST_PHYLINK;
+
+typedef struct ST_PHYCTL {
+    int phy_id;
+    int slot;               // -1 if not a slot phy
+    bool disable;           // DISABLE, else HARD RESET which also enables
+    int prog_min;           // programmed link rates to set with a LINK RESET instead, 0 to leave
+    int prog_max;
+    int result;             // 0 the state expected reached, -1 request not sent or failed, -2 deadline expired,
+                            // -3 no SMP access to the expander
+    int negot;              // negotiated logical link rate at the end
+    bool was_down;          // the link was down before the request
+    qint64 down_ms;         // from the request until the link was seen going down, -1 if not seen
+    qint64 up_ms;           // until the link was seen up again, -1 if not seen
+} _ST_PHYCTL;
+
+int smp_for_each_expander(const std::function<void(int, smp_target_obj *)> & fn, int verbose);
+int smp_errlog_snapshot(_ST_ERRSNAPSHOT & snap, int verbose);
+void smp_errlog_report(const _ST_ERRSNAPSHOT & before, const _ST_ERRSNAPSHOT & after);
+int smp_discover_all(QVector<_ST_PHYLINK> phys[NEXPDR], int verbose);
+int smp_link_audit(int verbose);
+int smp_phy_control_batch(QVector<_ST_PHYCTL> ops[NEXPDR], int deadline_ms, int verbose);
+void smp_phy_control_report(const QVector<_ST_PHYCTL> ops[NEXPDR]);
+int smp_link_rate_apply(const QVector<int> & slots, int max_rate, const QVector<_ST_PHYLINK> saved[NEXPDR],
+                        QVector<int> & verified, int deadline_ms, int verbose);
+int smp_link_rate_restore(const QVector<int> & slots, const QVector<_ST_PHYLINK> saved[NEXPDR], int deadline_ms, int verbose);
+
+#endif // SMP_BATCH_H
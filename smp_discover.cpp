@@ -798,6 +798,93 @@ do_discover(smp_target_obj * top, int disc_phy_id, uint8_t * resp, int max_resp_
     return len;
 }
 
+/* Sends an SMP request of any function and checks the response frame.
+ * Returns length of response in bytes, excluding the CRC on success,
+ * -3 (or less) -> SMP_LIB errors negated (-4 - smp_err), -1 for other errors */
+int
+smp_function(smp_target_obj * top, uint8_t * req, int req_len, uint8_t * resp, int max_resp_len, int vb)
+{
+    int len, res, act_resplen;
+    char b[256];
+    smp_req_resp smp_rr;
+
+    memset(resp, 0, max_resp_len);
+    memset(&smp_rr, 0, sizeof(smp_rr));
+    smp_rr.request_len = req_len;
+    if (I_SGV4_MPI == top->selector) {
+        smp_rr.mpi3mr_function = MPI3_FUNCTION_SMP_PASSTHROUGH;
+        smp_rr.request_len -= 4;  // exclude CRC field on path-throughs
+    }
+    smp_rr.request = req;
+    smp_rr.max_response_l = max_resp_len;
+    smp_rr.response = resp;
+    res = smp_send_req(top, &smp_rr, vb);
+
+    if (res) {
+        qDebug("fn 0x%x smp_send_req failed, res=%d", req[1], res);
+        return -1;
+    }
+    if (smp_rr.transport_err) {
+        qDebug("fn 0x%x smp_send_req transport_error=%d", req[1], smp_rr.transport_err);
+        return -1;
+    }
+    act_resplen = smp_rr.act_response_l;
+    if ((act_resplen >= 0) && (act_resplen < 4)) {
+        qDebug("fn 0x%x response too short, len=%d", req[1], act_resplen);
+        return -4 - SMP_LIB_CAT_MALFORMED;
+    }
+    len = resp[3];
+    if ((0 == len) && (0 == resp[2])) {
+        len = smp_get_func_def_resp_len(resp[1]);
+        if (len < 0) {
+            len = 0;
+        }
+    }
+    len = 4 + (len * 4);        /* length in bytes, excluding 4 byte CRC */
+    if ((act_resplen >= 0) && (len > act_resplen)) {
+        len = act_resplen;
+    }
+    if (SMP_FRAME_TYPE_RESP != resp[0]) {
+        qDebug("fn 0x%x expected SMP frame response type, got=0x%x", req[1], resp[0]);
+        return -4 - SMP_LIB_CAT_MALFORMED;
+    }
+    if (resp[1] != req[1]) {
+        qDebug("Expected function code=0x%x, got=0x%x", req[1], resp[1]);
+        return -4 - SMP_LIB_CAT_MALFORMED;
+    }
+    if (resp[2]) {
+        if (vb) {
+            qDebug("fn 0x%x result: %s", req[1], smp_get_func_res_str(resp[2], sizeof(b), b));
+        }
+        return -4 - resp[2];
+    }
+    return len;
+}
+
+/* Number of phys of the expander, or negative as get_num_phys() */
+int
+smp_num_phys(smp_target_obj * top, int vb)
+{
+    uint8_t rp[SMP_FN_REPORT_GENERAL_RESP_LEN];
+    return get_num_phys(top, rp, NULL, vb);
+}
+
+/* REPORT GENERAL response placed in rp (SMP_FN_REPORT_GENERAL_RESP_LEN),
+ * returns as get_num_phys() */
+int
+smp_report_general(smp_target_obj * top, uint8_t * rp, int vb)
+{
+    memset(rp, 0, SMP_FN_REPORT_GENERAL_RESP_LEN);
+    return get_num_phys(top, rp, NULL, vb);
+}
+
+/* DISCOVER of a single phy, returns as do_discover() */
+int
+smp_discover_phy(smp_target_obj * top, int phy_id, uint8_t * resp, int max_resp_len, int vb)
+{
+    return do_discover(top, phy_id, resp, max_resp_len, vb);
+}
+
 /* Calls do_discover() multiple times. Summarizes info into one
  * line per phy. Returns 0 if ok, else function result. */
 int
@@ -1265,6 +1352,9 @@ do_multiple_slot(smp_target_obj * top, int vb)
     uint64_t ull, expander_sa = 0, hba_sa = 0;
     uint8_t * rp = NULL;
     uint8_t * free_rp = NULL;
+    int uplink_base = -1;
+    int lane[32];       /* 1 attached to the HBA, 0 down or nothing attached, -1 otherwise */
+    int negot[32];
 
     len = SMP_FN_DISCOVER_RESP_LEN;
     rp = smp_memalign(len, 0, &free_rp, false);
@@ -1273,6 +1363,9 @@ do_multiple_slot(smp_target_obj * top, int vb)
         return SMP_LIB_RESOURCE_ERROR;
     }
 
+    for (k = 0; k < 32; ++k) {
+        lane[k] = -1;
+    }
     for (k = 0; k < 32; ++k) {
         len = do_discover(top, k, rp, SMP_FN_DISCOVER_RESP_LEN, vb);
         if (len < 0)
@@ -1315,14 +1408,33 @@ do_multiple_slot(smp_target_obj * top, int vb)
                 hba_sa = sa;
                 gControllers.setDiscoverResp(top->device_name, ull, sa, rp, len);
             }
+            if (0 != sa && sa == hba_sa) {
+                lane[k] = 1;
+                if (uplink_base < 0) {
+                    uplink_base = k & ~3;
+                }
+            }
         } else {
+            /* ATTACHED DEVICE TYPE (byte 12), none on a phy that is down */
+            if (0 == (rp[12] & 0x70)) {
+                lane[k] = 0;
+            }
             /* Device Slot Number */
             dsn = ((len > 108) && (0xff != rp[108])) ? rp[108] : -1;
             gDevices.setDiscoverResp(dsn, rp, len);
         }
+        negot[k] = (len > 13) ? (rp[13] & 0xf) : 0;
     }
 
 finish:
+    /* Every phy of the port group the HBA is attached to is a lane of the uplink, also those down */
+    if (uplink_base >= 0) {
+        for (k = uplink_base; k < uplink_base + 4; ++k) {
+            if (lane[k] >= 0) {
+                gControllers.addUplinkPhy(expander_sa, k, lane[k] ? negot[k] : 0);
+            }
+        }
+    }
     if (free_rp)
         free(free_rp);
     return ret;
@@ -1372,8 +1484,22 @@ slot_discover(int vb)
     free(namelist);
 }
 
-void
+/* PHY CONTROL: HARD RESET or DISABLE. Returns 0 on success, else as smp_send_req() */
+int
 phy_control(smp_target_obj * top, int phy_id, bool disable, int vb)
+{
+    return phy_control_rate(top, phy_id, disable ? 3 : 2, 0, 0, vb);
+}
+
+/*
+ * PHY CONTROL operation (01h: LINK RESET, 02h: HARD RESET, 03h: DISABLE)
+ * with the programmed minimum and maximum physical link rates, 0 for no
+ * change; the rates take effect on the link reset. Returns 0 on success,
+ * else as smp_send_req(), -1 on a transport error, or -4 less the function
+ * result when the expander rejects the request
+ */
+int
+phy_control_rate(smp_target_obj * top, int phy_id, int op, int min_rate, int max_rate, int vb)
 {
     int k, res;
     uint8_t smp_req[] = {
@@ -1385,10 +1511,12 @@ phy_control(smp_target_obj * top, int phy_id, bool disable, int vb)
     smp_req_resp smp_rr;
 
     smp_req[9] = phy_id;
-    smp_req[10] = disable ? 3 : 2;  // 02h: HARD RESET, 03h: DISABLE
+    smp_req[10] = op;
+    smp_req[32] = (min_rate & 0xf) << 4;    // PROGRAMMED MINIMUM PHYSICAL LINK RATE
+    smp_req[33] = (max_rate & 0xf) << 4;    // PROGRAMMED MAXIMUM PHYSICAL LINK RATE
 
     if (vb) {
-        QString msg = QString::asprintf("    Phy %s request: ", disable ? "off" : "on");
+        QString msg = QString::asprintf("    Phy %s request: ", (3 == op) ? "off" : "on");
         for (k = 0; k < (int)sizeof(smp_req); ++k) {
             if (0 == (k % 16)) {
                 qDebug() << msg;
@@ -1416,5 +1544,20 @@ phy_control(smp_target_obj * top, int phy_id, bool disable, int vb)
         qDebug("smp_send_req failed, res=%d", res);
         if (0 == vb)
             qDebug("    try adding '-v' option for more debug");
+        return res;
+    }
+    if (smp_rr.transport_err) {
+        qDebug("PHY CONTROL smp_send_req transport_error=%d", smp_rr.transport_err);
+        return -1;
+    }
+    if ((smp_rr.act_response_l >= 0) && (smp_rr.act_response_l < 4)) {
+        qDebug("PHY CONTROL response too short, len=%d", smp_rr.act_response_l);
+        return -4 - SMP_LIB_CAT_MALFORMED;
     }
+    if (SMP_FRES_FUNCTION_ACCEPTED != smp_resp[2]) {
+        char b[256];
+        qDebug("PHY CONTROL of phy %d: %s", phy_id, smp_get_func_res_str(smp_resp[2], sizeof(b), b));
+        return -4 - smp_resp[2];
+    }
+    return 0;
 }
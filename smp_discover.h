@@ -23,6 +23,11 @@ void mpt_discover(int verbose);
 void slot_discover(int verbose);
 int do_multiple(smp_target_obj * top, int verbose);
 int do_multiple_slot(smp_target_obj * top, int verbose);
-void phy_control(smp_target_obj * top, int phy_id, bool disable, int verbose);
+int phy_control(smp_target_obj * top, int phy_id, bool disable, int verbose);
+int phy_control_rate(smp_target_obj * top, int phy_id, int op, int min_rate, int max_rate, int verbose);
+int smp_function(smp_target_obj * top, uint8_t * req, int req_len, uint8_t * resp, int max_resp_len, int verbose);
+int smp_num_phys(smp_target_obj * top, int verbose);
+int smp_report_general(smp_target_obj * top, uint8_t * rp, int verbose);
+int smp_discover_phy(smp_target_obj * top, int phy_id, uint8_t * resp, int max_resp_len, int verbose);
 
 #endif // SMP_DISCOVER_H
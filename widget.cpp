@@ -1,11 +1,13 @@
 #include <QDateTime>
 #include <QElapsedTimer>
 #include <QFile>
+#include <QFileDialog>
 #include <QMessageBox>
 #include <QProcess>
 #include <QSystemTrayIcon>
 #include <QTimer>
 #include <QVBoxLayout>
+#include <algorithm>
 
 #include "ui_widget.h"
 #include "widget.h"
@@ -14,8 +16,34 @@
 #include "smp_lib.h"
 #include "smp_discover.h"
 #include "mpi3mr_app.h"
+#include "fio_result.h"
+#include "fio_matrix.h"
+#include "slot_analysis.h"
+#include "bw_model.h"
+#include "numa_affinity.h"
+#include "slot_sampler.h"
+#include "smp_batch.h"
+#include "phy_events.h"
+#include "flap_monitor.h"
+#include "multipath.h"
+#include "mpath_failover.h"
+#include "ses.h"
+#include "drive_port.h"
+#include "sg3_sweep.h"
+#include "media_scan.h"
+#include "mode_pages.h"
+#include "queue_tuning.h"
+#include "blk_latency.h"
 
 extern int verbose;
+extern int sampleHz;
+
+#define UPLINK_BOUND    0.85    // a plateau this close to the uplink theoretical is uplink-bound
+#define PHYCTL_DEADLINE_MS  10000   // phys not in the state expected by then are reported
+#define FAILOVER_DOWN_S     15      // the active path's phy is disabled this far into the run
+#define FAILOVER_UP_S       35      // and enabled again
+#define FAILOVER_RUN_S      60
+#define FAILOVER_PROBE_US   1000    // time resolution of the stall
 
 static QTabWidget * gTab = nullptr;
 static QComboBox * gCombo = nullptr;
@@ -47,6 +75,8 @@ void DeviceFunc::clrSlot(int sl, bool uncheck)
         SlotInfo[sl].d_name.clear();
         SlotInfo[sl].wwid.clear();
         SlotInfo[sl].block.clear();
+        SlotInfo[sl].mpath.clear();
+        SlotInfo[sl].blklat.clear();
         SlotInfo[sl].resp_len = 0;
 
         // decrement the slot count
@@ -56,8 +86,8 @@ void DeviceFunc::clrSlot(int sl, bool uncheck)
 
 void DeviceFunc::setSlot(QString dir_name, QString device, int sl)
 {
-    // validate the index passed
-    if (sl == valiIndex(sl)) {
+    // validate the index passed, the other port of a dual-ported drive is left to the multipath scan
+    if (sl == valiIndex(sl) && SlotInfo[sl].d_name.isEmpty()) {
         // Get wwid of this device (some BMC exposed "Virtual" devices does not have wwid attribute)
         QString wwid, wd = dir_name.append("/%1").arg(device);
         if (get_myValue(wd, "wwid", wwid) && !wwid.isEmpty()) {
@@ -67,12 +97,18 @@ void DeviceFunc::setSlot(QString dir_name, QString device, int sl)
             // Set slot occupied by something
             SlotInfo[sl].d_name = device;
 
+            // Get model of this device for grouping the alike drives
+            QString model;
+            get_myValue(wd, "model", model);
+            SlotInfo[sl].model = model.trimmed();
+
             // Get block name of this device
             wd += "/block";
             SlotInfo[sl].block = get_blockname(wd);
 
             SlotInfo[sl].cb_slot->setEnabled(true);
             setSlotLabel(sl);
+            keepSlotPerf(sl);
             myCount++;
         }
     }
@@ -91,7 +127,7 @@ void DeviceFunc::setSlot(QString dir_name, QString device, QString expander, uin
     setSlot(dir_name, device, sl);
 }
 
-void DeviceFunc::setSlot(int slp, QString d_name, QString wwid, QString block)
+void DeviceFunc::setSlot(int slp, QString d_name, QString wwid, QString block, QString model)
 {
     // the device should be within this expander's domain
     if (slp <= 0 || slp > NSLOT) {
@@ -101,6 +137,14 @@ void DeviceFunc::setSlot(int slp, QString d_name, QString wwid, QString block)
 
     // validate the index passed
     int sl = valiIndex(slp - 1);
+
+    // the other port of a dual-ported drive reported in the same slot is left to the multipath scan
+    if (false == SlotInfo[sl].d_name.isEmpty()) {
+        if (verbose) {
+            qDebug() << "Device [" << d_name << "] in slot " << slp << " taken by [" << SlotInfo[sl].d_name << "]";
+        }
+        return;
+    }
     {
         // Set slot occupied by something
         SlotInfo[sl].d_name = d_name;
@@ -111,12 +155,122 @@ void DeviceFunc::setSlot(int slp, QString d_name, QString wwid, QString block)
         // Get block name of this device
         SlotInfo[sl].block = block;
 
+        // Get model of this device for grouping the alike drives
+        SlotInfo[sl].model = model;
+
         SlotInfo[sl].cb_slot->setEnabled(true);
         setSlotLabel(sl);
+        keepSlotPerf(sl);
         myCount++;
     }
 }
 
+/*
+ * Measurements survive a refresh as long as the same device stays in the slot
+ */
+void DeviceFunc::keepSlotPerf(int sl)
+{
+    if (SlotInfo[sl].perf_wwid != SlotInfo[sl].wwid) {
+        SlotInfo[sl].perf_wwid = SlotInfo[sl].wwid;
+        SlotInfo[sl].perf = _ST_SLOTPERF();
+        SlotInfo[sl].solo = _ST_SLOTPERF();
+        SlotInfo[sl].flags = 0;
+    }
+    setSlotStyle(sl);
+}
+
+void DeviceFunc::setSlotPerf(int sl, const _ST_SLOTPERF & perf)
+{
+    // validate the index passed
+    if (sl == valiIndex(sl) && false == slotVacant(sl)) {
+        SlotInfo[sl].perf_wwid = SlotInfo[sl].wwid;
+        SlotInfo[sl].perf = perf;
+        if (1 == perf.njobs) {
+            SlotInfo[sl].solo = perf;
+        }
+        setSlotStyle(sl);
+    }
+}
+
+void DeviceFunc::setSlotFlags(int sl, int flags)
+{
+    // validate the index passed
+    if (sl == valiIndex(sl)) {
+        SlotInfo[sl].flags = flags;
+        setSlotStyle(sl);
+    }
+}
+
+void DeviceFunc::setSlotHeat(int sl, const QString & color, const QString & live)
+{
+    // validate the index passed
+    if (sl == valiIndex(sl)) {
+        SlotInfo[sl].heat = color;
+        SlotInfo[sl].live = live;
+        setSlotStyle(sl);
+    }
+}
+
+void DeviceFunc::setSlotTip(int sl, const QString & live)
+{
+    // validate the index passed
+    if (sl == valiIndex(sl)) {
+        SlotInfo[sl].live = live;
+        setSlotToolTip(sl);
+    }
+}
+
+void DeviceFunc::setSlotMpath(int sl, const QString & mpath)
+{
+    // validate the index passed
+    if (sl == valiIndex(sl)) {
+        SlotInfo[sl].mpath = mpath;
+        setSlotToolTip(sl);
+    }
+}
+
+void DeviceFunc::setSlotBlkLat(int sl, const QString & blklat)
+{
+    // validate the index passed
+    if (sl == valiIndex(sl)) {
+        SlotInfo[sl].blklat = blklat;
+        setSlotToolTip(sl);
+    }
+}
+
+void DeviceFunc::setSlotToolTip(int sl)
+{
+    const _ST_SLOTPERF & perf = SlotInfo[sl].perf;
+    QString tip = SlotInfo[sl].live;
+    if (false == SlotInfo[sl].blklat.isEmpty()) {
+        tip.append((tip.isEmpty() ? "" : "\n") + SlotInfo[sl].blklat);
+    }
+    if (false == SlotInfo[sl].mpath.isEmpty()) {
+        tip.prepend(SlotInfo[sl].mpath + (tip.isEmpty() ? "" : "\n"));
+    }
+    if (perf.njobs > 0) {
+        tip.prepend(QString::asprintf("%s: %.1f MiB/s, %.0f IOPS, lat %.0f us, p99 %.0f us",
+            perf.workload.toStdString().c_str(), perf.bw_kbs / 1024, perf.iops, perf.lat_us, perf.p99_us)
+            + (tip.isEmpty() ? "" : "\n"));
+    }
+    SlotInfo[sl].cb_slot->setToolTip(tip);
+}
+
+void DeviceFunc::setSlotStyle(int sl)
+{
+    setSlotToolTip(sl);
+
+    // flagged slots are highlighted, whereas a disabled phy (red) is left as it is
+    if (SlotInfo[sl].resp_len > 13 && 1 == (SlotInfo[sl].discover_resp[13] & 0xf)) {
+        return;
+    }
+    QString color = SlotInfo[sl].flags ? "color: #d35400; font-weight: bold;" : "color: black;";
+    if (false == SlotInfo[sl].heat.isEmpty()) {
+        color += " background-color: " + SlotInfo[sl].heat + ";";
+    }
+    SlotInfo[sl].cb_slot->setStyleSheet(QString("QCheckBox:enabled{%1} QCheckBox:disabled{color: grey;}").arg(color));
+}
+
 void DeviceFunc::setDiscoverResp(int dsn, uchar * src, int len)
 {
     int sl = dsn - 1;
@@ -193,6 +347,9 @@ void ExpanderFunc::clear()
         GboxInfo[i].bsg_path.clear();
         GboxInfo[i].wwid64 = 0;;
         GboxInfo[i].resp_len = 0;
+        GboxInfo[i].uplink_lanes = 0;
+        GboxInfo[i].uplink_down = 0;
+        GboxInfo[i].uplink_mbps = 0;
     }
     myCount = 0;
 }
@@ -227,21 +384,30 @@ void ExpanderFunc::setDiscoverResp(QString path, uint64_t ull, uint64_t sa, ucha
     memcpy(GboxInfo[el].discover_resp, src, SMP_FN_DISCOVER_RESP_LEN);
     GboxInfo[el].resp_len = len;
 
-    const char* cp = "";
-    if (len > 13) {
-        int negot = src[13] & 0xf;
-        if (negot == 0x8) cp = "1.5";
-        if (negot == 0x9) cp = "3";
-        if (negot == 0xa) cp = "6";
-        if (negot == 0xb) cp = "12";
-        if (negot == 0xc) cp = "22.5";
-    }
+    const char* cp = (len > 13) ? linkrate_str(src[13] & 0xf) : "";
 
     QString title = GboxInfo[el].gbox->title();
     GboxInfo[el].gbox->setTitle(
         title.append(QString::asprintf(" [HBA:%lX/%s Gbps]", sa, cp)));
 }
 
+/*
+ * A lane of the expander's wide port uplink, negot is the negotiated link
+ * rate of the phy; a lane down is counted and marked, it adds no bandwidth
+ */
+void ExpanderFunc::addUplinkPhy(uint64_t ull, int phy_id, int negot)
+{
+    int el = WWID_TO_INDEX(ull);
+    int mbps = linkrate_mbps(negot);
+
+    GboxInfo[el].uplink_lanes++;
+    GboxInfo[el].uplink_mbps += mbps;
+    if (0 == mbps) {
+        GboxInfo[el].uplink_down++;
+        gAppendMessage(QString::asprintf("Warning: Expander-%d uplink phy %d is down", el + 1, phy_id));
+    }
+}
+
 Widget::Widget(QWidget *parent)
     : QWidget(parent)
     , ui(new Ui::Widget)
@@ -298,6 +464,8 @@ Widget::Widget(QWidget *parent)
     connect(ui->btnListSdx, &QPushButton::clicked, this, &Widget::btnListSdxClicked);
     connect(ui->btnSmpDoit, &QPushButton::clicked, this, &Widget::btnSmpDoitClicked);
     connect(ui->btnFio2Go, &QPushButton::clicked, this, &Widget::btnFio2GoClicked);
+    connect(ui->btnMatrix, &QPushButton::clicked, this, &Widget::btnMatrixClicked);
+    connect(ui->btnSg3Go, &QPushButton::clicked, this, &Widget::btnSg3GoClicked);
     connect(ui->btnClearTB, &QPushButton::clicked, this, &Widget::btnClearTBClicked);
     connect(ui->tabWidget, &QTabWidget::currentChanged, this, &Widget::tabSelected);
 
@@ -320,18 +488,41 @@ Widget::Widget(QWidget *parent)
     gText = ui->textBrowser;
 
     ui->progress_afio->hide();
+    ui->cbxModeProfile->addItems(mode_profile_names());
+    for (QComboBox * cbx : { ui->cbxTuning, ui->cbxTuning2 }) {
+        cbx->addItem("(kernel)");
+        cbx->addItems(queue_profile_names());
+    }
     ///ui->radDiscover->hide();    // temporarily hide for release
 
+    m_sampler = new SlotSampler;
+    m_flaps = new FlapMonitor;
+    m_scan = new MediaScan;
+    m_blklat = new BlkLatTracer;
+
     appendMessage("Here lists the messages:");
     filloutCanvas();
 }
 
+void Widget::closeEvent(QCloseEvent *event)
+{
+    qDebug() << "Close button is pressed!!";
+    m_closed++;
+    // a mode profile still applied is not left on the drives, done while the window is still whole
+    mode_rollback(verbose);
+    QWidget::closeEvent(event);
+}
+
 Widget::~Widget()
 {
     delete ui;
     delete m_layout;
     delete m_trayIcon;
     delete m_Watcher;
+    delete m_sampler;
+    delete m_flaps;
+    delete m_scan;
+    delete m_blklat;
 }
 
 void Widget::appendMessage(QString message)
@@ -406,84 +597,6 @@ void Widget::sdxlist_sit(QTextStream & stream, int sl)
     }
 }
 
-void Widget::sdxlist_wl1(QTextStream & stream, int sl)
-{
-    stream << "[global]"        << Qt::endl
-           << "bs=4K"           << Qt::endl
-           << "#numjobs=1"      << Qt::endl
-           << "iodepth=8"       << Qt::endl
-           << "direct=1"        << Qt::endl
-           << "ioengine=libaio" << Qt::endl
-           << "#group_reporting=0" << Qt::endl
-           << "time_based"      << Qt::endl
-           << "ramp_time=30"    << Qt::endl
-           << "runtime=120"     << Qt::endl
-           << "name=Workload 1" << Qt::endl
-           << "rw=randread"     << Qt::endl << Qt::endl;
-
-    int jobn = 0;
-
-    // loop through the expanders discovered
-    for (int k = 0; k < NEXPDR; ++k) {
-        stream << "## Expander-" << k+1 << Qt::endl;
-        if (false == gControllers.bsgPath(k).isEmpty()) {
-            // Workload 1
-            for (int i = k*NSLOT_PEREXP; i < (k+1)*NSLOT_PEREXP; ++i) {
-                // check if this slot is occupied?
-                if (false == gDevices.slotVacant(i)) {
-                    stream << "[job" << ++jobn << "]" << Qt::endl
-                           << "filename=/dev/" << gDevices.block(i) << Qt::endl;
-                    // check if this slot is the target?
-                    if ((i == sl) || ((-1 == sl) && gDevices.cbSlot(i)->isChecked())) {
-                        stream << "bs=512k" << Qt::endl
-                               << "rw=write" << Qt::endl;
-                    }
-                    stream << Qt::endl;
-                }
-            }
-        }
-    }
-}
-
-void Widget::sdxlist_wl2(QTextStream & stream, int sl)
-{
-    stream << "[global]"        << Qt::endl
-           << "bs=4K"           << Qt::endl
-           << "#numjobs=1"      << Qt::endl
-           << "iodepth=8"       << Qt::endl
-           << "direct=1"        << Qt::endl
-           << "ioengine=libaio" << Qt::endl
-           << "#group_reporting=0" << Qt::endl
-           << "time_based"      << Qt::endl
-           << "ramp_time=30"    << Qt::endl
-           << "runtime=120"     << Qt::endl
-           << "name=Workload 2" << Qt::endl
-           << "rw=randread"     << Qt::endl << Qt::endl;
-
-    int jobn = 0;
-
-    // loop through the expanders discovered
-    for (int k = 0; k < NEXPDR; ++k) {
-        stream << "## Expander-" << k+1 << Qt::endl;
-        if (false == gControllers.bsgPath(k).isEmpty()) {
-            // Workload 2
-            for (int i = k*NSLOT_PEREXP; i < (k+1)*NSLOT_PEREXP; ++i) {
-                // check if this slot is occupied?
-                if (false == gDevices.slotVacant(i)) {
-                    stream << "[job" << ++jobn << "]" << Qt::endl
-                           << "filename=/dev/" << gDevices.block(i) << Qt::endl;
-                    // check if this slot is the target?
-                    if ((i == sl) || ((-1 == sl) && gDevices.cbSlot(i)->isChecked())) {
-                        stream << "bs=4k" << Qt::endl
-                               << "rw=randwrite" << Qt::endl;
-                    }
-                    stream << Qt::endl;
-                }
-            }
-        }
-    }
-}
-
 /*
  * Use resultReady signal needs one more QCoreApplication::processEvents call after workerThread->isFinished,
  * So a member m_errMsg is created and used for message passing between threads
@@ -587,105 +700,587 @@ void Widget::autofio_wls(int wl)
 
         QCheckBox * cbfd[] = { ui->cb_fd50, ui->cb_fd60, ui->cb_fd70, ui->cb_fd80, ui->cb_fd90, ui->cb_fd100 };
         QString fd[] = { "50", "60", "70", "80", "90", "100" };
+
+        // every checked slot is the target of its own point, fan duty 50% -> 100%
+        _ST_FIOMATRIX mx = fio_matrix_preset(wl);
+        mx.targets = ENUM_TARGETSET::TGT_EACH;
+        mx.pause = ui->spinAfwl->value();
+        mx.tuning = (ui->cbxTuning->currentIndex() > 0) ? ui->cbxTuning->currentText() : QString();
         for (int l = 0; l < sizeof(cbfd)/sizeof(cbfd[0]); ++l) {
             cbfd[l]->setEnabled(false);
+            if (cbfd[l]->isChecked()) {
+                mx.fan << fd[l];
+            }
         }
-
-        int loops = 0;
-        if (ui->cb_fd100->isChecked()) loops++;
-        if (ui->cb_fd90->isChecked()) loops++;
-        if (ui->cb_fd80->isChecked()) loops++;
-        if (ui->cb_fd70->isChecked()) loops++;
-        if (ui->cb_fd60->isChecked()) loops++;
-        if (ui->cb_fd50->isChecked()) loops++;
-        if (loops == 0) {
+        if (mx.fan.isEmpty()) {
             ui->cb_fd100->setChecked(true);
-            loops = 1;
+            mx.fan << "100";
         }
 
         try {
-            int devCount = 0;
-            for (int i = 0; i < NSLOT; i++) {
-                if (false == gDevices.slotVacant(i) && true == gDevices.cbSlot(i)->isChecked()) {
-                    ++devCount;
+            runMatrix(mx);
+
+        } catch (QString errMsg) {
+            appendMessage(errMsg);
+        }
+
+        for (int l = 0; l < sizeof(cbfd)/sizeof(cbfd[0]); ++l) {
+            cbfd[l]->setEnabled(true);
+        }
+    }
+
+    // Modal QMessageBox greys out the tab page, repaint the tab widget
+    ui->tabWidget->repaint();
+}
+
+/*
+ * The slots are sampled live while fio runs, with the results in JSON
+ * appended to the normal output for the analysis afterwards
+ */
+void Widget::runFio(const QString & fio, const QString & out, int progress_maxms)
+{
+    QStringList arguments;
+    arguments << fio << "--output-format=normal,json" << "--output" << out;
+
+    m_sampler->start(sampleHz);
+    try {
+        startWorkInAThread("fio", arguments, progress_maxms);
+    } catch (...) {
+        m_sampler->stop();
+        throw;
+    }
+    m_sampler->stop();
+}
+
+/*
+ * Pull the per-slot numbers out of a fio run and look for the slow drives
+ */
+void Widget::fioAnalyze(const QVector<_ST_FIOJOB> & jobs)
+{
+    int applied = fio_apply_results(jobs);
+    if (verbose) {
+        qDebug("%s: %d jobs parsed, %d slots updated", __func__, (int)jobs.size(), applied);
+    }
+    if (applied > 0) {
+        slot_outlier_scan(verbose);
+    }
+}
+
+/*
+ * Run the plan of a workload matrix: one fio invocation per run, the fans set
+ * before each run of a new duty and the targets capped before each run of a
+ * new link rate, each point of a run analyzed and recorded on its own
+ * reporting group. The slots take the block queue profile of the matrix
+ * first. The link rates and queue settings are restored at the end, also
+ * when a run fails or is cancelled.
+ */
+void Widget::runMatrix(const _ST_FIOMATRIX & mx)
+{
+    QVector<QVector<_ST_FIOPOINT>> plan = fio_matrix_plan(mx);
+    if (plan.isEmpty()) {
+        throw QString("No device selected to test!");
+    }
+    int points = 0;
+    for (const QVector<_ST_FIOPOINT> & run : plan) {
+        points += run.size();
+    }
+
+    QString fan, linkrate;
+    QString name = mx.name;
+    name.replace(' ', '_');
+    int processed = 0;
+
+    // the link rates of the targets as they were, put back when done
+    QVector<_ST_PHYLINK> saved[NEXPDR];
+    QVector<int> capped, rate_up;
+    if (false == mx.linkrate.isEmpty()) {
+        for (const QVector<_ST_FIOPOINT> & run : plan) {
+            for (const _ST_FIOPOINT & pt : run) {
+                for (int sl : pt.slots) {
+                    if (false == capped.contains(sl)) {
+                        capped.append(sl);
+                    }
                 }
             }
-            if (0 == devCount) {
-                throw QString("No device selected to test!");
+        }
+        smp_discover_all(saved, verbose);
+    }
+
+    // the block queue settings of every slot in the runs, put back when done
+    QVector<_ST_QUEUEPARAM> queue;
+    QMap<int, QString> queue_set;
+    if (false == mx.tuning.isEmpty()) {
+        QVector<int> tuned;
+        for (const QVector<_ST_FIOPOINT> & run : plan) {
+            for (const _ST_FIOPOINT & pt : run) {
+                for (int sl : pt.slots + pt.bg) {
+                    if (false == tuned.contains(sl)) {
+                        tuned.append(sl);
+                    }
+                }
+            }
+        }
+        appendMessage("Queue profile " + mx.tuning + ": " + queue_profile_desc(mx.tuning));
+        queue_tuning_apply(tuned, mx.tuning, queue, queue_set, verbose);
+    }
+    auto restore = [&]() {
+        if (false == capped.isEmpty()) {
+            appendMessage("Restore link rates...");
+            smp_link_rate_restore(capped, saved, PHYCTL_DEADLINE_MS, verbose);
+        }
+        if (false == queue.isEmpty()) {
+            appendMessage("Restore queue settings...");
+            queue_tuning_restore(queue, verbose);
+        }
+    };
+
+    // a run cancelled or failed leaves nothing changed behind either
+    bool traced = false;
+    try {
+        for (int r = 0; r < plan.size(); ++r) {
+            QVector<_ST_FIOPOINT> run = plan[r];
+
+            // ipmitool sets fan duty to 50%, 60%, ...
+            if (false == run[0].fan.isEmpty() && fan != run[0].fan) {
+                setFanDuty(fan = run[0].fan);
+            }
+            // PHY CONTROL caps the targets at 12G, 6G, ..., verified by DISCOVER
+            if (false == run[0].linkrate.isEmpty() && linkrate != run[0].linkrate) {
+                linkrate = run[0].linkrate;
+                appendMessage("Link rate capped at " + linkrate + " Gbps...");
+                smp_link_rate_apply(capped, linkrate_code(linkrate), saved, rate_up, PHYCTL_DEADLINE_MS, verbose);
+                if (rate_up.size() < capped.size()) {
+                    appendMessage(QString::asprintf("%d of %d links up at the rate, the others are left out at %s Gbps",
+                                                    (int)rate_up.size(), (int)capped.size(), linkrate.toStdString().c_str()));
+                }
+            }
+            // only the slots verified at the rate are measured, a point left with none is skipped
+            if (false == run[0].linkrate.isEmpty() && rate_up.size() < capped.size()) {
+                int planned = run.size();
+                for (int g = run.size() - 1; g >= 0; --g) {
+                    run[g].slots.erase(std::remove_if(run[g].slots.begin(), run[g].slots.end(),
+                                                      [&](int sl) { return false == rate_up.contains(sl); }),
+                                       run[g].slots.end());
+                    if (run[g].slots.isEmpty()) {
+                        run.remove(g);
+                    }
+                }
+                if (run.isEmpty()) {
+                    processed += planned;
+                    continue;
+                }
+                processed += planned - run.size();
+            }
+            // check if pause time need to insert between tests
+            if (r > 0) {
+                pauseBar(mx.pause * 1000);
+            }
+
+            // Size iodepth and jobs from the topology
+            QVector<_ST_BWMODEL> models(run.size());
+            for (int g = 0; g < run.size(); ++g) {
+                bw_model_build(models[g], run[g].rw, run[g].bs, run[g].slots, verbose);
+                if (mx.autosize && models[g].iodepth > 0) {
+                    run[g].iodepth = models[g].iodepth;
+                    run[g].numjobs = models[g].numjobs;
+                    appendMessage(QString::asprintf("Auto-sized %s iodepth=%d numjobs=%d, predicted %.1f MB/s",
+                                                    models[g].workload.toStdString().c_str(),
+                                                    models[g].iodepth, models[g].numjobs, models[g].total_mbs));
+                    if (false == models[g].basis.isEmpty()) {
+                        appendMessage("  " + models[g].basis);
+                    }
+                }
+            }
+
+            QDateTime date(QDateTime::currentDateTime());
+            QString time = date.toString("_yyyyMMdd_hhmmss");
+            QString head = name + (fan.isEmpty() ? "" : "_fd" + fan) + (linkrate.isEmpty() ? "" : "_lr" + linkrate) + time;
+            QString fio = head + ".fio";
+            QString out = head + ".txt";
+            processed += run.size();
+            appendMessage(fio + "  -->  " + out + QString::asprintf(" (%d/%d)", processed, points));
+
+            QFile file(fio);
+            if (false == file.open(QIODevice::WriteOnly | QIODevice::Text)) {
+                throw QString("FIO script failed to open for write!");
+            }
+
+            // We're going to streaming text to the file
+            QTextStream stream(&file);
+            fio_write_jobfile(stream, mx, run);
+            file.close();
+
+            // Execute FIO test between snapshots of the phy error counters
+            _ST_ERRSNAPSHOT before, after;
+            bool errlog = smp_errlog_snapshot(before, verbose) > 0;
+            // and of the drive end of each link
+            _ST_DRVSNAPSHOT drv_before, drv_after;
+            bool drvlog = drive_port_snapshot(drv_before, verbose) > 0;
+            // and the phy event counters sampled about 24 times over the run
+            PhyEventMonitor events;
+            bool monitored = ui->cbPhyEvents->isChecked() && events.begin(qMax(1000, fio_run_seconds(mx, run) * 1000 / 24), verbose);
+            // and the block layer latency of every slot in the run
+            traced = false;
+            if (ui->cbBlkLat->isChecked() && false == m_blklat->isRunning()) {
+                QVector<int> slots;
+                for (const _ST_FIOPOINT & pt : run) {
+                    slots += pt.slots + pt.bg;
+                }
+                traced = m_blklat->begin(slots, verbose);
+            }
+            runFio(fio, out, fio_run_seconds(mx, run) * 1000);
+            events.end();
+            if (traced) {
+                m_blklat->end();
+            }
+
+            QVector<_ST_FIOJOB> jobs = fio_parse_output(out);
+            for (int g = 0; g < run.size(); ++g) {
+                QVector<_ST_FIOJOB> group = fio_group_jobs(jobs, g);
+                fioAnalyze(group);
+                if (mx.autosize) {
+                    bw_model_report(models[g], group);
+                }
+                fio_record_run(out, mx, g, run[g], group, queue_set);
             }
+            if (errlog && smp_errlog_snapshot(after, verbose) > 0) {
+                smp_errlog_report(before, after);
+            }
+            if (drvlog && drive_port_snapshot(drv_after, verbose) > 0) {
+                drive_port_report(drv_before, drv_after, before, after);
+            }
+            if (monitored) {
+                events.report(head + "_phyevents.csv");
+            }
+            if (traced) {
+                m_blklat->report();
+            }
+        }
+    } catch (...) {
+        if (traced) {
+            m_blklat->end();
+        }
+        restore();
+        throw;
+    }
+    restore();
+    // Test is over!
+    appendMessage("Batch test is completed!");
+}
+
+/*
+ * Path balance: sequential reads on the multipath devices of the checked
+ * slots, all at once, with the sectors moved on each path sampled around
+ * the run, to see whether the I/O is spread over both expanders.
+ */
+void Widget::mpathBalance()
+{
+    QStringList devices;
+    for (const _ST_MPATH & mp : mpath_groups()) {
+        for (int sl : mp.slots) {
+            if (sl >= 0 && gDevices.cbSlot(sl)->isChecked() && false == mp.dm.isEmpty()) {
+                devices << mp.dm;
+                break;
+            }
+        }
+    }
+
+    try {
+        if (devices.isEmpty()) {
+            throw QString("No multipath device among the slots selected!");
+        }
+
+        QDateTime date(QDateTime::currentDateTime());
+        QString time = date.toString("_yyyyMMdd_hhmmss");
+        QString fio = "mpath" + time + ".fio";
+        QString out = "mpath" + time + ".txt";
+        QFile file(fio);
+        if (false == file.open(QIODevice::WriteOnly | QIODevice::Text)) {
+            throw QString("FIO script failed to open for write!");
+        }
+        QTextStream stream(&file);
+        stream << "[global]"        << Qt::endl
+               << "bs=128k"         << Qt::endl
+               << "iodepth=32"      << Qt::endl
+               << "direct=1"        << Qt::endl
+               << "ioengine=libaio" << Qt::endl
+               << "time_based"      << Qt::endl
+               << "runtime=30"      << Qt::endl
+               << "name=Path Balance" << Qt::endl
+               << "rw=read"         << Qt::endl << Qt::endl;
+        for (const QString & dm : devices) {
+            stream << "[" << dm << "]" << Qt::endl
+                   << "filename=/dev/" << dm << Qt::endl << Qt::endl;
+        }
+        file.close();
+        appendMessage(QString::asprintf("Path balance over %d multipath devices: ", (int)devices.size()) + fio + "  -->  " + out);
+
+        QMap<QString, quint64> before = mpath_sectors();
+        QElapsedTimer clock;
+        clock.start();
+        runFio(fio, out, 30 * 1000);
+        double seconds = clock.elapsed() / 1000.0;
+        QMap<QString, quint64> after = mpath_sectors();
+
+        QFile csv("mpath" + time + ".csv");
+        if (false == csv.open(QIODevice::WriteOnly | QIODevice::Text)) {
+            throw QString("Path balance result failed to open for write!");
+        }
+        QTextStream result(&csv);
+        mpath_balance_report(before, after, seconds, result);
+        csv.close();
+        appendMessage("Path balance is completed! Results in " + csv.fileName());
+
+    } catch (QString errMsg) {
+        appendMessage(errMsg);
+    }
+}
+
+/*
+ * Failover: a steady 4k random read on each multipath device of the checked
+ * slots in turn; the phy of the path carrying the IO is disabled by SMP while
+ * the workload runs and enabled again, with the device and its paths sampled
+ * at a high rate for the stall, the dip and the failback.
+ */
+void Widget::mpathFailover()
+{
+    QVector<_ST_MPATH> devices;
+    for (const _ST_MPATH & mp : mpath_groups()) {
+        for (int sl : mp.slots) {
+            if (sl >= 0 && gDevices.cbSlot(sl)->isChecked() && false == mp.dm.isEmpty()) {
+                devices << mp;
+                break;
+            }
+        }
+    }
+
+    try {
+        if (devices.isEmpty()) {
+            throw QString("No multipath device among the slots selected!");
+        }
+
+        QDateTime date(QDateTime::currentDateTime());
+        QString time = date.toString("_yyyyMMdd_hhmmss");
+        QFile csv("failover" + time + ".csv");
+        if (false == csv.open(QIODevice::WriteOnly | QIODevice::Text)) {
+            throw QString("Failover result failed to open for write!");
+        }
+        QTextStream result(&csv);
+        result << "device,path,slot,baseline_IOPS,stall_ms,dip_IOPS,recovered_ms,failback_ms,failback_stall_ms" << Qt::endl;
+
+        for (int d = 0; d < devices.size(); ++d) {
+            const _ST_MPATH & mp = devices[d];
+            if (d > 0) {
+                pauseBar(ui->spinAfwl->value() * 1000);
+            }
+
+            QString fio = "failover_" + mp.name + time + ".fio";
+            QString out = "failover_" + mp.name + time + ".txt";
+            QFile file(fio);
+            if (false == file.open(QIODevice::WriteOnly | QIODevice::Text)) {
+                throw QString("FIO script failed to open for write!");
+            }
+            QTextStream stream(&file);
+            stream << "[" << mp.name << "]" << Qt::endl
+                   << "filename=/dev/" << mp.dm << Qt::endl
+                   << "rw=randread"     << Qt::endl
+                   << "bs=4k"           << Qt::endl
+                   << "iodepth=32"      << Qt::endl
+                   << "direct=1"        << Qt::endl
+                   << "ioengine=libaio" << Qt::endl
+                   << "time_based"      << Qt::endl
+                   << "runtime=" << FAILOVER_RUN_S << Qt::endl;
+            file.close();
+            appendMessage(QString("Failover of ") + mp.name + " (" + mp.dm + "): " + fio + "  -->  " + out);
+
+            FailoverProbe probe;
+            if (false == probe.begin(mp, FAILOVER_PROBE_US)) {
+                appendMessage("  " + mp.dm + " statistics failed to open");
+                continue;
+            }
+
+            // the phy of the active path goes down and comes up while fio runs
+            QVector<_ST_PHYCTL> ops[NEXPDR];
+            int path = -1, k = 0;
+            qint64 down_us = -1, up_us = -1;
+            QTimer down, up;
+            down.setSingleShot(true);
+            up.setSingleShot(true);
+            QObject::connect(&down, &QTimer::timeout, [&]() {
+                path = probe.busiest_path(1000);
+                int sl = mp.slots[path];
+                if (sl < 0 || gDevices.slotPhyId(sl) < 0) {
+                    appendMessage("  the active path " + mp.blocks[path] + " is not in a slot, left alone");
+                    path = -1;
+                    return;
+                }
+                k = sl / NSLOT_PEREXP;
+                _ST_PHYCTL op = { gDevices.slotPhyId(sl), sl, true };
+                ops[k] = { op };
+                down_us = probe.elapsed_us();
+                smp_phy_control_batch(ops, PHYCTL_DEADLINE_MS, verbose);
+                smp_phy_control_report(ops);
+            });
+            QObject::connect(&up, &QTimer::timeout, [&]() {
+                if (path >= 0) {
+                    ops[k][0].disable = false;
+                    up_us = probe.elapsed_us();
+                    smp_phy_control_batch(ops, PHYCTL_DEADLINE_MS, verbose);
+                    smp_phy_control_report(ops);
+                }
+            });
+            // fio gone early or failed, the phy is not left disabled
+            auto reenable = [&]() {
+                down.stop();
+                up.stop();
+                if (path >= 0 && up_us < 0) {
+                    up_us = probe.elapsed_us();
+                    ops[k][0].disable = false;
+                    smp_phy_control_batch(ops, PHYCTL_DEADLINE_MS, verbose);
+                    smp_phy_control_report(ops);
+                }
+            };
+            down.start(FAILOVER_DOWN_S * 1000);
+            up.start(FAILOVER_UP_S * 1000);
+
+            try {
+                runFio(fio, out, FAILOVER_RUN_S * 1000);
+            } catch (...) {
+                reenable();
+                probe.end();
+                throw;
+            }
+            reenable();
+            probe.end();
+
+            if (path >= 0) {
+                probe.report(path, down_us, up_us, result);
+            }
+        }
+        csv.close();
+        appendMessage("Failover test is completed! Results in " + csv.fileName());
+
+    } catch (QString errMsg) {
+        appendMessage(errMsg);
+    }
+}
+
+/*
+ * Uplink saturation ramp: sequential reads on 1, 2, ... N drives of an expander
+ * at a time; the aggregate stops scaling at the knee, which is compared to the
+ * theoretical bandwidth of the wide port lanes up between the expander and HBA.
+ */
+void Widget::rampTest()
+{
+    QMessageBox msgBox(this);
+    msgBox.setIconPixmap(QPixmap(":/listsdx_48.png"));
+    msgBox.setText("Uplink Ramp (128k SeqR)");
+    msgBox.setStandardButtons(QMessageBox::Cancel | QMessageBox::Ok);
+
+    if (QMessageBox::Ok == msgBox.exec()) {
+
+        QDateTime date(QDateTime::currentDateTime());
+        QString time = date.toString("_yyyyMMdd_hhmmss");
+        QFile csv("ramp" + time + ".csv");
+
+        try {
+            if (false == csv.open(QIODevice::WriteOnly | QIODevice::Text)) {
+                throw QString("Ramp result failed to open for write!");
+            }
+            QTextStream result(&csv);
+            result << "expander,drives,agg_MBps,uplink_lanes,uplink_MBps" << Qt::endl;
 
             bool tested = false;
-            int processed = 0;
-
-            // loop through fan duty 50% -> 100%
-            for (int l = 0; l < sizeof(cbfd)/sizeof(cbfd[0]); ++l) {
-
-                // check if this fan duty is to loop
-                if (cbfd[l]->isChecked()) {
-                    // ipmitool sets fan duty to 50%, 60%, ...
-                    setFanDuty(fd[l]);
-
-                    // loop through the expanders discovered
-                    for (int k = 0; k < NEXPDR; ++k) {
-                        appendMessage(QString::asprintf("## Expander-%d", k+1));
-                        if (false == gControllers.bsgPath(k).isEmpty()) {
-                            // Workload 1
-                            for (int i = k*NSLOT_PEREXP; i < (k+1)*NSLOT_PEREXP; ++i) {
-                                // check if this slot is occupied?
-                                if (false == gDevices.slotVacant(i) && true == gDevices.cbSlot(i)->isChecked()) {
-
-                                    // check if pause time need to insert between tests
-                                    if (tested) {
-                                        pauseBar(ui->spinAfwl->value() * 1000);
-                                    }
-                                    tested = true;
-
-                                    QDateTime date(QDateTime::currentDateTime());
-                                    QString time = date.toString("_yyyyMMdd_hhmmss");
-                                    QString head = (1 == wl) ? "512k_SeqW_" : "4k_RandW_";
-                                    QString sln = QString::asprintf("_sl%03d_", i + 1);
-                                    QString fio = head + fd[l] + sln + gDevices.block(i) + time + ".fio";
-                                    QString out = head + fd[l] + sln + gDevices.block(i) + time + ".txt";
-                                    QString msg = fio + "  -->  " + out + QString::asprintf(" (%d/%d)", ++processed, loops * devCount);
-                                    appendMessage(msg);
-
-                                    QFile file(fio);
-                                    if (false == file.open(QIODevice::WriteOnly | QIODevice::Text)) {
-                                        throw QString("FIO script failed to open for write!");
-                                    }
-
-                                    // We're going to streaming text to the file
-                                    QTextStream stream(&file);
-
-                                    // Do the listing
-                                    (1 == wl) ? sdxlist_wl1(stream, i) : sdxlist_wl2(stream, i);
-
-                                    // Close the script file
-                                    file.close();
-
-                                    // Execute FIO test
-                                    QStringList arguments;
-                                    arguments << fio << "--output" << out;
-                                    startWorkInAThread("fio", arguments, 150 * 1000);
-
-                                    // Finally, remove the script file
-                                    file.remove();
-                                }
-                            }
+            for (int k = 0; k < NEXPDR; ++k) {
+                if (true == gControllers.bsgPath(k).isEmpty()) {
+                    continue;
+                }
+                QVector<int> slots;
+                for (int i = k*NSLOT_PEREXP; i < (k+1)*NSLOT_PEREXP; ++i) {
+                    if (false == gDevices.slotVacant(i) && true == gDevices.cbSlot(i)->isChecked()) {
+                        slots.append(i);
+                    }
+                }
+                if (slots.isEmpty()) {
+                    continue;
+                }
+                int uplink = gControllers.uplinkMBps(k);
+                appendMessage(QString::asprintf("## Expander-%d: %d drives, uplink %d lanes (%d down) = %d MB/s",
+                                                k+1, (int)slots.size(), gControllers.uplinkLanes(k), gControllers.uplinkDown(k), uplink));
+
+                QVector<double> agg;
+                for (int n = 1; n <= slots.size(); ++n) {
+                    // check if pause time need to insert between tests
+                    if (tested) {
+                        pauseBar(ui->spinAfwl->value() * 1000);
+                    }
+                    tested = true;
+
+                    QString fio = QString::asprintf("ramp_exp%d_%02d", k+1, n) + time + ".fio";
+                    QString out = QString::asprintf("ramp_exp%d_%02d", k+1, n) + time + ".txt";
+                    QFile file(fio);
+                    if (false == file.open(QIODevice::WriteOnly | QIODevice::Text)) {
+                        throw QString("FIO script failed to open for write!");
+                    }
+                    QTextStream stream(&file);
+                    stream << "[global]"        << Qt::endl
+                           << "bs=128k"         << Qt::endl
+                           << "iodepth=16"      << Qt::endl
+                           << "direct=1"        << Qt::endl
+                           << "ioengine=libaio" << Qt::endl
+                           << "time_based"      << Qt::endl
+                           << "ramp_time=5"     << Qt::endl
+                           << "runtime=20"      << Qt::endl
+                           << "name=Uplink Ramp" << Qt::endl
+                           << "rw=read"         << Qt::endl << Qt::endl;
+                    for (int j = 0; j < n; ++j) {
+                        stream << "[job" << j+1 << "]" << Qt::endl
+                               << "filename=/dev/" << gDevices.block(slots[j]) << Qt::endl;
+                        for (const QString & opt : numa_job_options(slots[j])) {
+                            stream << opt << Qt::endl;
                         }
+                        stream << Qt::endl;
+                    }
+                    file.close();
+
+                    runFio(fio, out, 30 * 1000);
+                    file.remove();
+
+                    // KiB/s summed over the jobs, in MB/s to compare with the link rates
+                    double sum = 0;
+                    for (const _ST_FIOJOB & job : fio_parse_output(out)) {
+                        sum += job.bw_kbs * 1.024 / 1000;
                     }
+                    agg.append(sum);
+                    appendMessage(QString::asprintf("  %2d drives: %8.1f MB/s", n, sum));
+                    result << k+1 << "," << n << "," << QString::number(sum, 'f', 1) << ","
+                           << gControllers.uplinkLanes(k) << "," << uplink << Qt::endl;
+                }
+
+                double peak = *std::max_element(agg.cbegin(), agg.cend());
+                int knee = bw_find_knee(agg);
+                if (0 == knee) {
+                    appendMessage(QString::asprintf("  no knee over %d drives, peak %.1f MB/s", (int)agg.size(), peak));
+                } else {
+                    appendMessage(QString::asprintf("  knee at %d drives, plateau %.1f MB/s", knee, peak));
+                }
+                if (uplink > 0) {
+                    double ratio = peak / uplink;
+                    appendMessage(QString::asprintf("  %.0f%% of uplink theoretical: %s", ratio * 100,
+                                  (ratio >= UPLINK_BOUND) ? "uplink-bound" :
+                                  (knee ? "saturates below the uplink (expander/HBA/drive bound)" : "uplink not reached")));
                 }
             }
-            // Test is over!
-            appendMessage("Batch test is completed!");
+            csv.close();
+            if (false == tested) {
+                csv.remove();
+                throw QString("No device selected to test!");
+            }
+            appendMessage("Ramp test is completed! Results in " + csv.fileName());
 
         } catch (QString errMsg) {
             appendMessage(errMsg);
         }
-
-        for (int l = 0; l < sizeof(cbfd)/sizeof(cbfd[0]); ++l) {
-            cbfd[l]->setEnabled(true);
-        }
     }
 
     // Modal QMessageBox greys out the tab page, repaint the tab widget
@@ -695,7 +1290,6 @@ void Widget::autofio_wls(int wl)
 void Widget::btnListSdxClicked()
 {
     const char * SDX_LIST_FILE[] = { "Dino_sdx_list.txt", "512k_SeqW_4k_RandR.fio", "4k_RandW_4k_RandR.fio" };
-    void (Widget::*do_list[])(QTextStream & stream, int sl) = { &Widget::sdxlist_sit, &Widget::sdxlist_wl1, &Widget::sdxlist_wl2 };
 
     int choice = 0;
     if (ui->tabWidget->currentIndex() == ENUM_TAB::FIO) {
@@ -713,6 +1307,18 @@ void Widget::btnListSdxClicked()
             autofio_wls(2);
             return;
         }
+        if (ui->radRamp->isChecked()) {
+            rampTest();
+            return;
+        }
+        if (ui->radMpath->isChecked()) {
+            mpathBalance();
+            return;
+        }
+        if (ui->radFailover->isChecked()) {
+            mpathFailover();
+            return;
+        }
     }
 
     QMessageBox msgBox(this);
@@ -727,8 +1333,16 @@ void Widget::btnListSdxClicked()
         // We're going to streaming text to the file
         QTextStream stream(&file);
 
-        // Do the listing
-        (this->*do_list[choice])(stream, -1);
+        // Do the listing, the checked slots are the targets of a workload
+        if (0 == choice) {
+            sdxlist_sit(stream);
+        } else {
+            _ST_FIOMATRIX mx = fio_matrix_preset(choice);
+            QVector<QVector<_ST_FIOPOINT>> plan = fio_matrix_plan(mx);
+            if (false == plan.isEmpty()) {
+                fio_write_jobfile(stream, mx, plan[0]);
+            }
+        }
 
         // Close the output file
         file.close();
@@ -747,14 +1361,68 @@ void Widget::btnClearTBClicked()
 
 void Widget::btnSmpDoitClicked()
 {
-    int delay = 0;
+    int touched = 0;
     if (ui->radPhyDisable->isChecked()) {
         appendMessage("Disable phys...");
-        delay = phySetDisabled(true);
+        touched = phySetDisabled(true);
     }
     else if (ui->radPhyReset->isChecked()) {
         appendMessage("Enable phys...");
-        delay = phySetDisabled(false);
+        touched = phySetDisabled(false);
+    }
+    else if (ui->radPhyErrLog->isChecked()) {
+        // counters since the previous read, absolute the first time
+        static _ST_ERRSNAPSHOT last;
+        static _ST_DRVSNAPSHOT drv_last;
+        _ST_ERRSNAPSHOT snap;
+        _ST_DRVSNAPSHOT drv_snap;
+        appendMessage("Report phy error log...");
+        if (smp_errlog_snapshot(snap, verbose) > 0) {
+            smp_errlog_report(last, snap);
+            if (drive_port_snapshot(drv_snap, verbose) > 0) {
+                drive_port_report(drv_last, drv_snap, last, snap);
+                drv_last = drv_snap;
+            }
+            last = snap;
+        }
+        return;
+    }
+    else if (ui->radLinkAudit->isChecked()) {
+        appendMessage("Audit link rates...");
+        smp_link_audit(verbose);
+        return;
+    }
+    else if (ui->radFlapMon->isChecked()) {
+        // toggles: started here, stopped and ranked the next time
+        if (m_flaps->isRunning()) {
+            m_flaps->end();
+            m_flaps->report();
+        } else if (m_flaps->begin(verbose)) {
+            appendMessage("Flap monitor started, Go again to stop it and rank the phys");
+        }
+        return;
+    }
+    else if (ui->radSesStatus->isChecked()) {
+        // the configuration is only read again when its generation code moved
+        appendMessage("Read enclosure status...");
+        ses_refresh(verbose);
+        ses_report();
+        return;
+    }
+    else if (ui->radLedIdent->isChecked() || ui->radLedFault->isChecked() || ui->radLocateFlagged->isChecked()) {
+        // the LEDs of the selection (or the flagged) set or cleared, one control page write per enclosure
+        bool fault = ui->radLedFault->isChecked();
+        bool on = false == ui->cbLedOff->isChecked();
+        QVector<int> slots;
+        for (int i = 0; i < NSLOT; i++) {
+            if (ui->radLocateFlagged->isChecked() ? (0 != gDevices.slotFlags(i)) : gDevices.cbSlot(i)->isChecked()) {
+                slots.append(i);
+            }
+        }
+        int written = ses_set_leds(slots, fault ? SES_LED_FAULT : SES_LED_IDENT, on, verbose);
+        appendMessage(QString::asprintf("%s %s on %d slots, the others left as they are: %d enclosures written",
+                                        fault ? "FAULT" : "IDENT", on ? "set" : "cleared", (int)slots.size(), written));
+        return;
     }
     else if (ui->radDiscover->isChecked()) {
         appendMessage("Discover expanders...");
@@ -762,13 +1430,8 @@ void Widget::btnSmpDoitClicked()
         return;
     }
 
-    // Run a function with a delay in QT
-    if (delay > 0) {
-        QEventLoop loop;
-        QTimer::singleShot(delay, &loop, &QEventLoop::quit);
-        loop.exec();
-
-        // Refreshing ?...
+    // the links are settled by now
+    if (touched > 0) {
         filloutCanvas();
     }
 }
@@ -777,114 +1440,179 @@ void Widget::btnFio2GoClicked()
 {
     enum { RANDREAD=0, RANDWRITE, SEQREAD, SEQWRITE, RW_ALL };
     QString fioname[] = { "randread", "randwrite", "read", "write" };
-    QString bs[] = { "4K", "64K", "128K", "256", "512K", "1M" };
-    QString iodepth[] = { "8", "16" };
+    QString bs[] = { "4K", "64K", "128K", "256K", "512K", "1M" };
+    int iodepth[] = { 8, 16 };
     QString group[] = { "group_reporting=0", "#group_reporting"};
     int ramp_time[] = { 5, 10, 20, 30 };
     int runtime[] = { 60, 120, 180, 240 };
 
-    try {
-        int devCount = 0;
-        for (int i = 0; i < NSLOT; i++) {
-            if (false == gDevices.slotVacant(i) && true == gDevices.cbSlot(i)->isChecked()) {
-                ++devCount;
-            }
-        }
-        if (0 == devCount) {
-            throw QString("No device selected to test!");
-        }
-
-        // ipmitool sets fan duty to 100%
-        setFanDuty("100");
-
-        int il, loops;
-        if (RW_ALL == ui->cbxRW->currentIndex()) {
-            il = RANDREAD;
-            loops = 4;
-        } else {
-            il = ui->cbxRW->currentIndex();
-            loops = 1;
-        }
-
-        bool tested = false;
-        int processed = 0;
-
-        // loop through the RW action
-        for (int m = 0; m < loops; ++m, ++il) {
-
-            // check if pause time need to insert between tests
-            if (tested) {
-                pauseBar(ui->spinFio2Wl->value() * 1000);
-            }
-            tested = true;
-
-            QDateTime date(QDateTime::currentDateTime());
-            QString time = date.toString("_yyyyMMdd_hhmmss");
-            QString fio = "fio2_" + fioname[il] + "_" + time + ".fio";
-            QString out = "fio2_" + fioname[il] + "_" + time + ".txt";
-            QString msg = fio + "  -->  " + out + QString::asprintf(" (%d/%d)", ++processed, loops);
-            appendMessage(msg);
-
-            QFile file(fio);
-            if (false == file.open(QIODevice::WriteOnly | QIODevice::Text)) {
-                throw QString("FIO script failed to open for write!");
-            }
-
-            // We're going to streaming text to the file
-            QTextStream stream(&file);
-
-            // Do the listing
-            stream << "[global]" << Qt::endl
-                   << "bs=" << bs[ui->cbxBS->currentIndex()] << Qt::endl
-                   << "iodepth=" << iodepth[ui->cbxIODepth->currentIndex()] << Qt::endl
-                   << "direct=1" << Qt::endl
-                   << "ioengine=libaio" << Qt::endl
-                   << group[ui->cbxGroup->currentIndex()] << Qt::endl
-                   << "time_based" << Qt::endl
-                   << "ramp_time=" << ramp_time[ui->cbxRamp->currentIndex()] << Qt::endl
-                   << "runtime=" << runtime[ui->cbxRuntime->currentIndex()] << Qt::endl
-                   << "name=" << fioname[il] << Qt::endl
-                   << "rw=" << fioname[il] << Qt::endl << Qt::endl;
+    _ST_FIOMATRIX mx;
+    mx.name = "fio2";
+    if (RW_ALL == ui->cbxRW->currentIndex()) {
+        mx.rw << fioname[RANDREAD] << fioname[RANDWRITE] << fioname[SEQREAD] << fioname[SEQWRITE];
+    } else {
+        mx.rw << fioname[ui->cbxRW->currentIndex()];
+    }
+    mx.bs << bs[ui->cbxBS->currentIndex()];
+    mx.iodepth << iodepth[ui->cbxIODepth->currentIndex()];
+    mx.numjobs << 1;
+    mx.fan << "100";
+    mx.targets = ENUM_TARGETSET::TGT_CHECKED;
+    mx.ramp = ramp_time[ui->cbxRamp->currentIndex()];
+    mx.runtime = runtime[ui->cbxRuntime->currentIndex()];
+    mx.pause = ui->spinFio2Wl->value();
+    mx.merge = false;
+    mx.autosize = ui->cbAutoSize->isChecked();
+    mx.global << group[ui->cbxGroup->currentIndex()];
+    mx.tuning = (ui->cbxTuning2->currentIndex() > 0) ? ui->cbxTuning2->currentText() : QString();
 
-            int jobn = 0;
+    try {
+        runMatrix(mx);
 
-            // loop through the expanders discovered
-            for (int k = 0; k < NEXPDR; ++k) {
-                stream << "## Expander-" << k+1 << Qt::endl;
-                if (false == gControllers.bsgPath(k).isEmpty()) {
-                    // Workload 1
-                    for (int i = k*NSLOT_PEREXP; i < (k+1)*NSLOT_PEREXP; ++i) {
-                        // check if this slot is occupied?
-                        if (false == gDevices.slotVacant(i) && true == gDevices.cbSlot(i)->isChecked()) {
-                            stream << "[job" << ++jobn << "]" << Qt::endl
-                                   << "filename=/dev/" << gDevices.block(i) << Qt::endl << Qt::endl;
-                        }
-                    }
-                }
-            }
+    } catch (QString errMsg) {
+        appendMessage(errMsg);
+    }
 
-            // Close the script file
-            file.close();
+    // Modal QMessageBox greys out the tab page, repaint the tab widget
+    ui->tabWidget->repaint();
+}
 
-            // Execute FIO test
-            QStringList arguments;
-            arguments << fio << "--output" << out;
-            startWorkInAThread("fio", arguments, (ramp_time[ui->cbxRamp->currentIndex()] + runtime[ui->cbxRuntime->currentIndex()]) * 1000);
+void Widget::btnMatrixClicked()
+{
+    QString path = QFileDialog::getOpenFileName(this, "Workload Matrix", QString(), "Matrix (*.json)");
+    if (path.isEmpty()) {
+        return;
+    }
 
-            // Finally, remove the script file
-            //file.remove();
+    try {
+        _ST_FIOMATRIX mx;
+        QString err;
+        if (false == fio_matrix_load(path, mx, err)) {
+            throw err;
+        }
+        if (ui->cbAutoSize->isChecked()) {
+            mx.autosize = true;
         }
-        // Test is over!
-        appendMessage("Batch test is completed!");
+        runMatrix(mx);
 
     } catch (QString errMsg) {
         appendMessage(errMsg);
     }
 
-    // Modal QMessageBox greys out the tab page, repaint the tab widget
+    // Modal QFileDialog greys out the tab page, repaint the tab widget
     ui->tabWidget->repaint();
 }
 
+/*
+ * SG3: SCSI commands to the checked slots, all of them in parallel over
+ * SG_IO rather than a tool run per drive.
+ */
+void Widget::btnSg3GoClicked()
+{
+    QVector<int> slots;
+    for (int i = 0; i < NSLOT; i++) {
+        if (false == gDevices.slotVacant(i) && gDevices.cbSlot(i)->isChecked()) {
+            slots.append(i);
+        }
+    }
+    if (ui->radSg3BlkLat->isChecked()) {
+        // toggles: traced from here, alongside fio or any other traffic, until the next time
+        if (m_blklat->isRunning()) {
+            m_blklat->end();
+            m_blklat->report();
+        } else if (slots.isEmpty()) {
+            appendMessage("No slot is checked!");
+        } else if (m_blklat->begin(slots, verbose)) {
+            appendMessage(QString::asprintf("Block latency traced on %d slots, Go again to stop", (int)slots.size()));
+        }
+        return;
+    }
+    if (ui->radSg3Scan->isChecked()) {
+        // toggles: started or resumed here, stopped with a checkpoint the next time
+        if (m_scan->isRunning()) {
+            m_scan->end();
+            m_scan->report();
+            appendMessage("Media scan stopped, Go again to resume it");
+        } else if (m_scan->begin(slots, verbose)) {
+            appendMessage("Go again to stop the media scan");
+        } else {
+            appendMessage("No slot is checked!");
+        }
+        return;
+    }
+    if (slots.isEmpty()) {
+        appendMessage("No slot is checked!");
+        return;
+    }
+
+    if (ui->radSg3Sweep->isChecked()) {
+        QElapsedTimer clock;
+        clock.start();
+        QVector<_ST_SG3INFO> infos = sg3_sweep(slots, verbose);
+        qint64 elapsed = clock.elapsed();
+
+        QVector<QStringList> rows;
+        QStringList tips;
+        for (const _ST_SG3INFO & info : infos) {
+            rows.append({
+                QString::number(info.slot + 1),
+                gDevices.block(info.slot),
+                info.vendor + " " + info.model,
+                info.firmware,
+                sg3_rotation_str(info.rotation),
+                sg3_capacity_str(info),
+                info.opt_xfer ? QString::number((qulonglong) info.opt_xfer * info.block_len / 1024) + " KiB" : QString("-"),
+                (0 == info.ready) ? QString("yes") : ((info.ready > 0) ? QString::asprintf("key %xh", info.ready) : QString("failed"))
+            });
+            tips.append(info.serial + (info.naa.isEmpty() ? QString() : " naa." + info.naa));
+        }
+        sg3Table({"Slot", "Device", "Model", "Firmware", "Rotation", "Capacity", "Opt. Xfer", "Ready"}, rows, tips);
+        sg3_latency_report(infos, elapsed);
+    }
+    else if (ui->radSg3Mode->isChecked()) {
+        QVector<QStringList> rows;
+        for (const _ST_MODEPAGES & pages : mode_sense_sweep(slots, verbose)) {
+            rows.append(mode_audit_row(pages));
+        }
+        sg3Table({"Slot", "Device", "Write Cache", "Read Cache", "Read-ahead", "Power Conditions", "Saved"}, rows);
+        appendMessage(QString::asprintf("Mode page audit: %d drives", (int)rows.size()));
+    }
+    else if (ui->radSg3ModeApply->isChecked()) {
+        bool save = ui->cbModeSave->isChecked();
+        if (save && QMessageBox::Yes != QMessageBox::question(this, "Mode Apply",
+                "Save the profile in the drives? It stays over power cycles until rolled back.")) {
+            return;
+        }
+        mode_apply_profile(slots, ui->cbxModeProfile->currentText(), save, verbose);
+    }
+    else if (ui->radSg3ModeUndo->isChecked()) {
+        if (0 == mode_rollback_pending()) {
+            appendMessage("No mode profile to roll back");
+        } else {
+            mode_rollback(verbose);
+        }
+    }
+}
+
+/* The SG3 results as a table in the message pane, a tooltip per row if given */
+void Widget::sg3Table(const QStringList & headers, const QVector<QStringList> & rows, const QStringList & tips)
+{
+    QString html = "<table cellspacing=0 cellpadding=2><tr>";
+    for (const QString & h : headers) {
+        html += "<th>" + h + "</th>";
+    }
+    html += "</tr>";
+    for (int r = 0; r < rows.size(); ++r) {
+        html += (r < tips.size()) ? "<tr title=\"" + tips[r].toHtmlEscaped() + "\">" : QString("<tr>");
+        for (const QString & col : rows[r]) {
+            html += "<td>" + col.toHtmlEscaped() + "</td>";
+        }
+        html += "</tr>";
+    }
+    html += "</table>";
+    appendMessage(html);
+}
+
 void Widget::tabSelected()
 {
     static int lastIndex = 0;
@@ -917,13 +1645,12 @@ void Widget::tabSelected()
         ui->textInfo->clear();
         if (cardType == ENUM_CARDTYPE::HBA9500) {
             ui->textInfo->append("HBA is 9500");
-            break;
-        }
-        if (cardType == ENUM_CARDTYPE::RAID9x60) {
+        } else if (cardType == ENUM_CARDTYPE::RAID9x60) {
             ui->textInfo->append("RAID9x60 plug-in card");
-            break;
+        } else {
+            ui->textInfo->append(get_infofacts());
         }
-        ui->textInfo->append(get_infofacts());
+        ui->textInfo->append(numa_describe());
         // Scroll QTextBrowser to the top
         QTextCursor cursor = ui->textInfo->textCursor();
         cursor.setPosition(0);
@@ -936,6 +1663,7 @@ void Widget::filloutCanvas(bool uncheck)
 {
     gDevices.clear(uncheck);
     gControllers.clear();
+    numa_reset();
     list_sdevices(verbose);
 
     if (cardType == ENUM_CARDTYPE::HBA9500) {
@@ -955,56 +1683,44 @@ void Widget::filloutCanvas(bool uncheck)
             ui->textInfo->setTextCursor(cursor);
         }
     }
+
+    // the ports of the dual-ported drives, and their multipath devices
+    mpath_scan(verbose);
 }
 
-/* return value is the delay time */
+/* return value is the number of phys controlled */
 int Widget::phySetDisabled(bool disable)
 {
-    smp_target_obj tobj;
-    int k, i, ret = 0;
+    QVector<_ST_PHYCTL> ops[NEXPDR];
+    int k, i, count = 0;
 
-    // loop through the expanders discovered
+    // the phys of the slots selected, per expander
     for (k = 0; k < NEXPDR; ++k) {
-        if (false == gControllers.bsgPath(k).isEmpty()) {
-            if (verbose) {
-                qDebug() << "----> phy controlling " << gControllers.bsgPath(k);
-            }
-            tobj.opened = 0;
-            // loop through the slots listed
-            for (i = k*NSLOT_PEREXP; i < (k+1)*NSLOT_PEREXP; ++i) {
-                // check if the slot is selected or not?
-                if (gDevices.cbSlot(i)->isChecked()) {
-                    // the expander is to be opened for the 1st selected slot
-                    if (0 == tobj.opened) {
-                        IntfEnum sel = (cardType == ENUM_CARDTYPE::HBA9500) ? I_SGV4 : I_SGV4_MPI;
-                        // assign the IOC number for multiple adapters case
-                        int res = smp_initiator_open(gControllers.bsgPath(k), sel, &tobj, verbose);
-                        if (res < 0) {
-                            break;
-                        }
-                        // signal Delay after function return
-                        ret = 10;
-                    }
-                    // check if a resonable phy id (4 - 31)
-                    int phy_id = gDevices.slotPhyId(i);
-                    if (phy_id > 3 && phy_id < 32) {
-                        // assign sas address for path-through
-                        tobj.sas_addr64 = gControllers.wwid64(k);
-                        // to issue PHY CONTROL request
-                        phy_control(&tobj, phy_id, disable, verbose);
-                    } else {
-                        gAppendMessage(QString::asprintf("found a phy id(%d) illegal on slot #%d", phy_id, i + 1));
-                    }
-                    gDevices.cbSlot(i)->setCheckState(Qt::CheckState::Unchecked);
+        for (i = k*NSLOT_PEREXP; i < (k+1)*NSLOT_PEREXP; ++i) {
+            // check if the slot is selected or not?
+            if (gDevices.cbSlot(i)->isChecked()) {
+                // check if a resonable phy id (4 - 31)
+                int phy_id = gDevices.slotPhyId(i);
+                if (phy_id > 3 && phy_id < 32) {
+                    _ST_PHYCTL op = { phy_id, i, disable };
+                    ops[k].append(op);
+                    count++;
+                } else {
+                    gAppendMessage(QString::asprintf("found a phy id(%d) illegal on slot #%d", phy_id, i + 1));
                 }
-            }
-            // check if close the opened expander
-            if (tobj.opened) {
-                smp_initiator_close(&tobj);
+                gDevices.cbSlot(i)->setCheckState(Qt::CheckState::Unchecked);
             }
         }
     }
-    return ret;
+    if (0 == count) {
+        return 0;
+    }
+
+    // all expanders at once, waiting on the links rather than a fixed delay
+    int done = smp_phy_control_batch(ops, PHYCTL_DEADLINE_MS, verbose);
+    smp_phy_control_report(ops);
+    gAppendMessage(QString::asprintf("%d of %d phys %s", done, count, disable ? "disabled" : "reset and up"));
+    return count;
 }
 
 void gAppendMessage(QString message)
@@ -13,11 +13,17 @@
 #include <QWidget>
 
 #include "smp_discover.h"
+#include "fio_matrix.h"
 
 QT_BEGIN_NAMESPACE
 namespace Ui { class Widget; }
 QT_END_NAMESPACE
 
+class SlotSampler;
+class FlapMonitor;
+class MediaScan;
+class BlkLatTracer;
+
 #define NEXPDR 4
 #define NSLOT_PEREXP 28
 #define NSLOT (NEXPDR * NSLOT_PEREXP)
@@ -46,6 +52,22 @@ typedef enum {
     SDx
 } ENUM_COMBO;
 
+typedef enum {
+    SLOW_BW     = 0x01,     // bandwidth well below the group median
+    TAIL_LAT    = 0x02,     // 99th percentile latency well above the group median
+    LOAD_DROP   = 0x04,     // bandwidth falls under load more than its peers
+    LINK_DOWN   = 0x08      // link negotiated below the rate of its capability and peers
+} ENUM_SLOTFLAG;
+
+typedef struct ST_SLOTPERF {
+    QString workload;       // "rw/bs" signature of the run measured
+    double bw_kbs;          // KiB/s (read + write)
+    double iops;
+    double lat_us;          // mean completion latency
+    double p99_us;          // 99th percentile completion latency
+    int njobs;              // concurrent jobs in the run measured
+} _ST_SLOTPERF;
+
 typedef struct ST_SLOTINFO {
     QCheckBox * cb_slot;
     QString d_name;
@@ -53,6 +75,15 @@ typedef struct ST_SLOTINFO {
     QString block;
     uchar discover_resp[SMP_FN_DISCOVER_RESP_LEN];
     int resp_len;
+    QString model;
+    QString perf_wwid;      // the device which perf/solo were measured on
+    _ST_SLOTPERF perf;      // the latest run on this slot
+    _ST_SLOTPERF solo;      // the latest run with this slot tested alone
+    int flags;
+    QString heat;           // live heatmap background, empty when not sampled
+    QString live;           // live statistics for the tooltip
+    QString mpath;          // which path of a dual-ported drive, empty if single
+    QString blklat;         // block layer latency traced by eBPF, empty if not traced
 } _ST_SLOTINFO;
 
 class DeviceFunc
@@ -66,19 +97,34 @@ public:
     void setSlot(QString dir_name, QString device, QString enclosure_device_name) {
         setSlot(dir_name, device, enclosure_device_name.right(2).toShort(0, 16) - 1);
     }
-    void setSlot(int slp, QString d_name, QString wwid, QString block);
+    void setSlot(QString dir_name, QString device, int sl);
+    void setSlot(int slp, QString d_name, QString wwid, QString block, QString model = QString());
     void setDiscoverResp(int dsn, uchar * src, int len);
     void setSlotLabel(int sl);
+    void setSlotPerf(int sl, const _ST_SLOTPERF & perf);
+    void setSlotFlags(int sl, int flags);
+    void setSlotHeat(int sl, const QString & color, const QString & live);
+    void setSlotTip(int sl, const QString & live);
+    void setSlotMpath(int sl, const QString & mpath);
+    void setSlotBlkLat(int sl, const QString & blklat);
     bool slotVacant(int sl) { return (sl == valiIndex(sl)) ? SlotInfo[sl].d_name.isEmpty() : false; }
     int count() { return myCount; }
 
     QCheckBox *& cbSlot(int sl) { return (sl == valiIndex(sl)) ? SlotInfo[sl].cb_slot : dummyCbSlot(); }
     const QString& block(int sl) { return (sl == valiIndex(sl)) ? SlotInfo[sl].block : dummySlotInfo.block; }
+    const QString& wwid(int sl) { return (sl == valiIndex(sl)) ? SlotInfo[sl].wwid : dummySlotInfo.wwid; }
+    const QString& model(int sl) { return (sl == valiIndex(sl)) ? SlotInfo[sl].model : dummySlotInfo.model; }
+    const _ST_SLOTPERF& perf(int sl) { return (sl == valiIndex(sl)) ? SlotInfo[sl].perf : dummySlotInfo.perf; }
+    const _ST_SLOTPERF& solo(int sl) { return (sl == valiIndex(sl)) ? SlotInfo[sl].solo : dummySlotInfo.solo; }
+    int slotFlags(int sl) { return (sl == valiIndex(sl)) ? SlotInfo[sl].flags : 0; }
     int slotPhyId(int sl) { return (sl == valiIndex(sl) && SlotInfo[sl].resp_len > 9) ? SlotInfo[sl].discover_resp[9] : -1; }
+    int slotLinkRate(int sl) { return (sl == valiIndex(sl) && SlotInfo[sl].resp_len > 13) ? (SlotInfo[sl].discover_resp[13] & 0xf) : 0; }
 
 private:
     void clrSlot(int sl, bool uncheck = true);
-    void setSlot(QString dir_name, QString device, int sl);
+    void keepSlotPerf(int sl);
+    void setSlotStyle(int sl);
+    void setSlotToolTip(int sl);
     int valiIndex(int sl) {
         if ((unsigned)sl < NSLOT)
             return sl;
@@ -109,6 +155,9 @@ typedef struct ST_GBOXINFO {
     uint64_t wwid64;
     uchar discover_resp[SMP_FN_DISCOVER_RESP_LEN];
     int resp_len;
+    int uplink_lanes;       // phys of the wide port attached to the HBA, up or down
+    int uplink_down;        // lanes of the wide port that are down
+    int uplink_mbps;        // theoretical bandwidth summed over the lanes up
 } _ST_GBOXINFO;
 
 class ExpanderFunc
@@ -121,11 +170,15 @@ public:
     void setController(QString expander, uint64_t wwid);
     void setDiscoverResp(QString path, uint64_t ull, uint64_t sa, uchar * src, int len);
     void setBsgPath(QString path, uint64_t ull) { GboxInfo[WWID_TO_INDEX(ull)].bsg_path = path; }
+    void addUplinkPhy(uint64_t ull, int phy_id, int negot);
     int count() { return myCount; }
 
     QGroupBox *& gbThe(int el) { return (el == valiIndex(el)) ? GboxInfo[el].gbox : dummyGbox(); }
     const QString& bsgPath(int el) { return (el == valiIndex(el)) ? GboxInfo[el].bsg_path : dummyGboxInfo.bsg_path; }
     uint64_t wwid64(int el) { return (el == valiIndex(el)) ? GboxInfo[el].wwid64 : dummyGboxInfo.wwid64; }
+    int uplinkLanes(int el) { return (el == valiIndex(el)) ? GboxInfo[el].uplink_lanes : 0; }
+    int uplinkDown(int el) { return (el == valiIndex(el)) ? GboxInfo[el].uplink_down : 0; }
+    int uplinkMBps(int el) { return (el == valiIndex(el)) ? GboxInfo[el].uplink_mbps : 0; }
 
 private:
     int valiIndex(int el) {
@@ -169,31 +222,38 @@ private slots:
     void btnClearTBClicked();
     void btnSmpDoitClicked();
     void btnFio2GoClicked();
+    void btnMatrixClicked();
+    void btnSg3GoClicked();
     void tabSelected();
     void showModified(const QString & path);
 
 protected:
-    void closeEvent(QCloseEvent *event) {
-        qDebug() << "Close button is pressed!!";
-        m_closed++;
-        QWidget::closeEvent(event);
-    }
+    void closeEvent(QCloseEvent *event);
 
 private:
     void filloutCanvas(bool uncheck = true);
     int phySetDisabled(bool disable);
     void sdxlist_sit(QTextStream & stream, int sl = -1);
-    void sdxlist_wl1(QTextStream & stream, int sl = -1);
-    void sdxlist_wl2(QTextStream & stream, int sl = -1);
     void autofio_wls(int wl);
+    void fioAnalyze(const QVector<_ST_FIOJOB> & jobs);
+    void runMatrix(const _ST_FIOMATRIX & mx);
+    void rampTest();
+    void mpathBalance();
+    void mpathFailover();
+    void runFio(const QString & fio, const QString & out, int progress_maxms);
     void startWorkInAThread(const QString & program, const QStringList & arguments, int progress_maxms = 0);
     void setFanDuty(const QString duty);
     void pauseBar(const int pause_ms);
+    void sg3Table(const QStringList & headers, const QVector<QStringList> & rows, const QStringList & tips = QStringList());
 
     Ui::Widget * ui;
     QVBoxLayout * m_layout;
     QSystemTrayIcon * m_trayIcon;
     QFileSystemWatcher * m_Watcher;
+    SlotSampler * m_sampler;
+    FlapMonitor * m_flaps;
+    MediaScan * m_scan;
+    BlkLatTracer * m_blklat;
     int m_closed;
 };
 